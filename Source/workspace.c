@@ -12,6 +12,7 @@
 #include <exec/types.h>
 #include <exec/execbase.h>
 #include <exec/memory.h>
+#include <exec/interrupts.h>
 #include <dos/dos.h>
 #include <dos/dostags.h>
 #include <intuition/intuition.h>
@@ -29,6 +30,7 @@
 #include <libraries/commodities.h>
 #include <devices/input.h>
 #include <devices/inputevent.h>
+#include <devices/timer.h>
 #include <dos/datetime.h>
 #include <libraries/locale.h>
 #include <datatypes/datatypes.h>
@@ -39,6 +41,7 @@
 #include <proto/graphics.h>
 #include <proto/gadtools.h>
 #include <graphics/modeid.h>
+#include <graphics/displayinfo.h>
 #include <graphics/gfx.h> 
 #include <proto/icon.h>
 #include <proto/wb.h>
@@ -47,6 +50,7 @@
 #include <proto/locale.h>
 #include <proto/datatypes.h>
 #include <proto/input.h>
+#include <proto/timer.h>
 #include <clib/alib_protos.h>
 #include <string.h>
 
@@ -78,11 +82,57 @@ VOID ReleaseDTDrawInfo(Object *o, APTR handle);
 #ifndef NP_StackSize
 #define NP_Dummy      (TAG_USER + 1000)
 #define NP_StackSize  (NP_Dummy + 11)   /* stacksize for process - default 4000 */
+#define NP_ExitCode   (NP_Dummy + 24)   /* code to be called on process exit */
+#define NP_ExitData   (NP_Dummy + 25)   /* optional argument for NP_ExitCode function */
 #endif
 
 #include <stdlib.h>
 #include <stdarg.h>
 
+/* Log levels - select at build time with DEFINE WS_LOG_LEVEL=n (see SMakefile) */
+/* Release builds default to WARN so the event loop and menu handlers contain */
+/* no formatting or DOS calls; build with WS_LOG_LEVEL=4 for full tracing */
+#define WS_LOG_NONE  0
+#define WS_LOG_ERROR 1
+#define WS_LOG_WARN  2
+#define WS_LOG_INFO  3
+#define WS_LOG_TRACE 4
+
+#ifndef WS_LOG_LEVEL
+#define WS_LOG_LEVEL WS_LOG_WARN
+#endif
+
+/* C89 has no variadic macros, so the Printf() argument list is passed in */
+/* its own parentheses: LOG_TRACE(("Workspace: value=%ld\n", value)); */
+/* A disabled level expands to nothing, arguments are never evaluated. */
+/* Enabled levels go through LogPrintf(), which either prints directly or */
+/* queues a binary record in the log ring (see LOGFILE argument). */
+#define LOG_EMIT(level, args) (logSiteLevel = (level), logSiteLine = __LINE__, LogPrintf args)
+
+#if WS_LOG_LEVEL >= WS_LOG_ERROR
+#define LOG_ERROR(args) LOG_EMIT(WS_LOG_ERROR, args)
+#else
+#define LOG_ERROR(args) ((void)0)
+#endif
+
+#if WS_LOG_LEVEL >= WS_LOG_WARN
+#define LOG_WARN(args) LOG_EMIT(WS_LOG_WARN, args)
+#else
+#define LOG_WARN(args) ((void)0)
+#endif
+
+#if WS_LOG_LEVEL >= WS_LOG_INFO
+#define LOG_INFO(args) LOG_EMIT(WS_LOG_INFO, args)
+#else
+#define LOG_INFO(args) ((void)0)
+#endif
+
+#if WS_LOG_LEVEL >= WS_LOG_TRACE
+#define LOG_TRACE(args) LOG_EMIT(WS_LOG_TRACE, args)
+#else
+#define LOG_TRACE(args) ((void)0)
+#endif
+
 /* Library base pointers */
 extern struct ExecBase *SysBase;
 extern struct DosLibrary *DOSBase;
@@ -97,24 +147,92 @@ struct GfxBase *GfxBase = NULL;
 struct MsgPort *InputPort = NULL;
 struct IOStdReq *InputIO = NULL;
 struct Library *InputBase = NULL;
+struct MsgPort *TimerPort = NULL;
+struct timerequest *TimerIO = NULL;
+struct Device *TimerBase = NULL;
+ULONG eclockFrequency = 0;  /* E-Clock ticks per second from ReadEClock() */
 
 /* Forward declarations */
 VOID Cleanup(VOID);
+BOOL InitializeTimer(VOID);
+VOID CleanupTimer(VOID);
 BOOL InitializeLibraries(VOID);
+BOOL OpenDesktopLibraries(VOID);
 BOOL InitializeCommodity(VOID);
 VOID CleanupCommodity(VOID);
 BOOL CreateWorkspaceScreen(VOID);
 BOOL CloseWorkspaceScreen(VOID);
+BOOL ClosePrivateScreen(VOID);
 BOOL CreateBackdropWindow(VOID);
 VOID CloseBackdropWindow(VOID);
+VOID CloseWindowSafely(struct Window *window);
 BOOL CreateMenuStrip(VOID);
+BOOL AttachMenuStrip(VOID);
 VOID FreeMenuStrip(VOID);
 BOOL CreateShellConsole(VOID);
 VOID CloseShellConsole(VOID);
+__saveds __asm LONG ShellExitCode(register __d0 LONG returnCode, register __d1 LONG exitData);
+VOID HandleShellExit(VOID);
+BOOL StartCommodityTask(VOID);
+VOID StopCommodityTask(VOID);
+__saveds VOID CommodityTask(VOID);
+BOOL ServiceCommodityMessage(CxMsg *cxmsg);
+VOID OpenRequester(struct Window *refWindow, struct EasyStruct *es);
+VOID HandleRequester(VOID);
+VOID CloseRequester(VOID);
 BOOL LoadBackdropImage(STRPTR imagePath);
 VOID FreeBackdropImage(VOID);
 VOID ProcessCommodityMessages(VOID);
-STRPTR GetWorkspaceName(VOID);
+struct Desktop;
+struct Desktop *NewDesktop(STRPTR pubName);
+struct Process *FindShellProcess(struct Desktop *desktop);
+VOID FreeDesktop(struct Desktop *desktop);
+VOID SetFrontDesktop(struct Desktop *desktop);
+BOOL SetDesktopBackdrop(struct Desktop *desktop, STRPTR path);
+struct ModeProfile;
+struct Desktop *OpenDesktop(STRPTR pubName, struct ModeProfile *mode, BOOL materialize);
+VOID ResolveModeProfile(struct ModeProfile *mode);
+BOOL NextModeStep(struct ModeProfile *mode);
+UWORD ValidModeDepth(LONG depth);
+BOOL WorkbenchIsNative(VOID);
+ULONG ModeChipCost(struct ModeProfile *mode);
+ULONG ScreenChipCost(struct Screen *screen);
+BOOL SameModeProfile(struct ModeProfile *a, struct ModeProfile *b);
+BOOL MaterializeDesktop(struct Desktop *desktop, BOOL profile);
+struct Desktop *FindDesktop(STRPTR name);
+BOOL ShowDesktop(VOID);
+BOOL HibernateDesktop(struct Desktop *desktop);
+VOID LinkDesktop(struct Desktop *desktop);
+BOOL PrepareSpareDesktop(VOID);
+struct Desktop *AdoptSpareDesktop(VOID);
+BOOL FreeSpareDesktop(struct Desktop *desktop);
+VOID RefillSpareLater(VOID);
+BOOL InstallMemHandler(VOID);
+VOID RemoveMemHandler(VOID);
+__saveds __asm LONG LowMemoryHandler(register __a0 struct MemHandlerData *data, register __a1 APTR isData);
+VOID ShedMemory(VOID);
+BOOL ShedBackdrops(VOID);
+BOOL ShedPalettes(VOID);
+BOOL ShedMenus(VOID);
+VOID RestoreShedResources(VOID);
+BOOL CapturePalette(struct Screen *screen);
+BOOL CloseDesktop(struct Desktop *desktop);
+VOID RequestCloseAllDesktops(VOID);
+VOID CloseRequestedDesktops(VOID);
+BOOL CreateLaunchPort(VOID);
+VOID CloseLaunchPort(VOID);
+BOOL SendLaunchMessage(VOID);
+VOID WarnManagerOnlyArgs(VOID);
+VOID HandleLaunchMessages(VOID);
+struct LaunchMessage;
+struct Desktop *OpenLaunchDesktop(STRPTR pubName, struct LaunchMessage *launch, BOOL materialize);
+BOOL OpenRegistry(VOID);
+VOID CloseRegistry(VOID);
+BOOL RegisterScreen(struct Desktop *desktop);
+VOID UnregisterScreen(struct Desktop *desktop);
+struct RegistryEntry *RegistryFind(STRPTR name);
+VOID RegistryChanged(VOID);
+WORD RegistryVisitors(struct RegistryEntry *entry);
 VOID ParseToolTypes(VOID);
 BOOL ParseCommandLine(VOID);
 VOID HandleAboutMenu(VOID);
@@ -122,57 +240,390 @@ BOOL HandleCloseMenu(VOID);  /* Returns TRUE if quit should proceed, FALSE if bl
 VOID HandleShellConsoleMenu(VOID);
 VOID HandleWindowsMenu(ULONG itemNumber);  /* Handle Windows menu items */
 WORD CheckWorkspaceVisitors(VOID);
+VOID ShowVisitorRequester(WORD otherWindows);
+VOID ShowShellRequester(VOID);
 VOID HandleSetAsDefaultMenu(struct MenuItem *menuItem);
 VOID HandleDefaultPubScreenSubMenu(STRPTR screenName);
-struct NewMenu *BuildDefaultPubScreenMenu(ULONG *menuCount);
+struct NewMenu *BuildDefaultPubScreenMenu(VOID);
 BOOL GetToolType(STRPTR toolType, STRPTR defaultValue, STRPTR buffer, ULONG bufferSize);
 VOID HandleThemeMenu(ULONG itemNumber);  /* Handle Theme menu items */
 BOOL ApplyTheme(ULONG themeIndex);  /* Apply color theme to screen */
+VOID LogPrintf(CONST_STRPTR format, ...);
+BOOL StartLogRing(STRPTR path);
+VOID FlushLogRing(VOID);
+VOID StopLogRing(VOID);
+VOID EClockElapsed(struct EClockVal *from, struct EClockVal *to, ULONG *seconds, ULONG *micros);
+struct ScheduledTimer;
+VOID ScheduleTimer(struct ScheduledTimer *timer, ULONG delayMicros);
+VOID CancelTimer(struct ScheduledTimer *timer);
+VOID RunDueTimers(VOID);
+VOID ArmTimer(VOID);
+VOID LogFlushTimer(struct ScheduledTimer *timer);
+VOID HibernateTimer(struct ScheduledTimer *timer);
+VOID SpareTimer(struct ScheduledTimer *timer);
+struct LatencyProbe;
+VOID LatencyBegin(struct LatencyProbe *probe, ULONG seconds, ULONG micros);
+VOID LatencyEnd(struct LatencyProbe *probe, ULONG action);
+ULONG LatencyRecord(struct LatencyProbe *probe, ULONG action);
+BPTR StatsOutput(VOID);
+VOID DumpLatencyStats(BPTR file);
+struct MemProbe;
+VOID MemProbeBegin(struct MemProbe *probe);
+VOID MemProbeEnd(struct MemProbe *probe, ULONG account);
+VOID MemCharge(ULONG account, ULONG requirements, LONG bytes);
+VOID DumpMemStats(BPTR file);
+struct WsCommand;
+BOOL RunCommand(struct WsCommand *command, ULONG seconds, ULONG micros);
+BOOL CmdDefaultPubScreen(struct WsCommand *command);
+BOOL CmdAbout(struct WsCommand *command);
+BOOL CmdQuit(struct WsCommand *command);
+BOOL CmdShell(struct WsCommand *command);
+BOOL CmdWindows(struct WsCommand *command);
+BOOL CmdTheme(struct WsCommand *command);
+BOOL CmdScreenToFront(struct WsCommand *command);
+BOOL CmdNewDesktop(struct WsCommand *command);
+BOOL CmdCycleDesktop(struct WsCommand *command);
+BOOL CmdGotoDesktop(struct WsCommand *command);
+BOOL CmdPubScreenPage(struct WsCommand *command);
+VOID SwitchDesktop(struct Desktop *desktop);
+CxObj *AddHotKey(CxObj *broker, struct MsgPort *port, STRPTR description, struct WsCommand *command);
+struct WsCommand *NewScreenCommand(STRPTR screenName);
+VOID FreeMenuPool(VOID);
+APTR AllocMenuMemory(ULONG size);
+ULONG BuildPubScreenItems(struct NewMenu *items, ULONG maxItems);
+VOID AddPubScreenItem(struct NewMenu *item, struct WsCommand *command, STRPTR defaultName);
+VOID RefreshPubScreenMenus(VOID);
+BOOL RebuildPubScreenItems(struct MenuItem *parent);
+VOID SyncPubScreenChecks(struct MenuItem *parent);
+struct WindowBatch;
+VOID DrainWindowPort(struct MsgPort *userPort, struct WindowBatch *batch);
+VOID RunWindowBatch(struct WindowBatch *batch);
+VOID RefreshBackdropWindow(VOID);
+VOID ProfileMark(VOID);
+VOID ProfilePhase(STRPTR name);
+VOID WriteProfileReport(VOID);
 
 /* Version string */
 static const char *verstag = "$VER: Workspace 47.1 (1.1.2026)\n";
 static const char *stack_cookie = "$STACK: 8192\n";
 const long oslibversion = 47L;
 
-/* Application state */
-struct WorkspaceState {
+/* Most desktops one manager owns */
+#define WS_MAX_DESKTOPS 16
+
+/* Goto-desktop hotkeys - CX_GOTOKEY followed by 1..9 */
+#define WS_GOTO_KEYS 9
+
+/* Screen mode of a desktop - 0 takes the Workbench value */
+struct ModeProfile {
+    UWORD width;
+    UWORD height;
+    UWORD depth;          /* One of modeDepths, 1 = 2 colors */
+    BOOL interleaved;     /* SA_Interleaved - FALSE leaves it to SA_LikeWorkbench */
+};
+
+/* Bottom of the fallback ladder - hires, NTSC height */
+#define MODE_MIN_WIDTH 640
+#define MODE_MIN_HEIGHT 200
+#define MODE_ROW_ALIGN 64     /* Bitplane rows are padded to the AGA 4x fetch width, in pixels */
+
+/* Depths a screen can have, deepest first - the fallback ladder steps along these */
+/* 24, 16 and 15 exist only on RTG boards, 1..8 are bitplanes */
+static const UBYTE modeDepths[] = { 24, 16, 15, 8, 7, 6, 5, 4, 3, 2, 1 };
+#define MODE_DEPTHS (sizeof(modeDepths) / sizeof(UBYTE))
+
+/* Per-desktop state - one for each Workspace screen the manager owns */
+struct Desktop {
+    struct Desktop *next;
+    ULONG number;                   /* n of the default Workspace.n name */
     struct Screen *workspaceScreen;
-    struct Window *backdropWindow;  /* Standard Intuition window */
+    struct Window *backdropWindow;  /* Standard Intuition window, IDCMP on wsState.windowPort */
     struct Window *shellWindow;     /* Separate backdrop window for shell console */
+    struct Process *shellProcess;   /* Running shell, NULL once it has exited or if it was */
+                                    /* never found - then the desktop cannot close before it ends */
+    BOOL shellWindowDonated;        /* Console took over shellWindow and will close it */
+    BOOL shellEnabled;
+    BOOL shellExited;               /* Set by ShellExitCode, read by the main task */
+    BOOL closeRequested;            /* Close this desktop after the current batch */
+    BOOL needsRefresh;              /* IDCMP_REFRESHWINDOW seen in the current batch */
+    BOOL wasActivated;              /* IDCMP_ACTIVEWINDOW seen in the current batch */
+    struct Window *requesterWindow; /* Open asynchronous requester from OpenRequester, or NULL */
     struct Menu *menuStrip;
+    STRPTR workspaceName;
+    Object *backdropImageObj;
+    APTR backdropDrawHandle;  /* Draw handle from ObtainDTDrawInfoA */
+    struct BitMap *backdropBitmap;
+    struct RastPort *backdropRastPort;
+    struct DrawInfo *drawInfo;
+    BOOL isDefaultScreen;  /* Track if this screen is set as default */
+    ULONG currentTheme;  /* Current color theme index (0 = Like Workbench) */
+    UBYTE *originalRGB; /* Palette captured when screen opened, 8 bits per gun, NULL = none */
+    ULONG numColors; /* Number of colors captured in originalRGB (<=256) */
+    APTR menuPool;                         /* Owns the current menu generation - NewMenu array and screen commands */
+    ULONG menuPoolBytes;                   /* Bytes allocated from menuPool, charged to MEMACCT_MENUS */
+    struct RegistryEntry *registryEntry;   /* This screen in the shared registry */
+    ULONG menuChangeCount;                 /* registry->changeCount the Default PubScreen items were built at */
+    ULONG pubScreenPage;                   /* Page of other screens the Default PubScreen submenu shows */
+    BOOL menuDirty;                        /* Default PubScreen items to be rebuilt - set until a rebuild succeeds */
+    ULONG idleSince;                       /* System seconds the screen has been idle since, 0 = not yet checked */
+    BOOL hibernated;                       /* Screen closed while idle - reopen with the palette kept here */
+    BOOL spare;                            /* Warm spare - private, behind, not yet handed out */
+    BOOL backdropShed;                     /* Backdrop image dropped for low memory - reloaded when shown */
+    BOOL menusShed;                        /* Menu strip dropped for low memory - rebuilt when activated */
+    ULONG ringIndex;                       /* Position in wsState.ring */
+    struct ModeProfile mode;               /* Mode asked for, the screen may be a cheaper one */
+    ULONG chipCost;                        /* Bitmap bytes of the open screen, in wsState.chipUsed */
+    STRPTR backdropPath;                   /* BACKDROP image - wsState's, or a copy from a launch request */
+    UBYTE screenName[1];                   /* Public screen name, allocated to fit - workspaceName points here */
+};
+
+/* Packed 8-bit gun to the left-justified 32 bits SetRGB32 takes */
+#define RGB32_GUN(gun) ((ULONG)(gun) * 0x01010101UL)
+
+/* Application state - shared by all desktops */
+struct WorkspaceState {
+    struct Desktop *desktops;       /* Open desktops in the order they were opened */
+    ULONG desktopCount;
+    struct Desktop *ring[WS_MAX_DESKTOPS];  /* Same order by position - switching needs no list walk */
+    struct MsgPort *windowPort;     /* Shared IDCMP port of all backdrop windows */
+    struct MsgPort *launchPort;     /* Public LAUNCH_PORT_NAME port, later runs send LaunchMessages here */
+    ULONG launchCount;              /* COUNT/N - desktops to open */
+    BOOL lazyDesktops;              /* LAZY/S - extra desktops open their screen when first needed */
+    ULONG hibernateSeconds;         /* HIBERNATE/K/N - close screens idle this long, 0 = never */
+    BOOL spareEnabled;              /* SPARE/S - keep a prepared desktop for New Workspace */
+    struct ModeProfile defaultMode; /* WIDTH/K/N, HEIGHT/K/N, DEPTH/K/N, INTERLEAVED/S */
+    ULONG chipBudget;               /* CHIPBUDGET/K/N in bytes - all screen bitmaps together, 0 = no limit. */
+                                    /* New screens are checked by estimate, open ones count at real size. */
+    ULONG chipUsed;                 /* Bitmap bytes of the open screens */
+    BOOL headless;                  /* HEADLESS/S - public screens only, no window, menus or themes */
+    struct Desktop *spare;          /* The prepared desktop, not in desktops until handed out */
+    struct Desktop *frontDesktop;   /* Last desktop shown - the one Exchange Show and CX_POPKEY bring */
+                                    /* to front. Written only under exclusive screenSemaphore. */
+    BYTE shellSigBit;               /* Signalled by ShellExitCode when a shell ends, -1 = none */
+    BYTE memSigBit;                 /* Signalled by LowMemoryHandler, -1 = no handler installed */
+    struct Interrupt memHandler;    /* AddMemHandler node (V39) */
+    BOOL memExhausted;              /* ShedMemory found nothing to release - LowMemoryHandler stays */
+                                    /* quiet until a menu strip, backdrop or palette is built again */
     CxObj *commodityBroker;
-    CxObj *commoditySender;
     CxObj *commodityReceiver;
     struct MsgPort *commodityPort;
-    struct Process *commodityProcess;
-    STRPTR workspaceName;
-    STRPTR pubName;  /* Command line pubname (default "Workspace.1") */
+    struct Process *commodityProcess;  /* CX_TASK servicing process, NULL = main task services the broker */
+    struct MsgPort *cxTaskPort;        /* Broker port owned by commodityProcess */
+    BYTE cxTaskSigBit;                 /* commodityProcess has started or stopped */
+    BOOL cxTaskEnabled;                /* CX_TASK/S */
+    struct SignalSemaphore screenSemaphore;  /* Shared to use frontDesktop's screen from commodityProcess */
+    STRPTR pubName;  /* Command line pubname (default "Workspace.n") */
     STRPTR cxName;   /* Command line cxname (default "Workspace") */
     STRPTR cxPopKey; /* Command line CX_POPKEY hotkey string */
+    STRPTR cxNextKey;  /* CX_NEXTKEY - next desktop in the ring */
+    STRPTR cxPrevKey;  /* CX_PREVKEY - previous desktop in the ring */
+    STRPTR cxGotoKey;  /* CX_GOTOKEY - qualifiers for desktop 1..WS_GOTO_KEYS */
+    STRPTR cxQuitKey;  /* CX_QUITKEY - close the current desktop */
     CxObj *commodityFilter;  /* Filter object for hotkey */
-    BOOL shellEnabled;
     STRPTR shellPath;
     STRPTR backdropImagePath;
-    Object *backdropImageObj;
-    APTR backdropDrawHandle;  /* Draw handle from ObtainDTDrawInfoA */
-    struct BitMap *backdropBitmap;
-    struct RastPort *backdropRastPort;
     struct Task *mainTask;
-    BOOL quitFlag;
-    ULONG instanceNumber;
-    struct DrawInfo *drawInfo;
     BOOL commodityActive;  /* Track broker activation state */
-    BOOL isDefaultScreen;  /* Track if this screen is set as default */
     struct RDArgs *rda;  /* ReadArgs result for cleanup */
-    ULONG currentTheme;  /* Current color theme index (0 = Like Workbench) */
+    ULONG defaultTheme;  /* Theme new desktops start with (THEME argument) */
     STRPTR themeName;  /* Command line theme name */
-    ULONG originalRGB[256 * 3]; /* Original palette captured when screen opened (GetRGB32 format) */
-    ULONG numColors; /* Number of colors captured in originalRGB (<=256) */
-    BOOL haveOriginalPalette; /* TRUE if originalRGB/numColors is valid */
 };
 
 static struct WorkspaceState wsState;
 
+/* Desktop that menu commands and hotkeys act on - the one whose event is being handled, */
+/* else the one last used. Only the main task uses it, often pointing it at a desktop for */
+/* a moment; the commodity task goes by wsState.frontDesktop instead. Desktops are */
+/* unlinked and freed only while the main task holds screenSemaphore exclusively. */
+static struct Desktop *currentDesktop = NULL;
+
+/* Workspace screen registry - every live Workspace screen, custom PUBNAMEs included, */
+/* so visitor counts and the Default PubScreen menu need no walk of all public screens. */
+/* Shared through a named semaphore; the last process to leave it empty frees it. */
+#define REGISTRY_NAME "Workspace.registry"
+
+struct RegistryEntry {
+    struct MinNode node;
+    struct Screen *screen;
+    struct PubScreenNode *pubNode;  /* Found once when registered, valid until the screen closes */
+    struct Task *owner;             /* Process that opened the screen */
+    WORD visitorCount;              /* psn_VisitorCount at the last RegistryVisitors() */
+    UBYTE name[MAXPUBSCREENNAME + 1];
+};
+
+struct WorkspaceRegistry {
+    struct SignalSemaphore semaphore;  /* Must be first - found with FindSemaphore(REGISTRY_NAME) */
+    struct MinList screens;            /* RegistryEntry nodes */
+    ULONG screenCount;
+    ULONG changeCount;                 /* Incremented whenever a screen is added or removed */
+    UBYTE name[sizeof(REGISTRY_NAME)]; /* Semaphore name, outlives the process that added it */
+};
+
+static struct WorkspaceRegistry *registry = NULL;
+
+/* Launch port - a second run of Workspace hands its arguments to the running manager */
+#define LAUNCH_PORT_NAME "Workspace"
+
+struct LaunchMessage {
+    struct Message lm_Message;
+    ULONG lm_Count;          /* Desktops to open */
+    UBYTE lm_PubName[64];    /* PUBNAME for the first of them, empty for Workspace.n */
+    struct ModeProfile lm_Mode;  /* Screen mode for all of them */
+    ULONG lm_Theme;          /* THEME for all of them, LAUNCH_THEME_DEFAULT for the manager's */
+    UBYTE lm_Backdrop[256];  /* BACKDROP for all of them, empty for the manager's */
+    ULONG lm_Opened;         /* Set by the manager - desktops actually opened */
+};
+
+#define LAUNCH_THEME_DEFAULT 0xFFFFFFFFUL
+
+/* Log ring - binary log records queued in memory and written out when idle */
+#define LOG_RING_SIZE 128     /* Records kept, must be a power of two */
+#define LOG_MAX_ARGS 8        /* Printf arguments captured per record */
+#define LOG_TEXT_SIZE 48      /* Bytes of %s argument text copied per record */
+#define LOG_DEFAULT_FILE "T:Workspace.log"
+
+struct LogRecord {
+    struct EClockVal timestamp;  /* ReadEClock() when the record was queued */
+    CONST_STRPTR format;         /* Format string - also identifies the call site */
+    UWORD line;                  /* Source line of the call site */
+    UBYTE level;                 /* WS_LOG_ERROR..WS_LOG_TRACE */
+    UBYTE argCount;              /* Number of valid entries in args */
+    LONG args[LOG_MAX_ARGS];     /* Raw Printf arguments, %s repointed into text */
+    UBYTE text[LOG_TEXT_SIZE];   /* Copies of %s arguments (callers may pass stack buffers) */
+};
+
+struct LogRing {
+    struct LogRecord *records;   /* LOG_RING_SIZE records, NULL when ring is off */
+    ULONG written;               /* Total records queued */
+    ULONG flushed;               /* Total records written to file (or lost) */
+    STRPTR path;                 /* Log file name */
+    BPTR file;                   /* Opened on first flush */
+    struct EClockVal startTime;  /* Timestamps are written relative to this */
+};
+
+static struct LogRing logRing;
+static UBYTE logSiteLevel = WS_LOG_INFO;  /* Set by LOG_EMIT for the next LogPrintf */
+static UWORD logSiteLine = 0;
+static const STRPTR logLevelNames[] = { "NONE", "ERROR", "WARN", "INFO", "TRACE" };
+
+#define LogRingPending() (logRing.records != NULL && logRing.written != logRing.flushed)
+
+/* Event latency - input event timestamp to the end of our reaction, per action */
+#define LATENCY_TILE 0      /* Windows menu */
+#define LATENCY_THEME 1     /* Prefs/Theme menu */
+#define LATENCY_SCREEN 2    /* Hotkey ScreenToFront */
+#define LATENCY_SHELL 3     /* Open AmigaShell */
+#define LATENCY_MENU 4      /* Other menu items */
+#define LATENCY_COUNT 5
+#define LATENCY_BUCKETS 16  /* Bucket 0 is below 128us, each next bucket doubles */
+#define LATENCY_BUCKET0_SHIFT 7
+
+struct LatencyProbe {
+    struct timeval origin;      /* Input event time (system time) */
+    struct EClockVal dispatch;  /* E-Clock when we started handling the event */
+    ULONG queueMicros;          /* Origin to dispatch: input.device, Intuition and our port */
+};
+
+struct LatencyStats {
+    ULONG count;
+    ULONG maxMicros;
+    ULONG totalMillis;          /* Sum in milliseconds so it does not overflow */
+    ULONG buckets[LATENCY_BUCKETS];
+};
+
+static struct LatencyStats latencyStats[LATENCY_COUNT];
+static const STRPTR latencyNames[] = { "tile", "theme", "screen", "shell", "menu" };
+
+/* Memory accounts - what each subsystem holds, counted from the sizes Workspace passes */
+/* to AllocVec, AllocPooled and OpenScreen (MemCharge), so other tasks are never charged. */
+/* Objects the system sizes itself - windows, brokers, datatypes, GadTools menus - only */
+/* show in the coarse AvailMem cross-check taken around the calls (MemProbeBegin/End). */
+#define MEMACCT_SCREEN 0     /* Screens - bitmaps */
+#define MEMACCT_WINDOW 1     /* Backdrop windows - cross-check only */
+#define MEMACCT_MENUS 2      /* Menu pool allocations */
+#define MEMACCT_BACKDROP 3   /* Datatype objects - cross-check only */
+#define MEMACCT_COMMODITY 4  /* Broker and hotkey objects - cross-check only */
+#define MEMACCT_DESKTOP 5    /* Desktop records, BACKDROP copies and captured palettes */
+#define MEMACCT_COUNT 6
+
+struct MemProbe {
+    ULONG avail;         /* AvailMem(MEMF_ANY) before the call */
+};
+
+struct MemAccount {
+    LONG chip;                /* Bytes held now, allocated as MEMF_CHIP - charges minus refunds */
+    LONG any;                 /* Bytes held now, allocated without MEMF_CHIP */
+    LONG peakChip;            /* Most held at any time */
+    LONG peakAny;
+    ULONG calls;              /* Calls probed */
+    LONG seen;                /* AvailMem drop around the probed calls - includes other tasks */
+};
+
+static struct MemAccount memAccounts[MEMACCT_COUNT];
+static const STRPTR memAccountNames[] = { "screen", "window", "menus", "backdrop", "commodity", "desktop" };
+
+/* Startup profile - E-Clock time and memory used by each startup phase */
+#define PROFILE_MAX_PHASES 12
+#define PROFILE_REPORT_SIZE 640
+
+struct ProfilePhaseRecord {
+    STRPTR name;
+    ULONG micros;
+    LONG chipUsed;   /* AvailMem(MEMF_CHIP) before minus after */
+    LONG fastUsed;   /* AvailMem(MEMF_FAST) before minus after */
+};
+
+struct StartupProfile {
+    BOOL enabled;            /* PROFILE/S given */
+    STRPTR reportFile;       /* PROFILEFILE/K, NULL = ENV:<screen name>.profile */
+    struct EClockVal mark;
+    ULONG chipMark;
+    ULONG fastMark;
+    ULONG phaseCount;
+    struct ProfilePhaseRecord phases[PROFILE_MAX_PHASES];
+};
+
+static struct StartupProfile startupProfile;
+
+/* Timer scheduler - all timed work shares TimerIO and the TimerPort signal */
+/* Timers are caller-owned and kept in a list sorted by due time; only the */
+/* head is ever queued with timer.device, and nothing is queued while the list is empty */
+struct ScheduledTimer {
+    struct ScheduledTimer *next;
+    struct timeval due;          /* System time the timer fires */
+    ULONG intervalMicros;        /* Period for repeating timers, 0 = one-shot */
+    ULONG slackMicros;           /* May fire this much late to share a wakeup with another timer */
+    VOID (*callback)(struct ScheduledTimer *timer);
+    BOOL scheduled;
+};
+
+struct TimerScheduler {
+    struct ScheduledTimer *head;
+    BOOL requestPending;         /* TimerIO is queued with timer.device */
+    struct timeval armedDue;     /* Due time of the queued request */
+};
+
+static struct TimerScheduler scheduler;
+
+/* Queued log records are written at most this long after the first one, */
+/* so a burst of logging costs one file write */
+#define LOG_FLUSH_DELAY 500000UL
+#define LOG_FLUSH_SLACK 250000UL
+
+static struct ScheduledTimer logFlushTimer = { NULL, { 0, 0 }, 0, LOG_FLUSH_SLACK, LogFlushTimer, FALSE };
+
+/* Idle screens are looked at this often - hibernation is not in a hurry */
+#define HIBERNATE_CHECK_INTERVAL 10000000UL
+#define HIBERNATE_CHECK_SLACK 5000000UL
+
+static struct ScheduledTimer hibernateTimer = { NULL, { 0, 0 }, HIBERNATE_CHECK_INTERVAL, HIBERNATE_CHECK_SLACK, HibernateTimer, FALSE };
+
+/* The spare is prepared this long after it was handed out, once things settle */
+#define SPARE_REFILL_DELAY 2000000UL
+#define SPARE_REFILL_SLACK 1000000UL
+
+static struct ScheduledTimer spareTimer = { NULL, { 0, 0 }, 0, SPARE_REFILL_SLACK, SpareTimer, FALSE };
+
 /* Tooltype defaults */
 /* Note: Default uses WINDOW parameter - user can override with custom path */
 /* For custom path, use %p for window pointer in hex format */
@@ -189,39 +640,196 @@ static STRPTR defaultBackdropImage = NULL;
 #define THEME_GREEN 4
 #define THEME_COUNT 5
 
+/* Theme labels - shared by themeNames, the theme commands and the Prefs menu template */
+#define THEME_LABEL_LIKE_WORKBENCH "Like Workbench"
+#define THEME_LABEL_DARK_MODE "Dark Mode"
+#define THEME_LABEL_SEPIA "Sepia"
+#define THEME_LABEL_BLUE "Blue"
+#define THEME_LABEL_GREEN "Green"
+
 /* Theme names for menu */
 static const STRPTR themeNames[] = {
-    "Like Workbench",
-    "Dark Mode",
-    "Sepia",
-    "Blue",
-    "Green",
+    THEME_LABEL_LIKE_WORKBENCH,
+    THEME_LABEL_DARK_MODE,
+    THEME_LABEL_SEPIA,
+    THEME_LABEL_BLUE,
+    THEME_LABEL_GREEN,
     NULL
 };
 
+/* Commands - menu item UserData and the hotkey sender ID point to one of these, */
+/* so dispatching a menu pick or hotkey is a single indirect call */
+struct WsCommand {
+    STRPTR name;                                 /* For logging */
+    BOOL (*handler)(struct WsCommand *command);  /* Returns TRUE when Workspace should quit */
+    ULONG arg;                                   /* Pre-resolved argument (layout, theme index, screen name) */
+    ULONG latencyAction;                         /* LATENCY_xxx histogram to charge */
+    ULONG group;                                 /* WSGROUP_xxx - a batch keeps only the last of a group */
+};
+
+/* Command groups - later commands in a group supersede earlier ones in the same batch */
+#define WSGROUP_NONE 0
+#define WSGROUP_LAYOUT 1     /* Tile/grid - only the final arrangement matters */
+#define WSGROUP_THEME 2
+#define WSGROUP_PUBSCREEN 3
+
+/* Window messages collected by one drain of the shared window port */
+/* Close and refresh requests are flagged on the desktop instead */
+#define BATCH_MAX_COMMANDS 16
+
+struct BatchedCommand {
+    struct WsCommand *command;
+    struct Desktop *desktop;  /* Desktop whose menu it was picked from */
+    ULONG seconds;   /* Input event timestamp, for latency */
+    ULONG micros;
+};
+
+struct WindowBatch {
+    BOOL full;           /* Stopped draining because commands[] is full */
+    ULONG messageCount;
+    ULONG commandCount;
+    struct BatchedCommand commands[BATCH_MAX_COMMANDS];
+};
+
+/* Default PubScreen entries for Workspace.n screens - one allocation holds the name too */
+struct ScreenCommand {
+    struct WsCommand command;
+    UBYTE screenName[1];  /* Allocated to fit the name */
+};
+
+/* Default PubScreen sub-items - Workbench and our own screen on every page, then a page */
+/* of the other screens and the page switches. Keeps MutualExclude (one bit per */
+/* sub-item) and the layout cost the same however many screens there are. */
+#define PUBSCREEN_PAGE_SIZE 16
+#define PUBSCREEN_MAX_ITEMS (2 + PUBSCREEN_PAGE_SIZE + 2)
+
+/* Menu generation pool - a strip's NewMenu array and screen commands share a puddle or two */
+#define MENU_POOL_PUDDLE 2048
+#define MENU_POOL_THRESHOLD 2048
+
+/* Indices into wsCommands */
+#define WSCMD_PUBSCREEN_WORKBENCH 0
+#define WSCMD_ABOUT 1
+#define WSCMD_QUIT 2
+#define WSCMD_SHELL 3
+#define WSCMD_TILE_HORIZONTAL 4
+#define WSCMD_TILE_VERTICAL 5
+#define WSCMD_GRID 6
+#define WSCMD_SCREEN_TO_FRONT 7
+#define WSCMD_NEW_DESKTOP 8
+#define WSCMD_NEXT_DESKTOP 9
+#define WSCMD_PREV_DESKTOP 10
+#define WSCMD_GOTO_DESKTOP 11  /* WS_GOTO_KEYS entries, one per ring position */
+#define WSCMD_PUBSCREEN_NEXT_PAGE (WSCMD_GOTO_DESKTOP + WS_GOTO_KEYS)
+#define WSCMD_PUBSCREEN_PREV_PAGE (WSCMD_PUBSCREEN_NEXT_PAGE + 1)
+#define WSCMD_THEME (WSCMD_PUBSCREEN_PREV_PAGE + 1)  /* THEME_COUNT entries, one per theme */
+#define WSCMD_COUNT (WSCMD_THEME + THEME_COUNT)
+
+static struct WsCommand wsCommands[WSCMD_COUNT] = {
+    { "pubscreen Workbench", CmdDefaultPubScreen, 0, LATENCY_MENU, WSGROUP_PUBSCREEN },
+    { "about", CmdAbout, 0, LATENCY_MENU, WSGROUP_NONE },
+    { "quit", CmdQuit, 0, LATENCY_MENU, WSGROUP_NONE },
+    { "shell", CmdShell, 0, LATENCY_SHELL, WSGROUP_NONE },
+    { "tile horizontally", CmdWindows, 0, LATENCY_TILE, WSGROUP_LAYOUT },
+    { "tile vertically", CmdWindows, 1, LATENCY_TILE, WSGROUP_LAYOUT },
+    { "grid layout", CmdWindows, 2, LATENCY_TILE, WSGROUP_LAYOUT },
+    { "screen to front", CmdScreenToFront, 0, LATENCY_SCREEN, WSGROUP_NONE },
+    { "new desktop", CmdNewDesktop, 0, LATENCY_MENU, WSGROUP_NONE },
+    { "next desktop", CmdCycleDesktop, 0, LATENCY_SCREEN, WSGROUP_NONE },
+    { "previous desktop", CmdCycleDesktop, 1, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 1", CmdGotoDesktop, 0, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 2", CmdGotoDesktop, 1, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 3", CmdGotoDesktop, 2, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 4", CmdGotoDesktop, 3, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 5", CmdGotoDesktop, 4, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 6", CmdGotoDesktop, 5, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 7", CmdGotoDesktop, 6, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 8", CmdGotoDesktop, 7, LATENCY_SCREEN, WSGROUP_NONE },
+    { "goto desktop 9", CmdGotoDesktop, 8, LATENCY_SCREEN, WSGROUP_NONE },
+    { "pubscreen next page", CmdPubScreenPage, 0, LATENCY_MENU, WSGROUP_NONE },
+    { "pubscreen previous page", CmdPubScreenPage, 1, LATENCY_MENU, WSGROUP_NONE },
+    { "theme " THEME_LABEL_LIKE_WORKBENCH, CmdTheme, THEME_LIKE_WORKBENCH, LATENCY_THEME, WSGROUP_THEME },
+    { "theme " THEME_LABEL_DARK_MODE, CmdTheme, THEME_DARK_MODE, LATENCY_THEME, WSGROUP_THEME },
+    { "theme " THEME_LABEL_SEPIA, CmdTheme, THEME_SEPIA, LATENCY_THEME, WSGROUP_THEME },
+    { "theme " THEME_LABEL_BLUE, CmdTheme, THEME_BLUE, LATENCY_THEME, WSGROUP_THEME },
+    { "theme " THEME_LABEL_GREEN, CmdTheme, THEME_GREEN, LATENCY_THEME, WSGROUP_THEME }
+};
+
+/* Fixed parts of the menu strip - a strip is menuHead, the Default PubScreen */
+/* sub-items, then menuTail (NO NM_END between menus!) */
+static const struct NewMenu menuHead[] = {
+    { NM_TITLE, "Workspace", NULL, 0, 0, NULL },
+    { NM_ITEM, "Default PubScreen", NULL, 0, 0, NULL }
+};
+
+/* Each theme excludes the others - the current one gets CHECKED when the strip is built */
+#define THEME_EXCLUDE(theme) (((1UL << THEME_COUNT) - 1) & ~(1UL << (theme)))
+
+static const struct NewMenu menuTail[] = {
+    { NM_ITEM, NM_BARLABEL, NULL, 0, 0, NULL },
+    { NM_ITEM, "About", "?", 0, 0, &wsCommands[WSCMD_ABOUT] },
+    { NM_ITEM, "Open AmigaShell", "S", 0, 0, &wsCommands[WSCMD_SHELL] },
+    { NM_ITEM, "New Workspace", "N", 0, 0, &wsCommands[WSCMD_NEW_DESKTOP] },
+    { NM_ITEM, "Close Workspace", "Q", 0, 0, &wsCommands[WSCMD_QUIT] },
+    { NM_TITLE, "Windows", NULL, 0, 0, NULL },
+    { NM_ITEM, "Tile Horizontally", "H", 0, 0, &wsCommands[WSCMD_TILE_HORIZONTAL] },
+    { NM_ITEM, "Tile Vertically", "V", 0, 0, &wsCommands[WSCMD_TILE_VERTICAL] },
+    { NM_ITEM, "Grid Layout", "G", 0, 0, &wsCommands[WSCMD_GRID] },
+    { NM_TITLE, "Prefs", NULL, 0, 0, NULL },
+    { NM_ITEM, "Theme", NULL, 0, 0, NULL },
+    { NM_SUB, THEME_LABEL_LIKE_WORKBENCH, NULL, CHECKIT, THEME_EXCLUDE(THEME_LIKE_WORKBENCH), &wsCommands[WSCMD_THEME + THEME_LIKE_WORKBENCH] },
+    { NM_SUB, THEME_LABEL_DARK_MODE, NULL, CHECKIT, THEME_EXCLUDE(THEME_DARK_MODE), &wsCommands[WSCMD_THEME + THEME_DARK_MODE] },
+    { NM_SUB, THEME_LABEL_SEPIA, NULL, CHECKIT, THEME_EXCLUDE(THEME_SEPIA), &wsCommands[WSCMD_THEME + THEME_SEPIA] },
+    { NM_SUB, THEME_LABEL_BLUE, NULL, CHECKIT, THEME_EXCLUDE(THEME_BLUE), &wsCommands[WSCMD_THEME + THEME_BLUE] },
+    { NM_SUB, THEME_LABEL_GREEN, NULL, CHECKIT, THEME_EXCLUDE(THEME_GREEN), &wsCommands[WSCMD_THEME + THEME_GREEN] },
+    { NM_END, NULL, NULL, 0, 0, NULL }
+};
+
+#define MENU_HEAD_ENTRIES (sizeof(menuHead) / sizeof(struct NewMenu))
+#define MENU_TAIL_ENTRIES (sizeof(menuTail) / sizeof(struct NewMenu))
+#define MENU_TAIL_THEMES (MENU_TAIL_ENTRIES - 1 - THEME_COUNT)  /* First theme sub-item in menuTail */
+
+/* Commodity task priority - above the UI task, below input.device (20) */
+#define CX_TASK_PRIORITY 10
+
+/* Menu number of "Open AmigaShell" (menu 0, item 3 counting the separator) */
+#define SHELL_MENUNUM FULLMENUNUM(0, 3, NOSUB)
+
 /* Main entry point */
 int main(int argc, char *argv[])
 {
     struct WBStartup *wbs = NULL;
     struct DiskObject *icon = NULL;
     BOOL fromWorkbench = FALSE;
-    BOOL done = FALSE;  /* Declare at top of function for C89 compliance */
     
-    Printf("Workspace: Starting application\n");
+    LOG_INFO(("Workspace: Starting application\n"));
     
     /* Initialize state */
     memset(&wsState, 0, sizeof(struct WorkspaceState));
-    wsState.instanceNumber = 1;
-    wsState.quitFlag = FALSE;
     wsState.commodityActive = FALSE;
-    wsState.isDefaultScreen = FALSE;
     wsState.mainTask = (struct Task *)FindTask(NULL);
-    wsState.currentTheme = THEME_LIKE_WORKBENCH;  /* Default to Like Workbench */
+    wsState.defaultTheme = THEME_LIKE_WORKBENCH;  /* Default to Like Workbench */
+    wsState.launchCount = 1;
+    wsState.shellSigBit = -1;
+    wsState.memSigBit = -1;
+    wsState.cxTaskSigBit = -1;
+    InitSemaphore(&wsState.screenSemaphore);
+    
+    LOG_TRACE(("Workspace: State initialized\n"));
+    
+    /* Open timer.device first - log timestamps need the E-Clock */
+    InitializeTimer();
     
-    Printf("Workspace: State initialized\n");
+    /* Phases are always measured (cheap) - PROFILE/S only decides whether a report is written */
+    ProfileMark();
     
     /* Check if running from Workbench */
     fromWorkbench = (argc == 0);
+    
+    /* Nobody can see console output when started from Workbench - log to file instead */
+    if (fromWorkbench) {
+        StartLogRing(NULL);
+    }
     {
         STRPTR workbenchStatus;
         if (fromWorkbench) {
@@ -229,7 +837,7 @@ int main(int argc, char *argv[])
         } else {
             workbenchStatus = "NO";
         }
-        Printf("Workspace: Running from Workbench: %s\n", workbenchStatus);
+        LOG_TRACE(("Workspace: Running from Workbench: %s\n", workbenchStatus));
     }
     
     if (fromWorkbench) {
@@ -241,108 +849,118 @@ int main(int argc, char *argv[])
     }
     
     /* Initialize libraries */
-    Printf("Workspace: Initializing libraries...\n");
+    LOG_TRACE(("Workspace: Initializing libraries...\n"));
     if (!InitializeLibraries()) {
-        Printf("Workspace: ERROR - Failed to initialize libraries\n");
+        LOG_ERROR(("Workspace: ERROR - Failed to initialize libraries\n"));
         return RETURN_FAIL;
     }
-    Printf("Workspace: Libraries initialized successfully\n");
+    ProfilePhase("libraries");
+    LOG_INFO(("Workspace: Libraries initialized successfully\n"));
     
     /* Parse command line arguments */
-    Printf("Workspace: Parsing command line arguments...\n");
+    LOG_TRACE(("Workspace: Parsing command line arguments...\n"));
     if (!ParseCommandLine()) {
-        Printf("Workspace: ERROR - Failed to parse command line arguments\n");
+        LOG_ERROR(("Workspace: ERROR - Failed to parse command line arguments\n"));
         if (icon) {
             FreeDiskObject(icon);
         }
         Cleanup();
         return RETURN_FAIL;
     }
-    Printf("Workspace: Command line arguments parsed successfully\n");
+    LOG_INFO(("Workspace: Command line arguments parsed successfully\n"));
     
     /* Parse tooltypes if icon available */
     if (icon) {
-        Printf("Workspace: Parsing tooltypes...\n");
+        LOG_TRACE(("Workspace: Parsing tooltypes...\n"));
         /* Store tooltypes for parsing */
         ParseToolTypes();
         FreeDiskObject(icon);
     }
+    ProfilePhase("args");
     
-    /* Determine workspace instance number and name */
-    wsState.workspaceName = GetWorkspaceName();
-    Printf("Workspace: Workspace name: %s (instance %ld)\n", wsState.workspaceName, wsState.instanceNumber);
+    /* One manager process owns every desktop - if one is running already, */
+    /* hand it our arguments and exit */
+    if (!CreateLaunchPort()) {
+        BOOL launched = SendLaunchMessage();
+        
+        Cleanup();
+        if (!launched) {
+            return RETURN_WARN;
+        }
+        return RETURN_OK;
+    }
     
-    /* Initialize commodity */
-    Printf("Workspace: Initializing commodity...\n");
-    if (!InitializeCommodity()) {
-        Printf("Workspace: ERROR - Failed to initialize commodity\n");
+    if (!OpenRegistry()) {
+        LOG_ERROR(("Workspace: ERROR - Failed to open screen registry\n"));
         Cleanup();
         return RETURN_FAIL;
     }
-    Printf("Workspace: Commodity initialized successfully\n");
     
-    /* Create workspace screen */
-    Printf("Workspace: Creating workspace screen...\n");
-    if (!CreateWorkspaceScreen()) {
-        Printf("Workspace: ERROR - Failed to create workspace screen\n");
-        CleanupCommodity();
+    /* A headless manager never opens a backdrop window, menus or images */
+    if (!wsState.headless && !OpenDesktopLibraries()) {
+        LOG_ERROR(("Workspace: ERROR - Failed to initialize desktop libraries\n"));
         Cleanup();
         return RETURN_FAIL;
     }
-    Printf("Workspace: Workspace screen created successfully\n");
+    /* Launch port, registry and the deferred library opens - kept out of "commodity" */
+    ProfilePhase("registry");
     
-    /* Apply theme if specified (and not Like Workbench) */
-    if (wsState.currentTheme != THEME_LIKE_WORKBENCH) {
-        Printf("Workspace: Applying theme %lu: %s\n", wsState.currentTheme, themeNames[wsState.currentTheme]);
-        if (!ApplyTheme(wsState.currentTheme)) {
-            Printf("Workspace: WARNING - Failed to apply theme, continuing with default\n");
-        }
+    /* Initialize commodity */
+    LOG_TRACE(("Workspace: Initializing commodity...\n"));
+    if (!InitializeCommodity()) {
+        LOG_ERROR(("Workspace: ERROR - Failed to initialize commodity\n"));
+        Cleanup();
+        return RETURN_FAIL;
     }
+    ProfilePhase("commodity");
+    LOG_INFO(("Workspace: Commodity initialized successfully\n"));
     
-    /* Create backdrop window first - menu will be created after window is open */
-    Printf("Workspace: Creating backdrop window...\n");
-    if (!CreateBackdropWindow()) {
-        Printf("Workspace: ERROR - Failed to create backdrop window\n");
-        CloseWorkspaceScreen();
+    /* IDCMP port shared by the backdrop windows of all desktops */
+    wsState.windowPort = CreateMsgPort();
+    if (wsState.windowPort == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Failed to create window port\n"));
         CleanupCommodity();
         Cleanup();
         return RETURN_FAIL;
     }
-    Printf("Workspace: Backdrop window created successfully\n");
     
-    /* Create and attach menu strip AFTER window is open */
-    Printf("Workspace: Creating menu strip...\n");
-    if (!CreateMenuStrip()) {
-        Printf("Workspace: ERROR - Failed to create menu strip\n");
-        CloseBackdropWindow();
-        CloseWorkspaceScreen();
+    /* Open the desktops - PUBNAME names the first, the rest are Workspace.n */
+    if (OpenDesktop(wsState.pubName, &wsState.defaultMode, TRUE) == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Failed to open desktop\n"));
         CleanupCommodity();
         Cleanup();
         return RETURN_FAIL;
     }
-    Printf("Workspace: Menu strip created and attached successfully\n");
-    
-    /* Load backdrop image if specified and shell not enabled */
-    if (!wsState.shellEnabled && wsState.backdropImagePath) {
-        LoadBackdropImage(wsState.backdropImagePath);
+    if (startupProfile.enabled) {
+        WriteProfileReport();
+    }
+    {
+        ULONG i;
+        
+        for (i = 1; i < wsState.launchCount; i++) {
+            if (OpenDesktop(NULL, &wsState.defaultMode, !wsState.lazyDesktops) == NULL) {
+                LOG_WARN(("Workspace: WARNING - Opened only %lu of %lu desktops\n", i, wsState.launchCount));
+                break;
+            }
+        }
     }
     
-    /* Create shell console if enabled */
-    if (wsState.shellEnabled) {
-        CreateShellConsole();
+    /* Prepare the spare once startup is out of the way */
+    if (wsState.spareEnabled) {
+        RefillSpareLater();
     }
     
-    /* Main event loop */
-    Printf("Workspace: Entering main event loop...\n");
-    {
-        LONG windowSigBit;
-        if (wsState.backdropWindow && wsState.backdropWindow->UserPort) {
-            windowSigBit = wsState.backdropWindow->UserPort->mp_SigBit;
-        } else {
-            windowSigBit = -1;
-        }
-        Printf("Workspace: Window UserPort signal bit: %ld\n", windowSigBit);
+    /* Close idle screens to give their memory back */
+    if (wsState.hibernateSeconds != 0) {
+        ScheduleTimer(&hibernateTimer, HIBERNATE_CHECK_INTERVAL);
     }
+    
+    /* Give memory back to applications when the system runs low */
+    InstallMemHandler();
+    
+    /* Main event loop - runs until the last desktop has closed */
+    LOG_INFO(("Workspace: Entering main event loop...\n"));
+    LOG_TRACE(("Workspace: Window port signal bit: %ld\n", (LONG)wsState.windowPort->mp_SigBit));
     {
         LONG commoditySigBit;
         if (wsState.commodityPort) {
@@ -350,76 +968,90 @@ int main(int argc, char *argv[])
         } else {
             commoditySigBit = -1;
         }
-        Printf("Workspace: Commodity port signal bit: %ld\n", commoditySigBit);
+        LOG_TRACE(("Workspace: Commodity port signal bit: %ld\n", commoditySigBit));
     }
-    event_loop_start:
     
-    while (!wsState.quitFlag) {
+    while (wsState.desktops != NULL) {
         ULONG signals;
-        ULONG windowSignal = 0;
+        ULONG windowSignal;
         ULONG expectedSignals;
+        struct Desktop *desktop;
         
-        /* Reset done at start of each iteration */
-        done = FALSE;
-        
-        /* Wait for messages - check if backdrop window exists */
-        if (wsState.backdropWindow == NULL) {
-            Printf("Workspace: ERROR - Backdrop window is NULL, exiting\n");
-            wsState.quitFlag = TRUE;
-            break;
+        /* Calculate expected signal mask */
+        windowSignal = (1L << wsState.windowPort->mp_SigBit);
+        expectedSignals = windowSignal | SIGBREAKF_CTRL_C | SIGBREAKF_CTRL_E | SIGBREAKF_CTRL_F;
+        if (wsState.commodityPort) {
+            expectedSignals |= (1L << wsState.commodityPort->mp_SigBit);
+        }
+        if (wsState.launchPort) {
+            expectedSignals |= (1L << wsState.launchPort->mp_SigBit);
+        }
+        if (wsState.shellSigBit != -1) {
+            expectedSignals |= (1L << wsState.shellSigBit);
+        }
+        if (wsState.memSigBit != -1) {
+            expectedSignals |= (1L << wsState.memSigBit);
+        }
+        for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+            if (desktop->requesterWindow) {
+                expectedSignals |= (1L << desktop->requesterWindow->UserPort->mp_SigBit);
+            }
+        }
+        if (scheduler.requestPending) {
+            expectedSignals |= (1L << TimerPort->mp_SigBit);
         }
         
-        /* Check if shell window was closed by console (when shell ends) */
-        /* Only check if shell is actually enabled - avoid false positives during startup */
-        if (wsState.shellEnabled && wsState.shellWindow != NULL) {
-            if (wsState.shellWindow->UserPort == NULL) {
-                /* Shell window was closed by console - shell has ended */
-                Printf("Workspace: Shell console ended - shell window was closed by console\n");
-                wsState.shellWindow = NULL;  /* Clear pointer */
-                wsState.shellEnabled = FALSE;  /* Reset shell enabled flag */
-                
-                /* Re-enable "Open AmigaShell" menu item since shell is now closed */
-                /* Menu 0, Item 3, Sub 0 - format: (menu << 16) | (item << 8) | sub */
-                if (wsState.backdropWindow) {
-                    OnMenu(wsState.backdropWindow, (0UL << 16) | (3UL << 8) | 0UL);
-                    Printf("Workspace: Re-enabled 'Open AmigaShell' menu item\n");
+        /* Write queued log records a little later, together with whatever follows */
+        if (LogRingPending() && !logFlushTimer.scheduled) {
+            if (TimerBase) {
+                ScheduleTimer(&logFlushTimer, LOG_FLUSH_DELAY);
+                if (scheduler.requestPending) {
+                    expectedSignals |= (1L << TimerPort->mp_SigBit);
                 }
+            } else if ((SetSignal(0, 0) & expectedSignals) == 0) {
+                FlushLogRing();
             }
         }
         
-        /* Get window signal from UserPort */
-        if (wsState.backdropWindow && wsState.backdropWindow->UserPort) {
-            windowSignal = (1L << wsState.backdropWindow->UserPort->mp_SigBit);
-        } else {
-            Printf("Workspace: ERROR - Window or UserPort is NULL, exiting\n");
-            wsState.quitFlag = TRUE;
-            break;
+        /* Wait for messages */
+        signals = Wait(expectedSignals);
+        
+        /* Break signal closes every desktop that has no visitor windows */
+        if (signals & SIGBREAKF_CTRL_C) {
+            LOG_INFO(("Workspace: Received CTRL-C break signal\n"));
+            RequestCloseAllDesktops();
         }
         
-        /* Calculate expected signal mask */
-        {
-            ULONG commoditySignal = 0;
-            if (wsState.commodityPort) {
-                commoditySignal = (1L << wsState.commodityPort->mp_SigBit);
-            }
-            expectedSignals = windowSignal | commoditySignal | SIGBREAKF_CTRL_C;
+        /* CTRL-E - another run of Workspace opened or closed a screen; the submenus */
+        /* are brought up to date by RefreshPubScreenMenus at the end of the pass */
+        
+        /* CTRL-F dumps the latency histograms and memory accounts */
+        if (signals & SIGBREAKF_CTRL_F) {
+            DumpLatencyStats(StatsOutput());
+            DumpMemStats(StatsOutput());
         }
         
-        /* If no valid signals, we can't wait - exit */
-        if (expectedSignals == SIGBREAKF_CTRL_C) {
-            Printf("Workspace: ERROR - No valid signals to wait for, exiting\n");
-            wsState.quitFlag = TRUE;
-            break;
+        /* Timer request came back - run whatever is due */
+        if (scheduler.requestPending && (signals & (1L << TimerPort->mp_SigBit))) {
+            RunDueTimers();
         }
         
-        /* Wait for messages */
-        signals = Wait(expectedSignals);
+        /* Input for open requesters */
+        for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+            if (desktop->requesterWindow && (signals & (1L << desktop->requesterWindow->UserPort->mp_SigBit))) {
+                currentDesktop = desktop;
+                HandleRequester();
+            }
+        }
         
-        /* Check for break signal */
-        if (signals & SIGBREAKF_CTRL_C) {
-            Printf("Workspace: Received CTRL-C break signal\n");
-            wsState.quitFlag = TRUE;
-            break;
+        /* A shell process has exited */
+        if (wsState.shellSigBit != -1 && (signals & (1L << wsState.shellSigBit))) {
+            HandleShellExit();
+        }
+        
+        /* The system ran out of memory - release what can be rebuilt later */
+        if (wsState.memSigBit != -1 && (signals & (1L << wsState.memSigBit))) {
+            ShedMemory();
         }
         
         /* Process commodity messages */
@@ -427,430 +1059,60 @@ int main(int argc, char *argv[])
             ProcessCommodityMessages();
         }
         
-        /* Process window messages using standard Intuition message handling */
-        if (windowSignal && (signals & windowSignal) && wsState.backdropWindow != NULL) {
-            struct IntuiMessage *imsg;
-            struct Message *msg;
-            struct MsgPort *userPort;
-            
-            /* Check if window is still valid - if UserPort is NULL, window was closed */
-            if (wsState.backdropWindow) {
-                userPort = wsState.backdropWindow->UserPort;
-            } else {
-                userPort = NULL;
-            }
-            if (userPort == NULL) {
-                /* Window was closed (likely by shell console) - recreate if shell was enabled */
-                Printf("Workspace: Window UserPort is NULL - window was closed\n");
-                if (wsState.shellEnabled) {
-                    Printf("Workspace: Shell console ended - window was closed by console, recreating backdrop window\n");
-                    wsState.shellEnabled = FALSE;  /* Reset shell enabled flag */
-                    wsState.backdropWindow = NULL;  /* Clear invalid pointer */
-                    if (!CreateBackdropWindow()) {
-                        Printf("Workspace: ERROR - Failed to recreate backdrop window after shell ended\n");
-                        wsState.quitFlag = TRUE;
-                        break;
-                    }
-                    /* Recreate menu on new window */
-                    if (!CreateMenuStrip()) {
-                        Printf("Workspace: ERROR - Failed to recreate menu after shell ended\n");
-                        wsState.quitFlag = TRUE;
-                        break;
-                    }
-                    /* Activate the new window */
-                    if (wsState.backdropWindow) {
-                        ActivateWindow(wsState.backdropWindow);
-                    }
-                    Printf("Workspace: Backdrop window recreated successfully after shell ended\n");
-                    continue;  /* Restart loop with new window */
-                } else {
-                    Printf("Workspace: ERROR - Window closed but shell not enabled, exiting\n");
-                    wsState.quitFlag = TRUE;
-                    break;
-                }
-            }
-            
-            /* Get all messages from window's UserPort */
-            while (wsState.backdropWindow != NULL && (msg = GetMsg(userPort)) != NULL) {
-                imsg = (struct IntuiMessage *)msg;
-                
-                switch (imsg->Class) {
-                    case IDCMP_CLOSEWINDOW:
-                        wsState.quitFlag = TRUE;
-                        done = TRUE;
-                        ReplyMsg(msg);
-                        break;
-                    
-                    case IDCMP_MENUPICK:
-                        {
-                            struct MenuItem *item;
-                            UWORD menuCode = imsg->Code;
-                            
-                            Printf("Workspace: IDCMP_MENUPICK received, menuCode=0x%x\n", menuCode);
-                            
-                            while (menuCode != MENUNULL) {
-                                item = ItemAddress(wsState.menuStrip, menuCode);
-                                if (item) {
-                                    Printf("Workspace: Found menu item at 0x%lx\n", (ULONG)item);
-                                    /* Get menu/item/sub numbers from UserData (GadTools stores it there) */
-                                    if (GTMENUITEM_USERDATA(item)) {
-                                        ULONG userData = (ULONG)GTMENUITEM_USERDATA(item);
-                                        ULONG menuNumber = (userData >> 16) & 0xFF;
-                                        ULONG itemNumber = (userData >> 8) & 0xFF;
-                                        ULONG subNumber = userData & 0xFF;
-                                        
-                                        Printf("Workspace: Menu item - menuNumber=%lu, itemNumber=%lu, subNumber=%lu, Flags=0x%x\n",
-                                               menuNumber, itemNumber, subNumber, (UWORD)item->Flags);
-                                        
-                                        if (menuNumber == 0) {
-                                            if (itemNumber == 0) {
-                                                /* Submenu items under "Default PubScreen" */
-                                                if (subNumber == 0) {
-                                                    /* "Workbench" sub-item */
-                                                    Printf("Workspace: Handling 'Workbench' submenu item\n");
-                                                    HandleDefaultPubScreenSubMenu(NULL);
-                                                } else {
-                                                    /* Workspace.n sub-item - get screen name from menu item text */
-                                                    STRPTR screenName = NULL;
-                                                    if (item->ItemFill && (item->Flags & ITEMTEXT)) {
-                                                        screenName = ((struct IntuiText *)item->ItemFill)->IText;
-                                                        if (screenName) {
-                                                            Printf("Workspace: Handling Workspace screen submenu item: %s\n", screenName);
-                                                            HandleDefaultPubScreenSubMenu(screenName);
-                                                        }
-                                                    }
-                                                }
-                                            } else {
-                                                /* Regular menu items (not sub-items) */
-                                                switch (itemNumber) {
-                                                    case 1:  /* About */
-                                                        HandleAboutMenu();
-                                                        break;
-                                                    
-                                                    case 2:  /* Quit */
-                                                        /* Only set done if HandleCloseMenu allows quit */
-                                                        Printf("Workspace: Quit menu item selected - calling HandleCloseMenu()\n");
-                                                        {
-                                                            STRPTR doneStr;
-                                                            STRPTR quitFlagStr;
-                                                            if (done) {
-                                                                doneStr = "TRUE";
-                                                            } else {
-                                                                doneStr = "FALSE";
-                                                            }
-                                                            if (wsState.quitFlag) {
-                                                                quitFlagStr = "TRUE";
-                                                            } else {
-                                                                quitFlagStr = "FALSE";
-                                                            }
-                                                            Printf("Workspace: BEFORE HandleCloseMenu - done=%s, quitFlag=%s\n", 
-                                                                   doneStr, quitFlagStr);
-                                                        }
-                                                        {
-                                                            BOOL allowQuit = HandleCloseMenu();
-                                                            {
-                                                                STRPTR returnStr;
-                                                                if (allowQuit) {
-                                                                    returnStr = "TRUE";
-                                                                } else {
-                                                                    returnStr = "FALSE";
-                                                                }
-                                                                Printf("Workspace: HandleCloseMenu returned %s\n", returnStr);
-                                                            }
-                                                            if (allowQuit) {
-                                                                Printf("Workspace: Setting done=TRUE because HandleCloseMenu returned TRUE\n");
-                                                                done = TRUE;
-                                                            } else {
-                                                                Printf("Workspace: NOT setting done - HandleCloseMenu returned FALSE\n");
-                                                                {
-                                                                    STRPTR doneStr;
-                                                                    STRPTR quitFlagStr;
-                                                                    if (done) {
-                                                                        doneStr = "TRUE";
-                                                                    } else {
-                                                                        doneStr = "FALSE";
-                                                                    }
-                                                                    if (wsState.quitFlag) {
-                                                                        quitFlagStr = "TRUE";
-                                                                    } else {
-                                                                        quitFlagStr = "FALSE";
-                                                                    }
-                                                                    Printf("Workspace: done remains %s, quitFlag is %s\n", 
-                                                                           doneStr, quitFlagStr);
-                                                                }
-                                                            }
-                                                        }
-                                                        {
-                                                            STRPTR doneStr;
-                                                            STRPTR quitFlagStr;
-                                                            if (done) {
-                                                                doneStr = "TRUE";
-                                                            } else {
-                                                                doneStr = "FALSE";
-                                                            }
-                                                            if (wsState.quitFlag) {
-                                                                quitFlagStr = "TRUE";
-                                                            } else {
-                                                                quitFlagStr = "FALSE";
-                                                            }
-                                                            Printf("Workspace: AFTER HandleCloseMenu - done=%s, quitFlag=%s\n", 
-                                                                   doneStr, quitFlagStr);
-                                                        }
-                                                        break;
-                                                    
-                                                    case 3:  /* Shell Console */
-                                                        HandleShellConsoleMenu();
-                                                        break;
-                                                    
-                                                    default:
-                                                        Printf("Workspace: Unknown menu item number: %lu\n", itemNumber);
-                                                        break;
-                                                }
-                                            }
-                                        } else if (menuNumber == 1) {
-                                            /* Windows menu */
-                                            HandleWindowsMenu(itemNumber);
-                                        } else if (menuNumber == 2) {
-                                            /* Prefs menu */
-                                            HandleThemeMenu(subNumber);
-                                        } else {
-                                            Printf("Workspace: Unknown menu number: %lu\n", menuNumber);
-                                        }
-                                    } else {
-                                        Printf("Workspace: WARNING - Menu item has no UserData\n");
-                                    }
-                                    menuCode = item->NextSelect;
-                                } else {
-                                    Printf("Workspace: WARNING - ItemAddress returned NULL for menuCode=0x%x\n", menuCode);
-                                    break;
-                                }
-                            }
-                        }
-                        ReplyMsg(msg);
-                        {
-                            STRPTR doneStr;
-                            STRPTR quitFlagStr;
-                            if (done) {
-                                doneStr = "TRUE";
-                            } else {
-                                doneStr = "FALSE";
-                            }
-                            if (wsState.quitFlag) {
-                                quitFlagStr = "TRUE";
-                            } else {
-                                quitFlagStr = "FALSE";
-                            }
-                            Printf("Workspace: After ReplyMsg for IDCMP_MENUPICK - done=%s, quitFlag=%s\n", 
-                                   doneStr, quitFlagStr);
-                        }
-                        if (done) {
-                            Printf("Workspace: Breaking from message processing loop because done=TRUE\n");
-                            break;
-                        }
-                        Printf("Workspace: Continuing message processing loop (done=FALSE)\n");
-                        break;
-                    
-                    default:
-                        ReplyMsg(msg);
-                        break;
-                }
-                
-                if (done) {
-                    break;
-                }
-            }
+        /* Another run of Workspace asked for more desktops */
+        if (wsState.launchPort && (signals & (1L << wsState.launchPort->mp_SigBit))) {
+            HandleLaunchMessages();
         }
         
-        {
-            STRPTR doneStr;
-            STRPTR quitFlagStr;
-            if (done) {
-                doneStr = "TRUE";
-            } else {
-                doneStr = "FALSE";
-            }
-            if (wsState.quitFlag) {
-                quitFlagStr = "TRUE";
-            } else {
-                quitFlagStr = "FALSE";
-            }
-            Printf("Workspace: End of event loop iteration - done=%s, quitFlag=%s\n", 
-                   doneStr, quitFlagStr);
-        }
-        if (done) {
-            Printf("Workspace: Breaking from main event loop because done=TRUE\n");
-            break;
-        }
-        {
-            STRPTR quitFlagStr;
-            if (wsState.quitFlag) {
-                quitFlagStr = "TRUE";
-            } else {
-                quitFlagStr = "FALSE";
-            }
-            Printf("Workspace: Continuing main event loop (done=FALSE, quitFlag=%s)\n", 
-                   quitFlagStr);
+        /* Drain the shared window port into a batch, replying at once so Intuition gets */
+        /* its messages back, then run the merged batch; repeat if the batch filled up */
+        if (signals & windowSignal) {
+            struct WindowBatch batch;
+            
+            do {
+                DrainWindowPort(wsState.windowPort, &batch);
+                RunWindowBatch(&batch);
+            } while (batch.full);
         }
+        
+        /* Close the desktops that were asked to - one with visitor windows stays open */
+        CloseRequestedDesktops();
+        
+        /* The batches are done with the menu items - replace the ones that changed */
+        RefreshPubScreenMenus();
     }
     
-    {
-        STRPTR doneStr;
-        STRPTR quitFlagStr;
-        if (done) {
-            doneStr = "TRUE";
-        } else {
-            doneStr = "FALSE";
-        }
-        if (wsState.quitFlag) {
-            quitFlagStr = "TRUE";
-        } else {
-            quitFlagStr = "FALSE";
-        }
-        Printf("Workspace: Event loop exited - done=%s, quitFlag=%s\n", 
-               doneStr, quitFlagStr);
+    LOG_INFO(("Workspace: Last desktop closed - exiting\n"));
+    if (wsState.spare) {
+        FreeSpareDesktop(wsState.spare);
+        wsState.spare = NULL;
     }
+    CleanupCommodity();
     
-    /* Only run cleanup if quitFlag was set (user actually wants to quit) */
-    /* If HandleCloseMenu returned FALSE due to visitors, quitFlag should be FALSE */
-    if (!wsState.quitFlag) {
-        Printf("Workspace: Event loop exited but quitFlag is FALSE - skipping cleanup\n");
-        Printf("Workspace: App will continue running\n");
-        return RETURN_OK;  /* Exit main() but don't cleanup */
+    Cleanup();
+    
+    return RETURN_OK;
+}
+
+/* Initialize required libraries */
+BOOL InitializeLibraries(VOID)
+{
+    LOG_TRACE(("Workspace: Opening intuition.library...\n"));
+    /* Open intuition.library */
+    IntuitionBase = (struct IntuitionBase *)OpenLibrary("intuition.library", 40L);
+    if (IntuitionBase == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Failed to open intuition.library\n"));
+        return FALSE;
     }
+    LOG_TRACE(("Workspace: intuition.library opened successfully\n"));
     
-    Printf("Workspace: quitFlag is TRUE - checking visitor count BEFORE closing anything\n");
-    
-    /* CRITICAL: Check visitor count FIRST, before closing the backdrop window */
-    /* Note: Backdrop window IS counted as a visitor window */
-    /* Expected: visitor count should be 1 (only backdrop window is open) */
-    {
-        WORD visitorCount = CheckWorkspaceVisitors();
-        Printf("Workspace: Visitor count: %ld\n", (LONG)visitorCount);
-        
-        if (visitorCount == 0) {
-            /* ERROR: Should have at least the backdrop window (count = 1) */
-            Printf("Workspace: ERROR - Visitor count is 0, expected at least 1 (backdrop window)\n");
-            Printf("Workspace: Something is wrong - aborting cleanup\n");
-            wsState.quitFlag = FALSE;
-            done = FALSE;
-            goto event_loop_start;
-        } else if (visitorCount == 1) {
-            /* Perfect: Only the backdrop window is open (backdrop counts as 1 visitor) */
-            Printf("Workspace: Only backdrop window is open (count=1) - proceeding with cleanup\n");
-            
-            /* Cleanup - order is important */
-            if (wsState.shellEnabled) {
-                CloseShellConsole();
-            }
-            
-            FreeBackdropImage();
-            /* CloseBackdropWindow will call ClearMenuStrip, so do it before FreeMenuStrip */
-            CloseBackdropWindow();
-            /* Now free the menu structure */
-            FreeMenuStrip();
-            /* Close screen - should succeed since only backdrop window was open */
-            if (!CloseWorkspaceScreen()) {
-                Printf("Workspace: ERROR - CloseWorkspaceScreen failed unexpectedly\n");
-                Printf("Workspace: Cannot exit - aborting cleanup, app will continue running\n");
-                wsState.quitFlag = FALSE;
-                done = FALSE;
-                goto event_loop_start;
-            }
-            /* Cleanup successful - continue with remaining cleanup */
-        } else {
-            /* visitorCount > 1: Other windows are open (backdrop + others) - show requester and abort */
-            /* Subtract 1 for the backdrop window when showing message */
-            {
-                WORD otherWindows = visitorCount - 1;
-                Printf("Workspace: %ld visitor window(s) total (1 backdrop + %ld others)\n", (LONG)visitorCount, (LONG)otherWindows);
-            }
-            Printf("Workspace: Showing requester and aborting cleanup - app will continue running\n");
-            
-            /* Show requester using backdrop window (which is still open) */
-            {
-                struct EasyStruct es;
-                STRPTR titleStr = "Cannot Exit Workspace";
-                char textBuffer[256];
-                STRPTR textStr;
-                STRPTR okStr = "OK";
-                struct Window *reqWindow;
-                WORD otherWindows;
-                
-                /* Format message with visitor count (subtract 1 for backdrop window) */
-                otherWindows = visitorCount - 1;
-                if (otherWindows == 1) {
-                    SNPrintf(textBuffer, sizeof(textBuffer), 
-                             "Cannot exit Workspace.\n\nThere is 1 window open on a Workspace screen.\n\nPlease close all windows and try again.");
-                } else {
-                    SNPrintf(textBuffer, sizeof(textBuffer), 
-                             "Cannot exit Workspace.\n\nThere are %d windows open on Workspace screens.\n\nPlease close all windows and try again.", 
-                             (int)otherWindows);
-                }
-                textStr = textBuffer;
-                
-                es.es_StructSize = sizeof(struct EasyStruct);
-                es.es_Flags = 0;
-                es.es_Title = titleStr;
-                es.es_TextFormat = textStr;
-                es.es_GadgetFormat = okStr;
-                
-                /* Ensure our screen is in front */
-                if (wsState.workspaceScreen) {
-                    ScreenToFront(wsState.workspaceScreen);
-                }
-                reqWindow = wsState.backdropWindow;
-                if (reqWindow == NULL || reqWindow->WScreen != wsState.workspaceScreen) {
-                    if (wsState.workspaceScreen && wsState.workspaceScreen->FirstWindow) {
-                        reqWindow = wsState.workspaceScreen->FirstWindow;
-                    }
-                }
-                EasyRequestArgs(reqWindow, &es, NULL, NULL);
-            }
-            
-            /* Reset quitFlag and restart event loop - do NOT close anything */
-            Printf("Workspace: Resetting quitFlag - app will continue running\n");
-            wsState.quitFlag = FALSE;
-            done = FALSE;
-            /* Restart the event loop */
-            Printf("Workspace: Restarting event loop\n");
-            goto event_loop_start;
-        }
-    }
-    
-    /* If we get here, cleanup was successful (visitorCount == 1 case) */
-    /* Continue with remaining cleanup */
-    CleanupCommodity();
-    
-    /* Free command line arguments */
-    if (wsState.rda) {
-        FreeArgs(wsState.rda);
-        wsState.rda = NULL;
-    }
-    
-    Cleanup();
-    
-    return RETURN_OK;
-}
-
-/* Initialize required libraries */
-BOOL InitializeLibraries(VOID)
-{
-    Printf("Workspace: Opening intuition.library...\n");
-    /* Open intuition.library */
-    IntuitionBase = (struct IntuitionBase *)OpenLibrary("intuition.library", 40L);
-    if (IntuitionBase == NULL) {
-        Printf("Workspace: ERROR - Failed to open intuition.library\n");
-        return FALSE;
-    }
-    Printf("Workspace: intuition.library opened successfully\n");
-    
-    /* Open utility.library */
-    UtilityBase = OpenLibrary("utility.library", 40L);
-    if (UtilityBase == NULL) {
-        CloseLibrary((struct Library *)IntuitionBase);
-        IntuitionBase = NULL;
-        return FALSE;
-    }
+    /* Open utility.library */
+    UtilityBase = OpenLibrary("utility.library", 40L);
+    if (UtilityBase == NULL) {
+        CloseLibrary((struct Library *)IntuitionBase);
+        IntuitionBase = NULL;
+        return FALSE;
+    }
     
     /* Open graphics.library */
     GfxBase = (struct GfxBase *)OpenLibrary("graphics.library", 40L);
@@ -873,16 +1135,22 @@ BOOL InitializeLibraries(VOID)
         return FALSE;
     }
     
+    /* Open commodities.library */
+    CommoditiesBase = OpenLibrary("commodities.library", 40L);
+    if (CommoditiesBase == NULL) {
+        /* Commodities not available, but continue anyway */
+    }
+    
+    return TRUE;
+}
+
+/* Libraries and devices only the backdrop window, menus and images need - */
+/* not opened in HEADLESS mode */
+BOOL OpenDesktopLibraries(VOID)
+{
     /* Open workbench.library */
     if (!(WorkbenchBase = OpenLibrary("workbench.library", 40L))) {
-        CloseLibrary(IconBase);
-        IconBase = NULL;
-        CloseLibrary(GfxBase);
-        GfxBase = NULL;
-        CloseLibrary(UtilityBase);
-        UtilityBase = NULL;
-        CloseLibrary((struct Library *)IntuitionBase);
-        IntuitionBase = NULL;
+        /* Cleanup closes the rest */
         return FALSE;
     }
     
@@ -892,12 +1160,6 @@ BOOL InitializeLibraries(VOID)
     /* Open datatypes.library (optional, for backdrop images) */
     DataTypesBase = OpenLibrary("datatypes.library", 40L);
         
-    /* Open commodities.library */
-    CommoditiesBase = OpenLibrary("commodities.library", 40L);
-    if (CommoditiesBase == NULL) {
-        /* Commodities not available, but continue anyway */
-    }
-    
     /* Open input.device for qualifier checking (optional) */
     InputPort = CreateMsgPort();
     if (InputPort != NULL) {
@@ -927,28 +1189,41 @@ BOOL InitializeCommodity(VOID)
     CxObj *broker;
     LONG brokerError;
     UBYTE commodityName[64];
+    struct MsgPort *brokerPort;
+    struct MemProbe probe;
     
     /* Initialize to NULL in case of early return */
     wsState.commodityBroker = NULL;
     wsState.commodityPort = NULL;
-    wsState.commoditySender = NULL;
     wsState.commodityReceiver = NULL;
     
     /* Open commodities.library - requires OS 3.0+ */
     /* Not critical - can run without commodity support */
     if (CommoditiesBase == NULL) {
-        Printf("Workspace: WARNING - Commodities library not available, continuing without commodity support\n");
+        LOG_WARN(("Workspace: WARNING - Commodities library not available, continuing without commodity support\n"));
         return TRUE; /* Non-fatal - continue without commodity support */
     }
     
-    Printf("Workspace: Creating commodity message port...\n");
+    LOG_TRACE(("Workspace: Creating commodity message port...\n"));
     /* Create message port for broker */
     wsState.commodityPort = CreateMsgPort();
     if (wsState.commodityPort == NULL) {
-        Printf("Workspace: WARNING - Failed to create commodity message port, continuing without commodity support\n");
+        LOG_WARN(("Workspace: WARNING - Failed to create commodity message port, continuing without commodity support\n"));
         return TRUE; /* Non-fatal */
     }
-    Printf("Workspace: Commodity message port created (signal bit: %ld)\n", wsState.commodityPort->mp_SigBit);
+    LOG_TRACE(("Workspace: Commodity message port created (signal bit: %ld)\n", wsState.commodityPort->mp_SigBit));
+    
+    /* With CX_TASK the broker talks to the commodity task, which forwards to commodityPort */
+    /* whatever it does not handle itself */
+    brokerPort = wsState.commodityPort;
+    if (wsState.cxTaskEnabled) {
+        if (StartCommodityTask()) {
+            brokerPort = wsState.cxTaskPort;
+            LOG_INFO(("Workspace: Commodity task started\n"));
+        } else {
+            LOG_WARN(("Workspace: WARNING - Failed to start commodity task, servicing commodity from main task\n"));
+        }
+    }
     
     /* Commodity name from command line or default "Workspace" */
     if (wsState.cxName && wsState.cxName[0] != '\0') {
@@ -965,81 +1240,74 @@ BOOL InitializeCommodity(VOID)
     nb.nb_Unique = NBU_UNIQUE | NBU_NOTIFY; /* Unique name, notify on duplicate */
     nb.nb_Flags = COF_SHOW_HIDE; /* Support show/hide commands */
     nb.nb_Pri = 0; /* Normal priority */
-    nb.nb_Port = wsState.commodityPort;
+    nb.nb_Port = brokerPort;
     nb.nb_ReservedChannel = 0;
     
-    Printf("Workspace: Creating commodity broker (name: %s)...\n", nb.nb_Name);
+    LOG_TRACE(("Workspace: Creating commodity broker (name: %s)...\n", nb.nb_Name));
     /* Create broker */
+    MemProbeBegin(&probe);
     broker = CxBroker(&nb, &brokerError);
     if (broker == NULL) {
         /* Check specific error code */
         switch (brokerError) {
             case CBERR_DUP:
-                Printf("Workspace: WARNING - Broker name '%s' already exists, continuing without commodity support\n", nb.nb_Name);
+                LOG_WARN(("Workspace: WARNING - Broker name '%s' already exists, continuing without commodity support\n", nb.nb_Name));
                 break;
             case CBERR_SYSERR:
-                Printf("Workspace: WARNING - System error creating broker (low memory), continuing without commodity support\n");
+                LOG_WARN(("Workspace: WARNING - System error creating broker (low memory), continuing without commodity support\n"));
                 break;
             case CBERR_VERSION:
-                Printf("Workspace: WARNING - Unknown broker version, continuing without commodity support\n");
+                LOG_WARN(("Workspace: WARNING - Unknown broker version, continuing without commodity support\n"));
                 break;
             default:
-                Printf("Workspace: WARNING - Failed to create broker (error: %ld), continuing without commodity support\n", brokerError);
+                LOG_WARN(("Workspace: WARNING - Failed to create broker (error: %ld), continuing without commodity support\n", brokerError));
                 break;
         }
-        /* Failed to create broker - cleanup and continue */
-        DeleteMsgPort(wsState.commodityPort);
-        wsState.commodityPort = NULL;
-        return TRUE; /* Non-fatal - continue without commodity support */
+        goto done;
     }
     
     /* Check for object errors */
     {
         LONG objError = CxObjError(broker);
         if (objError) {
-            Printf("Workspace: WARNING - Broker created but has errors (0x%lx), continuing without commodity support\n", (ULONG)objError);
+            LOG_WARN(("Workspace: WARNING - Broker created but has errors (0x%lx), continuing without commodity support\n", (ULONG)objError));
             /* Broker created but has errors - cleanup */
             DeleteCxObjAll(broker);
             broker = NULL;
-            DeleteMsgPort(wsState.commodityPort);
-            wsState.commodityPort = NULL;
-            return TRUE; /* Non-fatal */
+            goto done;
         }
     }
     
     wsState.commodityBroker = broker;
-    wsState.commoditySender = NULL;
     wsState.commodityReceiver = NULL;
     wsState.commodityFilter = NULL;
     
-    /* Create filter for hotkey if CX_POPKEY is specified */
-    if (wsState.cxPopKey && wsState.cxPopKey[0] != '\0') {
-        Printf("Workspace: Creating filter for hotkey: %s\n", wsState.cxPopKey);
-        wsState.commodityFilter = CxFilter(wsState.cxPopKey);
-        if (wsState.commodityFilter) {
-            LONG filterError = CxObjError(wsState.commodityFilter);
-            if (filterError) {
-                Printf("Workspace: WARNING - Filter has errors (0x%lx)\n", (ULONG)filterError);
-                DeleteCxObj(wsState.commodityFilter);
-                wsState.commodityFilter = NULL;
-            } else {
-                /* Attach filter to broker */
-                AttachCxObj(broker, wsState.commodityFilter);
-                /* Create sender to receive filtered events */
-                wsState.commoditySender = CxSender(wsState.commodityPort, 1);
-                if (wsState.commoditySender) {
-                    AttachCxObj(wsState.commodityFilter, wsState.commoditySender);
-                    Printf("Workspace: Hotkey filter and sender created successfully\n");
-                } else {
-                    Printf("Workspace: WARNING - Failed to create sender for hotkey filter\n");
-                }
-            }
-        } else {
-            Printf("Workspace: WARNING - Failed to create filter for hotkey\n");
+    /* Hotkeys - each sender's ID is the command to run, like menu item UserData */
+    wsState.commodityFilter = AddHotKey(broker, brokerPort, wsState.cxPopKey, &wsCommands[WSCMD_SCREEN_TO_FRONT]);
+    AddHotKey(broker, brokerPort, wsState.cxNextKey, &wsCommands[WSCMD_NEXT_DESKTOP]);
+    AddHotKey(broker, brokerPort, wsState.cxPrevKey, &wsCommands[WSCMD_PREV_DESKTOP]);
+    AddHotKey(broker, brokerPort, wsState.cxQuitKey, &wsCommands[WSCMD_QUIT]);
+    if (wsState.cxGotoKey) {
+        UBYTE gotoKey[80];
+        ULONG i;
+        
+        for (i = 0; i < WS_GOTO_KEYS; i++) {
+            SNPrintf(gotoKey, sizeof(gotoKey), "%s %lu", wsState.cxGotoKey, i + 1);
+            AddHotKey(broker, brokerPort, gotoKey, &wsCommands[WSCMD_GOTO_DESKTOP + i]);
         }
     }
     
-    Printf("Workspace: Activating commodity broker...\n");
+done:
+    MemProbeEnd(&probe, MEMACCT_COMMODITY);
+    if (broker == NULL) {
+        /* Failed to create broker - cleanup and continue */
+        StopCommodityTask();
+        DeleteMsgPort(wsState.commodityPort);
+        wsState.commodityPort = NULL;
+        return TRUE; /* Non-fatal - continue without commodity support */
+    }
+    
+    LOG_TRACE(("Workspace: Activating commodity broker...\n"));
     /* Activate the broker (brokers are created inactive) */
     /* ActivateCxObj returns previous activation state: 0 = was inactive, non-zero = was active */
     {
@@ -1047,19 +1315,58 @@ BOOL InitializeCommodity(VOID)
         if (prevState == 0) {
             /* Was inactive, now activated - this is expected */
             wsState.commodityActive = TRUE;
-            Printf("Workspace: Commodity broker activated successfully\n");
+            LOG_INFO(("Workspace: Commodity broker activated successfully\n"));
         } else {
             /* Was already active - unexpected but not an error */
             wsState.commodityActive = TRUE;
-            Printf("Workspace: WARNING - Broker was already active (unexpected)\n");
+            LOG_WARN(("Workspace: WARNING - Broker was already active (unexpected)\n"));
         }
     }
     return TRUE;
 }
 
+/* Filter for hotkey description with a sender that sends command to port */
+/* Returns the filter, attached to broker, or NULL if there is no such hotkey */
+CxObj *AddHotKey(CxObj *broker, struct MsgPort *port, STRPTR description, struct WsCommand *command)
+{
+    CxObj *filter;
+    CxObj *sender;
+    LONG filterError;
+    
+    if (description == NULL || description[0] == '\0') {
+        return NULL;
+    }
+    LOG_TRACE(("Workspace: Creating filter for hotkey: %s\n", description));
+    filter = CxFilter(description);
+    if (filter == NULL) {
+        LOG_WARN(("Workspace: WARNING - Failed to create filter for hotkey %s\n", description));
+        return NULL;
+    }
+    filterError = CxObjError(filter);
+    if (filterError) {
+        LOG_WARN(("Workspace: WARNING - Filter for hotkey %s has errors (0x%lx)\n", description, (ULONG)filterError));
+        DeleteCxObj(filter);
+        return NULL;
+    }
+    
+    /* Create sender to receive filtered events */
+    sender = CxSender(port, (LONG)command);
+    if (sender == NULL) {
+        LOG_WARN(("Workspace: WARNING - Failed to create sender for hotkey %s\n", description));
+        DeleteCxObj(filter);
+        return NULL;
+    }
+    AttachCxObj(filter, sender);
+    AttachCxObj(broker, filter);
+    LOG_TRACE(("Workspace: Hotkey %s runs %s\n", description, command->name));
+    return filter;
+}
+
 /* Cleanup commodity */
 VOID CleanupCommodity(VOID)
 {
+    struct MemProbe probe;
+    
     if (CommoditiesBase == NULL) {
         return;
     }
@@ -1071,2257 +1378,5155 @@ VOID CleanupCommodity(VOID)
             wsState.commodityActive = FALSE;
         }
         /* Delete the commodity object (this will also delete filter and sender) */
+        MemProbeBegin(&probe);
         DeleteCxObjAll(wsState.commodityBroker);
+        MemProbeEnd(&probe, MEMACCT_COMMODITY);
         wsState.commodityBroker = NULL;
-        wsState.commoditySender = NULL;
         wsState.commodityReceiver = NULL;
         wsState.commodityFilter = NULL;
     }
     
+    /* No more messages can arrive now - stop the task, it replies what it still holds */
+    StopCommodityTask();
+    
     if (wsState.commodityPort) {
+        struct Message *msg;
+        
+        /* Reply messages forwarded by the commodity task that were never serviced */
+        while ((msg = GetMsg(wsState.commodityPort)) != NULL) {
+            ReplyMsg(msg);
+        }
         DeleteMsgPort(wsState.commodityPort);
         wsState.commodityPort = NULL;
     }
 }
 
-/* Get workspace name (from command line or default "Workspace.1") */
-STRPTR GetWorkspaceName(VOID)
+/* Start the CX_TASK commodity servicing process and wait until its port exists */
+BOOL StartCommodityTask(VOID)
 {
-    static UBYTE nameBuffer[64];
+    wsState.cxTaskSigBit = AllocSignal(-1);
+    if (wsState.cxTaskSigBit == -1) {
+        return FALSE;
+    }
+    SetSignal(0, 1L << wsState.cxTaskSigBit);
     
-    /* Use command line pubname if provided, otherwise default to "Workspace.1" */
-    if (wsState.pubName && wsState.pubName[0] != '\0') {
-        SNPrintf(nameBuffer, sizeof(nameBuffer), "%s", wsState.pubName);
-    } else {
-        SNPrintf(nameBuffer, sizeof(nameBuffer), "Workspace.1");
+    wsState.commodityProcess = CreateNewProcTags(
+        NP_Entry, (ULONG)CommodityTask,
+        NP_Name, (ULONG)"Workspace Commodity",
+        NP_Priority, CX_TASK_PRIORITY,
+        NP_StackSize, 4096,
+        TAG_DONE);
+    if (wsState.commodityProcess == NULL) {
+        FreeSignal(wsState.cxTaskSigBit);
+        wsState.cxTaskSigBit = -1;
+        return FALSE;
+    }
+    
+    Wait(1L << wsState.cxTaskSigBit);
+    if (wsState.cxTaskPort == NULL) {
+        /* Task could not create its port and has exited */
+        wsState.commodityProcess = NULL;
+        FreeSignal(wsState.cxTaskSigBit);
+        wsState.cxTaskSigBit = -1;
+        return FALSE;
     }
-    wsState.instanceNumber = 1;
-    return nameBuffer;
+    return TRUE;
 }
 
-/* Create workspace screen (clone of Workbench) */
-BOOL CreateWorkspaceScreen(VOID)
+/* Stop the commodity task - call only after the broker has been deleted */
+VOID StopCommodityTask(VOID)
 {
-    struct Screen *newScreen;
-    LONG screenError = 0;
-    ULONG numColors;
+    if (wsState.commodityProcess == NULL) {
+        return;
+    }
+    Signal((struct Task *)wsState.commodityProcess, SIGBREAKF_CTRL_C);
+    Wait(1L << wsState.cxTaskSigBit);
+    wsState.commodityProcess = NULL;
+    FreeSignal(wsState.cxTaskSigBit);
+    wsState.cxTaskSigBit = -1;
+}
+
+/* CX_TASK commodity servicing process - handles hotkeys and Exchange Show itself */
+/* so they do not wait for the main task, and forwards all other messages to it */
+/* Runs without logging - the log ring belongs to the main task */
+__saveds VOID CommodityTask(VOID)
+{
+    struct MsgPort *port;
+    CxMsg *cxmsg;
+    BOOL running = TRUE;
     
-    /* Create screen using SA_LikeWorkbench (like example.c) */
-    Printf("Workspace: Opening screen with SA_LikeWorkbench...\n");
-    newScreen = OpenScreenTags(NULL,
-        SA_Type, PUBLICSCREEN,
-        SA_PubName, wsState.workspaceName,
-        SA_Title, wsState.workspaceName,
-        SA_LikeWorkbench, TRUE,
-        SA_ErrorCode, &screenError,
-        TAG_DONE);
+    port = CreateMsgPort();
+    wsState.cxTaskPort = port;
+    if (port == NULL) {
+        Forbid();
+        Signal(wsState.mainTask, 1L << wsState.cxTaskSigBit);
+        return;
+    }
+    Signal(wsState.mainTask, 1L << wsState.cxTaskSigBit);
     
-    if (newScreen == NULL) {
-        /* Check specific error code */
-        switch (screenError) {
-            case OSERR_PUBNOTUNIQUE:
-                Printf("Workspace: ERROR - Public screen name '%s' already in use\n", wsState.workspaceName);
-                break;
-            case OSERR_NOMEM:
-                Printf("Workspace: ERROR - Out of memory (normal memory)\n");
-                break;
-            case OSERR_NOCHIPMEM:
-                Printf("Workspace: ERROR - Out of memory (chip memory)\n");
-                break;
-            case OSERR_NOMONITOR:
-                Printf("Workspace: ERROR - Monitor not available\n");
-                break;
-            case OSERR_NOCHIPS:
-                Printf("Workspace: ERROR - Newer custom chips required\n");
-                break;
-            case OSERR_UNKNOWNMODE:
-                Printf("Workspace: ERROR - Unknown display mode\n");
-                break;
-            case OSERR_TOODEEP:
-                Printf("Workspace: ERROR - Screen too deep for hardware\n");
-                break;
-            case OSERR_ATTACHFAIL:
-                Printf("Workspace: ERROR - Failed to attach screens\n");
-                break;
-            case OSERR_NOTAVAILABLE:
-                Printf("Workspace: ERROR - Mode not available\n");
-                break;
-            case OSERR_NORTGBITMAP:
-                Printf("Workspace: ERROR - Could not allocate RTG bitmap\n");
-                break;
-            default:
-                Printf("Workspace: ERROR - Failed to open screen (error code: %ld)\n", screenError);
-                break;
+    while (running) {
+        ULONG signals = Wait((1L << port->mp_SigBit) | SIGBREAKF_CTRL_C);
+        
+        if (signals & SIGBREAKF_CTRL_C) {
+            running = FALSE;
+        }
+        while ((cxmsg = (CxMsg *)GetMsg(port)) != NULL) {
+            if (!running || ServiceCommodityMessage(cxmsg)) {
+                ReplyMsg((struct Message *)cxmsg);
+            } else {
+                PutMsg(wsState.commodityPort, (struct Message *)cxmsg);
+            }
         }
-        return FALSE;
     }
     
-    Printf("Workspace: Screen opened successfully\n");
-    /* Use Screen->RastPort.BitMap instead of Screen->BitMap (recommended in docs) */
-    Printf("Workspace: Screen->Width=%ld, Screen->Height=%ld\n",
-           (LONG)newScreen->Width, (LONG)newScreen->Height);
-    Printf("Workspace: ViewPort.DWidth=%ld, ViewPort.DHeight=%ld\n",
-           (LONG)newScreen->ViewPort.DWidth, (LONG)newScreen->ViewPort.DHeight);
+    wsState.cxTaskPort = NULL;
+    DeleteMsgPort(port);
     
-    /* Get draw info for our screen */
-    wsState.drawInfo = GetScreenDrawInfo(newScreen);
+    /* Forbid until we are gone - the main task may unload our code once signalled */
+    Forbid();
+    Signal(wsState.mainTask, 1L << wsState.cxTaskSigBit);
+}
+
+/* Commodity task side of ProcessCommodityMessages - TRUE if handled (caller replies), */
+/* FALSE to forward the message to the main task */
+BOOL ServiceCommodityMessage(CxMsg *cxmsg)
+{
+    BOOL toFront = FALSE;
+    struct LatencyProbe probe;
     
-    /* Make screen public - PubScreenStatus(screen, 0) makes it public */
-    /* According to docs: Returns 0 in bit 0 if screen wasn't public (success when making public) */
-    /* So bit 0 = 0 means SUCCESS when making public, bit 0 = 1 means was already public or error */
-    {
-        UWORD statusResult = PubScreenStatus(newScreen, 0);
-        if ((statusResult & 0x0001) == 0) {
-            /* Bit 0 = 0 means screen wasn't public before, so we successfully made it public */
-            Printf("Workspace: Screen is now public\n");
-        } else {
-            /* Bit 0 = 1 means screen was already public or error occurred */
-            Printf("Workspace: WARNING - Screen was already public or error (status: 0x%x)\n", statusResult);
-            /* Continue anyway */
+    if (CxMsgType(cxmsg) & CXM_IEVENT) {
+        if ((struct WsCommand *)CxMsgID(cxmsg) == &wsCommands[WSCMD_SCREEN_TO_FRONT]) {
+            struct InputEvent *ie = (struct InputEvent *)CxMsgData(cxmsg);
+            
+            if (ie) {
+                LatencyBegin(&probe, ie->ie_TimeStamp.tv_secs, ie->ie_TimeStamp.tv_micro);
+            } else {
+                LatencyBegin(&probe, 0, 0);
+            }
+            toFront = TRUE;
+        }
+    } else if (CxMsgType(cxmsg) & CXM_COMMAND) {
+        if (CxMsgID(cxmsg) == CXCMD_APPEAR || CxMsgID(cxmsg) == CXCMD_UNIQUE) {
+            LatencyBegin(&probe, 0, 0);
+            toFront = TRUE;
         }
     }
+    if (!toFront) {
+        return FALSE;
+    }
     
-    /* Check dimensions after making public */
-        Printf("Workspace: After making public - Width: %ld, Height: %ld\n",
-               (LONG)newScreen->Width, (LONG)newScreen->Height);
-    
-    wsState.workspaceScreen = newScreen;
+    ObtainSemaphoreShared(&wsState.screenSemaphore);
+    if (wsState.frontDesktop && wsState.frontDesktop->workspaceScreen == NULL) {
+        /* Not materialized yet - only the main task can open its screen */
+        ReleaseSemaphore(&wsState.screenSemaphore);
+        return FALSE;
+    }
+    if (wsState.frontDesktop) {
+        ScreenToFront(wsState.frontDesktop->workspaceScreen);
+    }
+    ReleaseSemaphore(&wsState.screenSemaphore);
+    LatencyRecord(&probe, LATENCY_SCREEN);
+    return TRUE;
+}
 
-    /* Capture original palette immediately after opening the screen */
-    wsState.haveOriginalPalette = FALSE;
-    wsState.numColors = 0;
-    numColors = 1UL << newScreen->BitMap.Depth;
-    if (numColors > 256) {
-        numColors = 256;
+/* Allocate a desktop named pubName if given, else the first Workspace.n not in use */
+struct Desktop *NewDesktop(STRPTR pubName)
+{
+    struct Desktop *desktop;
+    struct MemProbe probe;
+    UBYTE name[MAXPUBSCREENNAME + 1];
+    ULONG number = 0;
+    BOOL taken;
+    
+    if (pubName && pubName[0] != '\0') {
+        SNPrintf(name, sizeof(name), "%s", pubName);
+    } else {
+        /* The registry has the screens of every Workspace process, ours included */
+        ObtainSemaphoreShared(&registry->semaphore);
+        do {
+            number++;
+            SNPrintf(name, sizeof(name), "Workspace.%lu", number);
+            taken = (RegistryFind(name) != NULL);
+            /* The spare's name is not in the registry until it is handed out */
+            if (wsState.spare && strcmp((char *)wsState.spare->screenName, (char *)name) == 0) {
+                taken = TRUE;
+            }
+        } while (taken);
+        ReleaseSemaphore(&registry->semaphore);
     }
-    if (newScreen->ViewPort.ColorMap != NULL && numColors > 0) {
-        GetRGB32(newScreen->ViewPort.ColorMap, 0, numColors, wsState.originalRGB);
-        wsState.numColors = numColors;
-        wsState.haveOriginalPalette = TRUE;
+    
+    MemProbeBegin(&probe);
+    desktop = AllocVec(sizeof(struct Desktop) + strlen((char *)name), MEMF_CLEAR);
+    MemProbeEnd(&probe, MEMACCT_DESKTOP);
+    if (desktop == NULL) {
+        return NULL;
     }
+    MemCharge(MEMACCT_DESKTOP, MEMF_CLEAR, sizeof(struct Desktop) + strlen((char *)name));
+    strcpy((char *)desktop->screenName, (char *)name);
+    desktop->workspaceName = desktop->screenName;
+    desktop->number = number;
+    desktop->currentTheme = wsState.defaultTheme;
+    desktop->backdropPath = wsState.backdropImagePath;
+    return desktop;
+}
+
+/* Free a desktop that has no screen, window or registry entry left */
+/* Exclusive, so the commodity task is not looking at it as it goes */
+VOID FreeDesktop(struct Desktop *desktop)
+{
+    struct MemProbe probe;
     
+    ObtainSemaphore(&wsState.screenSemaphore);
+    if (wsState.frontDesktop == desktop) {
+        wsState.frontDesktop = wsState.desktops;
+    }
+    MemProbeBegin(&probe);
+    if (desktop->originalRGB) {
+        MemCharge(MEMACCT_DESKTOP, MEMF_ANY, -(LONG)(desktop->numColors * 3));
+        FreeVec(desktop->originalRGB);
+    }
+    if (desktop->backdropPath != wsState.backdropImagePath) {
+        MemCharge(MEMACCT_DESKTOP, MEMF_ANY, -(LONG)(strlen((char *)desktop->backdropPath) + 1));
+        FreeVec(desktop->backdropPath);
+    }
+    MemCharge(MEMACCT_DESKTOP, MEMF_CLEAR, -(LONG)(sizeof(struct Desktop) + strlen((char *)desktop->screenName)));
+    FreeVec(desktop);
+    MemProbeEnd(&probe, MEMACCT_DESKTOP);
+    ReleaseSemaphore(&wsState.screenSemaphore);
+}
+
+/* The desktop whose screen was just brought to front - for the commodity task */
+VOID SetFrontDesktop(struct Desktop *desktop)
+{
+    ObtainSemaphore(&wsState.screenSemaphore);
+    wsState.frontDesktop = desktop;
+    ReleaseSemaphore(&wsState.screenSemaphore);
+}
+
+/* Give a desktop a BACKDROP of its own - a copy, freed with the desktop */
+BOOL SetDesktopBackdrop(struct Desktop *desktop, STRPTR path)
+{
+    STRPTR copy;
+    struct MemProbe probe;
+    
+    MemProbeBegin(&probe);
+    copy = AllocVec(strlen((char *)path) + 1, MEMF_ANY);
+    if (copy != NULL) {
+        MemCharge(MEMACCT_DESKTOP, MEMF_ANY, strlen((char *)path) + 1);
+        strcpy((char *)copy, (char *)path);
+        if (desktop->backdropPath != wsState.backdropImagePath) {
+            MemCharge(MEMACCT_DESKTOP, MEMF_ANY, -(LONG)(strlen((char *)desktop->backdropPath) + 1));
+            FreeVec(desktop->backdropPath);
+        }
+        desktop->backdropPath = copy;
+    }
+    MemProbeEnd(&probe, MEMACCT_DESKTOP);
+    if (copy == NULL) {
+        LOG_WARN(("Workspace: WARNING - No memory for BACKDROP of %s\n", desktop->workspaceName));
+        return FALSE;
+    }
     return TRUE;
 }
 
-/* Close workspace screen - shows warning if visitors exist, then returns FALSE */
-/* Returns TRUE if screen was closed successfully, FALSE if visitors prevent closing */
-BOOL CloseWorkspaceScreen(VOID)
+/* Open a desktop in screen mode mode - pubName NULL picks the next free Workspace.n */
+/* The name is reserved in the registry right away. With materialize FALSE that is all - */
+/* the screen opens the first time the desktop is needed (see MaterializeDesktop). */
+/* A materialized desktop becomes current. */
+struct Desktop *OpenDesktop(STRPTR pubName, struct ModeProfile *mode, BOOL materialize)
 {
-    struct List *pubScreenList = NULL;
-    struct PubScreenNode *psn = NULL;
-    WORD visitorCount = 0;
-    BOOL closeSucceeded = FALSE;
-    struct EasyStruct es;
-    STRPTR titleStr;
-    STRPTR textStr;
-    STRPTR okStr;
+    struct Desktop *desktop;
+    struct Desktop *previous = currentDesktop;
     
-    if (!wsState.workspaceScreen) {
-        return TRUE;  /* No screen to close - consider it successful */
+    if (wsState.desktopCount >= WS_MAX_DESKTOPS) {
+        LOG_WARN(("Workspace: WARNING - Already managing %lu desktops\n", wsState.desktopCount));
+        return NULL;
     }
     
-    /* Check for visitor windows once - don't loop */
-    {
-        visitorCount = 0;
-        
-        /* Lock public screen list to check visitor count for all Workspace screens */
-        pubScreenList = LockPubScreenList();
-        if (pubScreenList) {
-            /* Iterate through all public screens - correct Exec list iteration */
-            psn = (struct PubScreenNode *)pubScreenList->lh_Head;
-            while (psn && psn->psn_Node.ln_Succ != (struct Node *)&pubScreenList->lh_Tail) {
-                /* Check if this is a Workspace screen (starts with "Workspace.") */
-                if (psn->psn_Node.ln_Name && 
-                    strncmp(psn->psn_Node.ln_Name, "Workspace.", 10) == 0) {
-                    visitorCount += (WORD)psn->psn_VisitorCount;
-                    Printf("Workspace: Screen '%s' has %ld visitor windows\n", 
-                           psn->psn_Node.ln_Name, (LONG)psn->psn_VisitorCount);
-                }
-                psn = (struct PubScreenNode *)psn->psn_Node.ln_Succ;
+    /* The spare already has its name and mode - use it if those are the ones wanted */
+    if (materialize && wsState.spare && SameModeProfile(mode, &wsState.spare->mode)) {
+        if (pubName == NULL || pubName[0] == '\0' ||
+            strcmp((char *)pubName, (char *)wsState.spare->workspaceName) == 0) {
+            desktop = AdoptSpareDesktop();
+            if (desktop) {
+                LinkDesktop(desktop);
+                return desktop;
             }
-            UnlockPubScreenList();
-        }
-        
-        Printf("Workspace: Total visitor windows on all Workspace screens: %d\n", visitorCount);
-        
-        /* Check if we can close - no visitors allowed */
-        if (visitorCount > 0) {
-            /* Show EasyRequest dialog warning user */
-            titleStr = "Cannot Exit Workspace";
-            textStr = "Cannot exit Workspace.\n\nAll windows on Workspace screens must be closed before exiting.\n\nPlease close all windows and try again.";
-            okStr = "OK";
-            
-            es.es_StructSize = sizeof(struct EasyStruct);
-            es.es_Flags = 0;
-            es.es_Title = titleStr;
-            es.es_TextFormat = textStr;
-            es.es_GadgetFormat = okStr;
-            
-            /* Ensure our screen is in front and use a valid window on our screen */
-            if (wsState.workspaceScreen) {
-                ScreenToFront(wsState.workspaceScreen);
-            }
-            /* Use backdrop window if available and valid, otherwise try to use screen's first window */
-            {
-                struct Window *reqWindow = wsState.backdropWindow;
-                /* If backdrop window is NULL or not on our screen, try to find another window */
-                if (reqWindow == NULL || reqWindow->WScreen != wsState.workspaceScreen) {
-                    /* Try to use the screen's first window if available */
-                    if (wsState.workspaceScreen && wsState.workspaceScreen->FirstWindow) {
-                        reqWindow = wsState.workspaceScreen->FirstWindow;
-                    }
-                }
-                EasyRequestArgs(reqWindow, &es, NULL, NULL);
-            }
-        Printf("Workspace: Cannot close - %ld visitor windows still open, user must close them\n", (LONG)visitorCount);
-        /* Return FALSE - screen was not closed */
-        return FALSE;
-        }
-        
-        /* No visitors - try to close screen */
-        /* Take screen private before closing */
-        {
-            UWORD statusResult = PubScreenStatus(wsState.workspaceScreen, PSNF_PRIVATE);
-            if ((statusResult & 0x0001) == 0) {
-                /* Bit 0 = 0 means can't make private (visitors are open) */
-                Printf("Workspace: WARNING - Could not make screen private (status: 0x%x), may have visitors\n", statusResult);
-                /* Show warning and return */
-                titleStr = "Cannot Close Screen";
-                textStr = "Cannot close Workspace screen.\n\nAll windows on this screen must be closed before exiting.\n\nPlease close all windows and try again.";
-                okStr = "OK";
-                
-                es.es_StructSize = sizeof(struct EasyStruct);
-                es.es_Flags = 0;
-                es.es_Title = titleStr;
-                es.es_TextFormat = textStr;
-                es.es_GadgetFormat = okStr;
-                
-                if (wsState.workspaceScreen) {
-                    ScreenToFront(wsState.workspaceScreen);
-                }
-                {
-                    struct Window *reqWindow = wsState.backdropWindow;
-                    if (reqWindow == NULL || reqWindow->WScreen != wsState.workspaceScreen) {
-                        if (wsState.workspaceScreen && wsState.workspaceScreen->FirstWindow) {
-                            reqWindow = wsState.workspaceScreen->FirstWindow;
-                        }
-                    }
-                    EasyRequestArgs(reqWindow, &es, NULL, NULL);
-                }
-            Printf("Workspace: Cannot make screen private, user must close windows\n");
-            return FALSE;
-            } else {
-                /* Bit 0 = 1 means successfully made private */
-                Printf("Workspace: Screen made private\n");
-            }
-        }
-        
-        /* Close screen - returns TRUE if closed, FALSE if windows still open */
-        closeSucceeded = CloseScreen(wsState.workspaceScreen);
-        if (!closeSucceeded) {
-            Printf("Workspace: CloseScreen failed - windows may still be open\n");
-            /* Show requester and retry */
-            titleStr = "Cannot Close Screen";
-            textStr = "Cannot close Workspace screen.\n\nAll windows on this screen must be closed before exiting.\n\nPlease close all windows and try again.";
-            okStr = "OK";
-            
-            es.es_StructSize = sizeof(struct EasyStruct);
-            es.es_Flags = 0;
-            es.es_Title = titleStr;
-            es.es_TextFormat = textStr;
-            es.es_GadgetFormat = okStr;
-            
-            /* Ensure our screen is in front and use a valid window on our screen */
-            if (wsState.workspaceScreen) {
-                ScreenToFront(wsState.workspaceScreen);
-            }
-            /* Use backdrop window if available and valid, otherwise try to use screen's first window */
-            {
-                struct Window *reqWindow = wsState.backdropWindow;
-                /* If backdrop window is NULL or not on our screen, try to find another window */
-                if (reqWindow == NULL || reqWindow->WScreen != wsState.workspaceScreen) {
-                    /* Try to use the screen's first window if available */
-                    if (wsState.workspaceScreen && wsState.workspaceScreen->FirstWindow) {
-                        reqWindow = wsState.workspaceScreen->FirstWindow;
-                    }
-                }
-                EasyRequestArgs(reqWindow, &es, NULL, NULL);
-            }
-            Printf("Workspace: CloseScreen failed, user must close windows\n");
-            /* Return FALSE - screen was not closed */
-            return FALSE;
         }
     }
     
-    /* Only free draw info after successful close */
-    if (wsState.drawInfo) {
-        FreeScreenDrawInfo(wsState.workspaceScreen, wsState.drawInfo);
-        wsState.drawInfo = NULL;
+    desktop = NewDesktop(pubName);
+    if (desktop == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Out of memory for desktop\n"));
+        return NULL;
+    }
+    desktop->mode = *mode;
+    LOG_INFO(("Workspace: Workspace name: %s\n", desktop->workspaceName));
+    if (!RegisterScreen(desktop)) {
+        LOG_ERROR(("Workspace: ERROR - Failed to reserve %s\n", desktop->workspaceName));
+        FreeDesktop(desktop);
+        return NULL;
     }
     
-    wsState.workspaceScreen = NULL;
-    Printf("Workspace: Screen closed successfully\n");
-    return TRUE;
+    if (materialize) {
+        if (!MaterializeDesktop(desktop, (BOOL)(wsState.desktops == NULL))) {
+            UnregisterScreen(desktop);
+            FreeDesktop(desktop);
+            currentDesktop = previous;
+            return NULL;
+        }
+    } else {
+        LOG_INFO(("Workspace: %s reserved, screen opens when first needed\n", desktop->workspaceName));
+    }
+    
+    LinkDesktop(desktop);
+    return desktop;
 }
 
-/* Create backdrop window using standard Intuition OpenWindowTags() */
-BOOL CreateBackdropWindow(VOID)
+/* Add a desktop to the list - it becomes current if there was none */
+VOID LinkDesktop(struct Desktop *desktop)
 {
-    WORD screenWidth, screenHeight;
-    WORD titleBarHeight, windowTop, windowHeight;
+    struct Desktop **link;
     
-    if (wsState.workspaceScreen == NULL) {
-        return FALSE;
+    /* Keep the list in the order the desktops were opened */
+    ObtainSemaphore(&wsState.screenSemaphore);
+    for (link = &wsState.desktops; *link != NULL; link = &(*link)->next) {
     }
-    
-    Printf("Workspace: Creating backdrop window on workspace screen...\n");
-    
-    /* Get screen dimensions - Width and Height are the RastPort dimensions */
-    /* According to docs: "Width = the width for this screen's RastPort" */
-    /* For SA_LikeWorkbench screens, use ViewPort dimensions if Screen->Width is 0 */
-    if (wsState.workspaceScreen->Width == 0 && wsState.workspaceScreen->ViewPort.DWidth > 0) {
-        screenWidth = 640; /*wsState.workspaceScreen->ViewPort.DWidth;*/
-        screenHeight = 480; /*wsState.workspaceScreen->ViewPort.DHeight;*/
-        Printf("Workspace: Using ViewPort dimensions: Width=%ld, Height=%ld\n",
-               (LONG)screenWidth, (LONG)screenHeight);
-    } else {
-        screenWidth = wsState.workspaceScreen->Width;
-        screenHeight = wsState.workspaceScreen->Height;
-        Printf("Workspace: Using Screen dimensions: Width=%ld, Height=%ld\n",
-               (LONG)screenWidth, (LONG)screenHeight);
+    *link = desktop;
+    desktop->ringIndex = wsState.desktopCount;
+    wsState.ring[wsState.desktopCount] = desktop;
+    wsState.desktopCount++;
+    if (currentDesktop == NULL) {
+        currentDesktop = desktop;
     }
+    if (wsState.frontDesktop == NULL) {
+        wsState.frontDesktop = desktop;
+    }
+    ReleaseSemaphore(&wsState.screenSemaphore);
+}
+
+/* Open the screen, backdrop window, menus, then backdrop image or shell of a desktop */
+/* The desktop becomes current. On failure it is left without a screen, its name */
+/* still reserved. Startup phases are profiled if profile is TRUE. */
+BOOL MaterializeDesktop(struct Desktop *desktop, BOOL profile)
+{
+    if (desktop->workspaceScreen) {
+        currentDesktop = desktop;
+        return TRUE;
+    }
+    currentDesktop = desktop;
     
-    /* Calculate title bar height - BarHeight is one less than actual height */
-    titleBarHeight = wsState.workspaceScreen->BarHeight + 1;
-    windowTop = titleBarHeight;
-    windowHeight = screenHeight - titleBarHeight;
-    
-    Printf("Workspace: Screen BarHeight=%ld, TitleBarHeight=%ld\n", 
-           (LONG)wsState.workspaceScreen->BarHeight, (LONG)titleBarHeight);
-    Printf("Workspace: Creating window: Left=0, Top=%ld, Width=%ld, Height=%ld\n", 
-           (LONG)windowTop, (LONG)screenWidth, (LONG)windowHeight);
-    
-    /* Validate dimensions - OpenWindowTags will fail or create invalid window if dimensions are 0 */
-    if (screenWidth <= 0 || windowHeight <= 0) {
-        Printf("Workspace: ERROR - Invalid window dimensions: Width=%ld, Height=%ld\n",
-               (LONG)screenWidth, (LONG)windowHeight);
+    /* Create workspace screen */
+    LOG_TRACE(("Workspace: Creating workspace screen...\n"));
+    if (!CreateWorkspaceScreen()) {
+        LOG_ERROR(("Workspace: ERROR - Failed to create workspace screen\n"));
         return FALSE;
     }
+    if (profile) {
+        ProfilePhase("screen");
+    }
+    LOG_INFO(("Workspace: Workspace screen created successfully\n"));
     
-    /* Open backdrop window - positioned below title bar */
-    /* Don't activate initially - will activate after menu is set */
-    wsState.backdropWindow = OpenWindowTags(NULL,
-        WA_Left, 0,
-        WA_Top, windowTop,
-        WA_Width, screenWidth,
-        WA_Height, windowHeight,
-        WA_CustomScreen, wsState.workspaceScreen,
-        WA_Backdrop, TRUE,
-        WA_Borderless, TRUE,
-        WA_DragBar, FALSE,
-        WA_IDCMP, IDCMP_MENUPICK | IDCMP_CLOSEWINDOW,
-        WA_DetailPen, -1,
-        WA_BlockPen, -1,
-        WA_Activate, FALSE,  /* Don't activate yet - will activate after menu is set */
-        WA_NewLookMenus, TRUE,  /* Required for GadTools NewLook menus */
-        TAG_DONE);
+    /* Headless - the public screen is all there is, visitors bring their own windows */
+    if (wsState.headless) {
+        ScreenToFront(desktop->workspaceScreen);
+        SetFrontDesktop(desktop);
+        desktop->hibernated = FALSE;
+        desktop->idleSince = 0;
+        return TRUE;
+    }
     
-    if (wsState.backdropWindow == NULL) {
-        Printf("Workspace: ERROR - Failed to open window (OpenWindowTags returned NULL)\n");
-        return FALSE;
+    /* Apply theme if specified (and not Like Workbench) - after hibernation always, */
+    /* Like Workbench then puts back the palette the desktop first opened with */
+    if (desktop->currentTheme != THEME_LIKE_WORKBENCH || desktop->hibernated) {
+        LOG_TRACE(("Workspace: Applying theme %lu: %s\n", desktop->currentTheme, themeNames[desktop->currentTheme]));
+        if (!ApplyTheme(desktop->currentTheme)) {
+            LOG_WARN(("Workspace: WARNING - Failed to apply theme, continuing with default\n"));
+        }
+        if (profile) {
+            ProfilePhase("theme");
+        }
     }
     
-    Printf("Workspace: Window opened successfully: 0x%lx\n", (ULONG)wsState.backdropWindow);
-    Printf("Workspace: Window actual dimensions: LeftEdge=%ld, TopEdge=%ld, Width=%ld, Height=%ld\n",
-           (LONG)wsState.backdropWindow->LeftEdge, (LONG)wsState.backdropWindow->TopEdge,
-           (LONG)wsState.backdropWindow->Width, (LONG)wsState.backdropWindow->Height);
-    Printf("Workspace: Window Flags: 0x%lx\n", (ULONG)wsState.backdropWindow->Flags);
+    /* Create backdrop window first - menu will be created after window is open */
+    LOG_TRACE(("Workspace: Creating backdrop window...\n"));
+    if (!CreateBackdropWindow()) {
+        LOG_ERROR(("Workspace: ERROR - Failed to create backdrop window\n"));
+        CloseWorkspaceScreen();
+        return FALSE;
+    }
+    if (profile) {
+        ProfilePhase("window");
+    }
+    LOG_INFO(("Workspace: Backdrop window created successfully\n"));
     
-    /* Check if window was created with valid dimensions */
-    if (wsState.backdropWindow->Width == 0 || wsState.backdropWindow->Height == 0) {
-        Printf("Workspace: ERROR - Window created with invalid dimensions (Width=%ld, Height=%ld)\n",
-               (LONG)wsState.backdropWindow->Width, (LONG)wsState.backdropWindow->Height);
-        CloseWindow(wsState.backdropWindow);
-        wsState.backdropWindow = NULL;
+    /* Create and attach menu strip AFTER window is open */
+    LOG_TRACE(("Workspace: Creating menu strip...\n"));
+    if (!CreateMenuStrip()) {
+        LOG_ERROR(("Workspace: ERROR - Failed to create menu strip\n"));
+        CloseBackdropWindow();
+        FreeMenuStrip();
+        CloseWorkspaceScreen();
         return FALSE;
     }
-    {
-        LONG signalBit;
-        if (wsState.backdropWindow && wsState.backdropWindow->UserPort) {
-            signalBit = wsState.backdropWindow->UserPort->mp_SigBit;
-        } else {
-            signalBit = -1;
+    if (profile) {
+        ProfilePhase("menus");
+    }
+    LOG_INFO(("Workspace: Menu strip created and attached successfully\n"));
+    
+    /* Load backdrop image if specified and shell not enabled */
+    if (!desktop->shellEnabled && desktop->backdropPath) {
+        LoadBackdropImage(desktop->backdropPath);
+        if (profile) {
+            ProfilePhase("backdrop");
         }
-        Printf("Workspace: Window UserPort: 0x%lx, Signal bit: %ld\n", 
-               (ULONG)wsState.backdropWindow->UserPort, signalBit);
     }
     
-    /* Window is now open - menu will be created separately after this function returns */
+    /* Create shell console if enabled */
+    if (desktop->shellEnabled) {
+        CreateShellConsole();
+        if (profile) {
+            ProfilePhase("shell");
+        }
+    }
     
+    if (desktop->hibernated) {
+        LOG_INFO(("Workspace: %s woke from hibernation\n", desktop->workspaceName));
+        desktop->hibernated = FALSE;
+    }
+    desktop->idleSince = 0;
+    SetFrontDesktop(desktop);
     return TRUE;
 }
 
-/* Close backdrop window */
-VOID CloseBackdropWindow(VOID)
+/* Close an idle desktop's screen to give its memory back - the desktop stays, its */
+/* name reserved, and MaterializeDesktop reopens it as it was */
+/* Returns FALSE if the screen is in use after all */
+BOOL HibernateDesktop(struct Desktop *desktop)
 {
-    if (wsState.backdropWindow) {
-        /* Clear menu strip before closing window (required by Intuition API) */
-        if (wsState.menuStrip) {
-            ClearMenuStrip(wsState.backdropWindow);
+    struct Desktop *previous = currentDesktop;
+    BOOL closed;
+    
+    /* Private first - fails if a visitor has just opened and keeps new ones out */
+    if ((PubScreenStatus(desktop->workspaceScreen, PSNF_PRIVATE) & 0x0001) == 0) {
+        LOG_TRACE(("Workspace: %s got a visitor, not hibernating\n", desktop->workspaceName));
+        return FALSE;
+    }
+    
+    currentDesktop = desktop;
+    FreeBackdropImage();
+    /* CloseBackdropWindow will call ClearMenuStrip, so do it before FreeMenuStrip */
+    CloseBackdropWindow();
+    FreeMenuStrip();
+    /* Already private - CloseWorkspaceScreen would take the failing PSNF_PRIVATE for visitors */
+    closed = ClosePrivateScreen();
+    if (closed) {
+        desktop->hibernated = TRUE;
+        LOG_INFO(("Workspace: %s hibernated\n", desktop->workspaceName));
+    } else {
+        /* Something still has a window open - public again, with our window back */
+        PubScreenStatus(desktop->workspaceScreen, 0);
+        if (wsState.headless) {
+            /* Nothing to give back */
+        } else if (!CreateBackdropWindow() || !CreateMenuStrip()) {
+            LOG_ERROR(("Workspace: ERROR - Failed to reopen backdrop window on %s\n", desktop->workspaceName));
+        } else if (desktop->backdropPath) {
+            LoadBackdropImage(desktop->backdropPath);
         }
-        /* Close the window using standard Intuition CloseWindow() */
-        CloseWindow(wsState.backdropWindow);
-        wsState.backdropWindow = NULL;
     }
+    currentDesktop = previous;
+    return closed;
 }
 
-/* Menu item handlers */
-VOID HandleAboutMenu(VOID)
+/* Prepare the warm spare - a private screen behind the others, named with the next */
+/* free Workspace.n, with its theme, backdrop window, menus and backdrop image ready */
+BOOL PrepareSpareDesktop(VOID)
 {
-    struct EasyStruct es;
-    STRPTR titleStr = "About Workspace";
-    STRPTR textStr = "Workspace\n\nA public screen manager for AmigaOS\n\nVersion 1.0";
-    STRPTR okStr = "OK";
-    struct Window *reqWindow;
+    struct Desktop *desktop;
+    struct Desktop *previous = currentDesktop;
     
-    es.es_StructSize = sizeof(struct EasyStruct);
-    es.es_Flags = 0;
-    es.es_Title = titleStr;
-    es.es_TextFormat = textStr;
-    es.es_GadgetFormat = okStr;
+    /* Not while exiting, and not one more than could be handed out */
+    if (!wsState.spareEnabled || wsState.spare != NULL || wsState.desktops == NULL ||
+        wsState.desktopCount >= WS_MAX_DESKTOPS) {
+        return FALSE;
+    }
     
-    /* Ensure our screen is in front */
-    if (wsState.workspaceScreen) {
-        ScreenToFront(wsState.workspaceScreen);
+    desktop = NewDesktop(NULL);
+    if (desktop == NULL) {
+        return FALSE;
     }
+    desktop->mode = wsState.defaultMode;
+    desktop->spare = TRUE;
     
-    /* Use backdrop window if available and valid, otherwise try to use screen's first window */
-    reqWindow = wsState.backdropWindow;
-    if (reqWindow == NULL || reqWindow->WScreen != wsState.workspaceScreen) {
-        if (wsState.workspaceScreen && wsState.workspaceScreen->FirstWindow) {
-            reqWindow = wsState.workspaceScreen->FirstWindow;
-        }
+    currentDesktop = desktop;
+    if (!CreateWorkspaceScreen()) {
+        LOG_WARN(("Workspace: WARNING - Failed to open spare screen\n"));
+        currentDesktop = previous;
+        FreeDesktop(desktop);
+        return FALSE;
+    }
+    if (desktop->currentTheme != THEME_LIKE_WORKBENCH) {
+        ApplyTheme(desktop->currentTheme);
     }
+    if (!CreateBackdropWindow() || !CreateMenuStrip()) {
+        LOG_WARN(("Workspace: WARNING - Failed to prepare spare desktop\n"));
+        currentDesktop = previous;
+        FreeSpareDesktop(desktop);
+        return FALSE;
+    }
+    if (desktop->backdropPath) {
+        LoadBackdropImage(desktop->backdropPath);
+    }
+    currentDesktop = previous;
     
-    EasyRequestArgs(reqWindow, &es, NULL, NULL);
+    wsState.spare = desktop;
+    wsState.memExhausted = FALSE;
+    LOG_INFO(("Workspace: Spare desktop %s ready\n", desktop->workspaceName));
+    return TRUE;
 }
 
-/* Structure to hold window information for tiling */
-struct WindowInfo {
-    struct Window *window;
-    WORD minWidth;
-    WORD minHeight;
-    WORD maxWidth;
-    WORD maxHeight;
-    BOOL isResizable;
-    BOOL isShellWindow;
-};
-
-/* Get all visitor windows on the workspace screen */
-/* Returns number of windows found, stores pointers in windows array */
-/* Excludes backdrop window and shell window if specified */
-WORD GetVisitorWindows(struct WindowInfo *windows, WORD maxWindows, BOOL excludeShell)
+/* Hand out the warm spare - register it, make it public and bring it to front */
+/* Returns NULL if it cannot be used, the caller then opens a desktop the slow way */
+struct Desktop *AdoptSpareDesktop(VOID)
 {
-    struct Window *win;
-    WORD count = 0;
-    WORD titleBarHeight;
-    
-    if (!wsState.workspaceScreen || !windows || maxWindows == 0) {
-        return 0;
+    struct Desktop *desktop = wsState.spare;
+    
+    wsState.spare = NULL;
+    desktop->spare = FALSE;
+    PubScreenStatus(desktop->workspaceScreen, 0);
+    if (!RegisterScreen(desktop)) {
+        LOG_WARN(("Workspace: WARNING - Failed to register spare %s\n", desktop->workspaceName));
+        /* Private again for FreeSpareDesktop - fails only if a visitor got in meanwhile */
+        PubScreenStatus(desktop->workspaceScreen, PSNF_PRIVATE);
+        FreeSpareDesktop(desktop);
+        return NULL;
     }
     
-    /* Get title bar height for screen */
-    titleBarHeight = wsState.workspaceScreen->BarHeight + 1;
+    currentDesktop = desktop;
+    ScreenToFront(desktop->workspaceScreen);
+    SetFrontDesktop(desktop);
+    ActivateWindow(desktop->backdropWindow);
+    LOG_INFO(("Workspace: %s opened from the spare\n", desktop->workspaceName));
     
-    /* Iterate through all windows on the screen */
-    win = wsState.workspaceScreen->FirstWindow;
-    Printf("Workspace: GetVisitorWindows - backdropWindow=0x%lx, shellWindow=0x%lx\n",
-           (ULONG)wsState.backdropWindow, (ULONG)wsState.shellWindow);
-    while (win != NULL && count < maxWindows) {
-        Printf("Workspace: GetVisitorWindows - checking window 0x%lx\n", (ULONG)win);
-        
-        /* ALWAYS skip backdrop window - it's our own window, never tile it */
-        if (win == wsState.backdropWindow) {
-            Printf("Workspace: GetVisitorWindows - skipping backdrop window\n");
-            win = win->NextWindow;
-            continue;
-        }
-        
-        /* ALWAYS skip shell window - it's our own window, never tile it */
-        /* Check both by pointer and by checking if it's a backdrop window at the bottom */
-        if (win == wsState.shellWindow) {
-            Printf("Workspace: GetVisitorWindows - skipping shell window (by pointer match)\n");
-            win = win->NextWindow;
-            continue;
-        }
-        
-        /* Also check if this window matches shell window characteristics:
-         * - Backdrop window
-         * - Borderless
-         * - At bottom of screen (TopEdge near screen height - 200)
-         * - Height is approximately 200
-         * This works even if wsState.shellWindow is NULL (after shell ends)
-         */
-        if ((win->Flags & WFLG_BACKDROP) != 0 &&
-            (win->Flags & WFLG_BORDERLESS) != 0 &&
-            win->WScreen == wsState.workspaceScreen) {
-            WORD expectedTop = wsState.workspaceScreen->Height - 200;
-            WORD expectedHeight = 200;
-            /* Check if window is at bottom of screen with ~200px height */
-            /* Use a wider tolerance for TopEdge since it might vary slightly */
-            if (win->TopEdge >= expectedTop - 20 && win->TopEdge <= expectedTop + 20 &&
-                win->Height >= expectedHeight - 20 && win->Height <= expectedHeight + 20) {
-                Printf("Workspace: GetVisitorWindows - skipping shell window (by characteristics: TopEdge=%ld, Height=%ld, expected Top=%ld, Height=%ld)\n",
-                       (LONG)win->TopEdge, (LONG)win->Height, (LONG)expectedTop, (LONG)expectedHeight);
-                win = win->NextWindow;
-                continue;
-            }
-        }
-        
-        /* Store window info */
-        windows[count].window = win;
-        windows[count].isShellWindow = FALSE;  /* We've already excluded shell window above */
-        Printf("Workspace: GetVisitorWindows - including window 0x%lx in tiling list\n", (ULONG)win);
-        
-        /* Check if window is resizable */
-        /* Windows with WFLG_SIZEGADGET or WFLG_DRAGBAR are typically resizable */
-        windows[count].isResizable = ((win->Flags & WFLG_SIZEGADGET) != 0);
-        
-        /* Get window size limits if available */
-        /* For now, use reasonable defaults */
-        windows[count].minWidth = 64;
-        windows[count].minHeight = 32;
-        windows[count].maxWidth = win->WScreen->Width;
-        windows[count].maxHeight = win->WScreen->Height - titleBarHeight;
-        
-        count++;
-        /* Split Printf to avoid potential stack corruption */
-        Printf("Workspace: GetVisitorWindows - count is now %ld\n", (LONG)count);
-        Printf("Workspace: GetVisitorWindows - included window 0x%lx\n", (ULONG)win);
-        win = win->NextWindow;
+    RefillSpareLater();
+    return desktop;
+}
+
+/* Close a spare that was never handed out, or failed to be - its screen is private, */
+/* so it is closed directly. FALSE if it stays open; the record is then not freed. */
+BOOL FreeSpareDesktop(struct Desktop *desktop)
+{
+    struct Desktop *previous = currentDesktop;
+    BOOL closed;
+    
+    currentDesktop = desktop;
+    FreeBackdropImage();
+    /* CloseBackdropWindow will call ClearMenuStrip, so do it before FreeMenuStrip */
+    CloseBackdropWindow();
+    FreeMenuStrip();
+    closed = ClosePrivateScreen();
+    currentDesktop = previous;
+    if (!closed) {
+        LOG_ERROR(("Workspace: ERROR - Failed to close spare %s\n", desktop->workspaceName));
+        return FALSE;
     }
-    
-    Printf("Workspace: GetVisitorWindows - final count before return: %ld\n", (LONG)count);
-    return count;
+    UnregisterScreen(desktop);
+    FreeDesktop(desktop);
+    return TRUE;
 }
 
-/* Tile windows horizontally */
-VOID TileWindowsHorizontally(VOID)
+/* Prepare the next spare from the main loop, after whatever caused the refill */
+VOID RefillSpareLater(VOID)
 {
-    struct WindowInfo windows[32];
-    WORD windowCount;
-    WORD i;
-    WORD screenWidth;
-    WORD screenHeight;
-    WORD titleBarHeight;
-    WORD windowWidth;
-    WORD windowHeight;
-    WORD windowTop;
-    WORD windowLeft;
-    WORD shellHeight = 0;
-    WORD usableHeight;
-    
-    if (!wsState.workspaceScreen) {
-        return;
+    if (TimerBase) {
+        ScheduleTimer(&spareTimer, SPARE_REFILL_DELAY);
+    } else {
+        PrepareSpareDesktop();
     }
-    
-    /* Get screen dimensions */
-    screenWidth = wsState.workspaceScreen->Width;
-    screenHeight = wsState.workspaceScreen->Height;
-    titleBarHeight = wsState.workspaceScreen->BarHeight + 1;
-    
-    /* Account for shell window at bottom if open */
-    if (wsState.shellWindow && wsState.shellEnabled) {
-        shellHeight = 200;  /* Shell window height */
+}
+
+/* Install LowMemoryHandler - needs exec V39, without it nothing is shed */
+BOOL InstallMemHandler(VOID)
+{
+    if (SysBase->LibNode.lib_Version < 39) {
+        LOG_TRACE(("Workspace: No memory handlers before exec V39\n"));
+        return FALSE;
     }
-    
-    usableHeight = screenHeight - titleBarHeight - shellHeight;
-    
-    /* Get all visitor windows (excluding backdrop, excluding shell) */
-    Printf("Workspace: Getting visitor windows...\n");
-    windowCount = GetVisitorWindows(windows, 32, TRUE);
-    Printf("Workspace: GetVisitorWindows returned %ld windows\n", (LONG)windowCount);
-    
-    /* Early return if no windows - check immediately after function call */
-    if (windowCount == 0) {
-        Printf("Workspace: No windows to tile - returning early\n");
-        return;
+    wsState.memSigBit = AllocSignal(-1);
+    if (wsState.memSigBit == -1) {
+        LOG_WARN(("Workspace: WARNING - No signal for low memory handler\n"));
+        return FALSE;
     }
-    
-    /* Double-check windowCount before proceeding */
-    if (windowCount == 0 || windowCount > 32) {
-        Printf("Workspace: ERROR - invalid windowCount=%ld, aborting\n", (LONG)windowCount);
+    wsState.memHandler.is_Node.ln_Type = NT_INTERRUPT;
+    wsState.memHandler.is_Node.ln_Pri = 0;
+    wsState.memHandler.is_Node.ln_Name = "Workspace";
+    wsState.memHandler.is_Data = NULL;
+    wsState.memHandler.is_Code = (VOID (*)())LowMemoryHandler;
+    AddMemHandler(&wsState.memHandler);
+    return TRUE;
+}
+
+/* Remove LowMemoryHandler - nothing can signal memSigBit afterwards */
+VOID RemoveMemHandler(VOID)
+{
+    if (wsState.memSigBit == -1) {
         return;
     }
-    
-    Printf("Workspace: Tiling %ld windows horizontally\n", (LONG)windowCount);
-    
-    /* Calculate window dimensions - prevent division by zero */
-    if (windowCount == 0) {
-        Printf("Workspace: ERROR - windowCount is 0, returning early\n");
-        return;
+    RemMemHandler(&wsState.memHandler);
+    FreeSignal(wsState.memSigBit);
+    wsState.memSigBit = -1;
+}
+
+/* Memory handler - runs on the task whose allocation failed, under Forbid, so it can */
+/* only signal the main task. That allocation still fails; ShedMemory makes room for */
+/* the ones after it. Once there is nothing left to release it stays quiet, or every */
+/* failed allocation in the system would wake the main task for nothing. */
+__saveds __asm LONG LowMemoryHandler(register __a0 struct MemHandlerData *data, register __a1 APTR isData)
+{
+    if (!wsState.memExhausted) {
+        Signal(wsState.mainTask, 1L << wsState.memSigBit);
     }
-    
-    windowWidth = screenWidth / windowCount;
-    if (windowWidth == 0) {
-        Printf("Workspace: ERROR - calculated windowWidth is 0, returning early\n");
+    return MEM_DID_NOTHING;
+}
+
+/* Release one level of resources each time the system runs low, in the order they are */
+/* cheapest to do without: rendered backdrops, captured palettes, menu strips, the spare */
+VOID ShedMemory(VOID)
+{
+    if (ShedBackdrops() || ShedPalettes() || ShedMenus()) {
         return;
     }
-    windowHeight = usableHeight;
-    windowTop = titleBarHeight;
-    
-    Printf("Workspace: Calculated windowWidth=%ld, windowHeight=%ld, windowTop=%ld\n", 
-           (LONG)windowWidth, (LONG)windowHeight, (LONG)windowTop);
-    
-    /* Tile windows */
-    Printf("Workspace: Starting tile loop for %ld windows\n", (LONG)windowCount);
-    
-    /* Safety check - should never happen if early return worked */
-    if (windowCount == 0 || windowCount > 32) {
-        Printf("Workspace: ERROR - invalid windowCount=%ld, aborting tile operation\n", (LONG)windowCount);
+    if (wsState.spare) {
+        LOG_INFO(("Workspace: Low memory - closing spare %s\n", wsState.spare->workspaceName));
+        CancelTimer(&spareTimer);
+        FreeSpareDesktop(wsState.spare);
+        wsState.spare = NULL;
         return;
     }
+    LOG_TRACE(("Workspace: Low memory - nothing left to release\n"));
+    wsState.memExhausted = TRUE;
+}
+
+/* Drop the backdrop images - damage is repaired with the window's solid fill until */
+/* the desktop is shown or activated again */
+BOOL ShedBackdrops(VOID)
+{
+    struct Desktop *previous = currentDesktop;
+    struct Desktop *desktop;
+    BOOL shed = FALSE;
     
-    for (i = 0; i < windowCount; i++) {
-        /* Safety check - ensure window pointer is valid */
-        if (windows[i].window == NULL) {
-            Printf("Workspace: ERROR - window[%ld] is NULL, skipping\n", (LONG)i);
-            continue;
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (desktop->backdropImageObj) {
+            currentDesktop = desktop;
+            FreeBackdropImage();
+            desktop->backdropShed = TRUE;
+            shed = TRUE;
         }
-        
-        {
-            char *resizableStr;
-            if (windows[i].isResizable) {
-                resizableStr = "YES";
-            } else {
-                resizableStr = "NO";
-            }
-            Printf("Workspace: Tiling window %ld of %ld (window=0x%lx, resizable=%s)\n", 
-                   (LONG)(i + 1), (LONG)windowCount, (ULONG)windows[i].window, resizableStr);
+    }
+    currentDesktop = previous;
+    if (shed) {
+        LOG_INFO(("Workspace: Low memory - backdrop images released\n"));
+    }
+    return shed;
+}
+
+/* Drop the palettes of desktops showing Like Workbench - the screen itself still has */
+/* the colors, ApplyTheme captures them again. Themed desktops need theirs to switch back. */
+BOOL ShedPalettes(VOID)
+{
+    struct Desktop *desktop;
+    struct MemProbe probe;
+    BOOL shed = FALSE;
+    
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (desktop->originalRGB && desktop->currentTheme == THEME_LIKE_WORKBENCH) {
+            MemProbeBegin(&probe);
+            MemCharge(MEMACCT_DESKTOP, MEMF_ANY, -(LONG)(desktop->numColors * 3));
+            FreeVec(desktop->originalRGB);
+            MemProbeEnd(&probe, MEMACCT_DESKTOP);
+            desktop->originalRGB = NULL;
+            desktop->numColors = 0;
+            shed = TRUE;
         }
-        windowLeft = i * windowWidth;
-        
-        /* For resizable windows, resize them */
-        if (windows[i].isResizable) {
-            Printf("Workspace: Calling ChangeWindowBox for window %ld: left=%ld, top=%ld, width=%ld, height=%ld\n",
-                   (LONG)i, (LONG)windowLeft, (LONG)windowTop, (LONG)windowWidth, (LONG)windowHeight);
-            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
-        } else {
-            /* For fixed-size windows, just move them */
-            Printf("Workspace: Calling MoveWindow for window %ld: deltaX=%ld, deltaY=%ld\n",
-                   (LONG)i, 
-                   (LONG)(windowLeft - windows[i].window->LeftEdge),
-                   (LONG)(windowTop - windows[i].window->TopEdge));
-            MoveWindow(windows[i].window, windowLeft - windows[i].window->LeftEdge, 
-                      windowTop - windows[i].window->TopEdge);
+    }
+    if (shed) {
+        LOG_INFO(("Workspace: Low memory - captured palettes released\n"));
+    }
+    return shed;
+}
+
+/* Drop the menu strips of desktops whose window is not active - AttachMenuStrip */
+/* builds them again on IDCMP_ACTIVEWINDOW. Shell desktops keep theirs (the shell item */
+/* is disabled on it). */
+BOOL ShedMenus(VOID)
+{
+    struct Desktop *previous = currentDesktop;
+    struct Desktop *desktop;
+    BOOL shed = FALSE;
+    
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (desktop->menuStrip && !desktop->shellEnabled &&
+            (desktop->backdropWindow->Flags & WFLG_WINDOWACTIVE) == 0) {
+            currentDesktop = desktop;
+            ClearMenuStrip(desktop->backdropWindow);
+            FreeMenuStrip();
+            desktop->menusShed = TRUE;
+            shed = TRUE;
         }
-        Printf("Workspace: Finished tiling window %ld\n", (LONG)i);
     }
-    Printf("Workspace: Finished tiling all %ld windows\n", (LONG)windowCount);
+    currentDesktop = previous;
+    if (shed) {
+        LOG_INFO(("Workspace: Low memory - menu strips released\n"));
+    }
+    return shed;
 }
 
-/* Tile windows vertically */
-VOID TileWindowsVertically(VOID)
+/* Rebuild what ShedMemory dropped from the current desktop, now that it is in use. */
+/* Runs on IDCMP_ACTIVEWINDOW too, so it must not activate windows or reorder screens. */
+/* The backdrop gets one attempt - a failed reload is not retried on every activation. */
+/* What it rebuilds clears memExhausted, so the next shortage can shed it again. */
+VOID RestoreShedResources(VOID)
 {
-    struct WindowInfo windows[32];
-    WORD windowCount;
-    WORD i;
-    WORD screenWidth;
-    WORD screenHeight;
-    WORD titleBarHeight;
-    WORD windowWidth;
-    WORD windowHeight;
-    WORD windowTop;
-    WORD windowLeft;
-    WORD shellHeight = 0;
-    WORD usableHeight;
-    
-    if (!wsState.workspaceScreen) {
+    if (currentDesktop->backdropWindow == NULL) {
         return;
     }
-    
-    /* Get screen dimensions */
-    screenWidth = wsState.workspaceScreen->Width;
-    screenHeight = wsState.workspaceScreen->Height;
-    titleBarHeight = wsState.workspaceScreen->BarHeight + 1;
-    
-    /* Account for shell window at bottom if open */
-    if (wsState.shellWindow && wsState.shellEnabled) {
-        shellHeight = 200;  /* Shell window height */
+    if (currentDesktop->menusShed) {
+        AttachMenuStrip();
+    }
+    if (currentDesktop->backdropShed) {
+        if (currentDesktop->backdropPath && !currentDesktop->shellEnabled) {
+            LoadBackdropImage(currentDesktop->backdropPath);
+        }
+        currentDesktop->backdropShed = FALSE;
     }
+}
+
+/* Find one of our desktops by screen name */
+struct Desktop *FindDesktop(STRPTR name)
+{
+    struct Desktop *desktop;
     
-    usableHeight = screenHeight - titleBarHeight - shellHeight;
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (strcmp((char *)desktop->workspaceName, (char *)name) == 0) {
+            return desktop;
+        }
+    }
+    return NULL;
+}
+
+/* Bring the current desktop to front, opening its screen if it has none yet */
+BOOL ShowDesktop(VOID)
+{
+    if (currentDesktop == NULL) {
+        return FALSE;
+    }
+    if (currentDesktop->workspaceScreen == NULL) {
+        /* MaterializeDesktop brings the new screen to front */
+        return MaterializeDesktop(currentDesktop, FALSE);
+    }
+    ScreenToFront(currentDesktop->workspaceScreen);
+    SetFrontDesktop(currentDesktop);
+    RestoreShedResources();
+    return TRUE;
+}
+
+/* Close a desktop and free it - FALSE if windows other than ours keep it open */
+/* Sets currentDesktop to the first remaining desktop (NULL after the last) */
+BOOL CloseDesktop(struct Desktop *desktop)
+{
+    struct Desktop **link;
+    WORD visitorCount;
+    ULONG i;
     
-    /* Get all visitor windows (excluding backdrop, excluding shell) */
-    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    currentDesktop = desktop;
     
-    if (windowCount == 0) {
-        Printf("Workspace: No windows to tile\n");
-        return;
+    /* A shell whose process was never found cannot be unhooked - ShellExitCode writes */
+    /* to this desktop and runs our code when it ends, so the desktop (and Workspace) */
+    /* stays until it has */
+    if (desktop->shellEnabled && desktop->shellProcess == NULL && !desktop->shellExited) {
+        LOG_WARN(("Workspace: WARNING - %s waits for its shell to end\n", desktop->workspaceName));
+        ShowShellRequester();
+        return FALSE;
     }
     
-    Printf("Workspace: Tiling %ld windows vertically\n", (LONG)windowCount);
+    visitorCount = CheckWorkspaceVisitors();
+    LOG_TRACE(("Workspace: %s visitor count: %ld\n", desktop->workspaceName, (LONG)visitorCount));
+    if (visitorCount > 0) {
+        ShowVisitorRequester(visitorCount);
+        return FALSE;
+    }
     
-    /* Calculate window dimensions - prevent division by zero */
-    if (windowCount == 0) {
-        Printf("Workspace: ERROR - windowCount is 0, returning early\n");
-        return;
+    /* Cleanup - order is important */
+    CloseRequester();
+    if (desktop->shellEnabled) {
+        CloseShellConsole();
+    }
+    FreeBackdropImage();
+    /* CloseBackdropWindow will call ClearMenuStrip, so do it before FreeMenuStrip */
+    CloseBackdropWindow();
+    FreeMenuStrip();
+    if (!CloseWorkspaceScreen()) {
+        /* A visitor appeared after the check - CloseWorkspaceScreen told the user, */
+        /* give the desktop its window back */
+        LOG_ERROR(("Workspace: ERROR - CloseWorkspaceScreen failed for %s\n", desktop->workspaceName));
+        if (!wsState.headless && (!CreateBackdropWindow() || !CreateMenuStrip())) {
+            LOG_ERROR(("Workspace: ERROR - Failed to reopen backdrop window on %s\n", desktop->workspaceName));
+        }
+        return FALSE;
     }
+    UnregisterScreen(desktop);
     
-    windowWidth = screenWidth;
-    windowHeight = usableHeight / windowCount;
-    if (windowHeight == 0) {
-        Printf("Workspace: ERROR - calculated windowHeight is 0, returning early\n");
-        return;
+    /* Exclusive, so the commodity task never sees a freed currentDesktop */
+    ObtainSemaphore(&wsState.screenSemaphore);
+    for (link = &wsState.desktops; *link != desktop; link = &(*link)->next) {
     }
-    windowLeft = 0;
+    *link = desktop->next;
+    wsState.desktopCount--;
+    for (i = desktop->ringIndex; i < wsState.desktopCount; i++) {
+        wsState.ring[i] = wsState.ring[i + 1];
+        wsState.ring[i]->ringIndex = i;
+    }
+    wsState.ring[wsState.desktopCount] = NULL;
+    currentDesktop = wsState.desktops;
+    if (wsState.frontDesktop == desktop) {
+        wsState.frontDesktop = wsState.desktops;
+    }
+    ReleaseSemaphore(&wsState.screenSemaphore);
     
-    /* Tile windows */
-    for (i = 0; i < windowCount; i++) {
-        windowTop = titleBarHeight + (i * windowHeight);
-        
-        /* For resizable windows, resize them */
-        if (windows[i].isResizable) {
-            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
-        } else {
-            /* For fixed-size windows, just move them */
-            MoveWindow(windows[i].window, windowLeft - windows[i].window->LeftEdge, 
-                      windowTop - windows[i].window->TopEdge);
+    LOG_INFO(("Workspace: Desktop %s closed\n", desktop->screenName));
+    FreeDesktop(desktop);
+    return TRUE;
+}
+
+/* Ask every desktop to close (CTRL-C, Exchange Kill) */
+VOID RequestCloseAllDesktops(VOID)
+{
+    struct Desktop *desktop;
+    
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        desktop->closeRequested = TRUE;
+    }
+}
+
+/* Close desktops with closeRequested set - each one still checks its visitors */
+VOID CloseRequestedDesktops(VOID)
+{
+    struct Desktop *desktop;
+    struct Desktop *next;
+    
+    for (desktop = wsState.desktops; desktop != NULL; desktop = next) {
+        next = desktop->next;
+        if (desktop->closeRequested) {
+            desktop->closeRequested = FALSE;
+            CloseDesktop(desktop);
         }
     }
 }
 
-/* Tile windows in a grid layout */
-VOID TileWindowsGrid(VOID)
+/* Become the manager by adding the public launch port */
+/* Returns FALSE if another Workspace already has it */
+BOOL CreateLaunchPort(VOID)
 {
-    struct WindowInfo windows[32];
-    WORD windowCount;
-    WORD i;
-    WORD screenWidth;
-    WORD screenHeight;
-    WORD titleBarHeight;
-    WORD windowWidth;
-    WORD windowHeight;
-    WORD windowTop;
-    WORD windowLeft;
-    WORD shellHeight = 0;
-    WORD usableHeight;
-    WORD cols;
-    WORD rows;
-    WORD col;
-    WORD row;
+    struct MsgPort *port;
     
-    if (!wsState.workspaceScreen) {
-        return;
+    port = CreateMsgPort();
+    if (port == NULL) {
+        /* Still run, later runs just cannot reach us */
+        LOG_WARN(("Workspace: WARNING - Failed to create launch port\n"));
+        return TRUE;
     }
+    port->mp_Node.ln_Name = LAUNCH_PORT_NAME;
+    port->mp_Node.ln_Pri = 0;
     
-    /* Get screen dimensions */
-    screenWidth = wsState.workspaceScreen->Width;
-    screenHeight = wsState.workspaceScreen->Height;
-    titleBarHeight = wsState.workspaceScreen->BarHeight + 1;
-    
-    /* Account for shell window at bottom if open */
-    if (wsState.shellWindow && wsState.shellEnabled) {
-        shellHeight = 200;  /* Shell window height */
+    /* Look and add under one Forbid so two starts cannot both become the manager */
+    Forbid();
+    if (FindPort(LAUNCH_PORT_NAME) != NULL) {
+        Permit();
+        DeleteMsgPort(port);
+        return FALSE;
     }
+    AddPort(port);
+    Permit();
     
-    usableHeight = screenHeight - titleBarHeight - shellHeight;
-    
-    /* Get all visitor windows (excluding backdrop, excluding shell) */
-    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    wsState.launchPort = port;
+    return TRUE;
+}
+
+/* Remove the launch port - runs that are still waiting get lm_Opened 0 */
+VOID CloseLaunchPort(VOID)
+{
+    struct LaunchMessage *launch;
     
-    if (windowCount == 0) {
-        Printf("Workspace: No windows to tile\n");
+    if (wsState.launchPort == NULL) {
         return;
     }
+    RemPort(wsState.launchPort);
+    while ((launch = (struct LaunchMessage *)GetMsg(wsState.launchPort)) != NULL) {
+        launch->lm_Opened = 0;
+        ReplyMsg((struct Message *)launch);
+    }
+    DeleteMsgPort(wsState.launchPort);
+    wsState.launchPort = NULL;
+}
+
+/* Hand COUNT, PUBNAME, the screen mode, THEME and BACKDROP to the running manager and */
+/* wait until it has opened the desktops. Returns TRUE if at least one was opened. */
+BOOL SendLaunchMessage(VOID)
+{
+    struct MsgPort *replyPort;
+    struct MsgPort *managerPort;
+    struct LaunchMessage launch;
     
-    Printf("Workspace: Tiling %ld windows in grid\n", (LONG)windowCount);
+    replyPort = CreateMsgPort();
+    if (replyPort == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Failed to create reply port\n"));
+        return FALSE;
+    }
     
-    /* Calculate grid dimensions (aim for roughly square grid) */
-    cols = (WORD)((windowCount + 1) / 2);  /* Roughly square */
-    if (cols == 0) cols = 1;
-    rows = (windowCount + cols - 1) / cols;  /* Ceiling division */
-    if (rows == 0) rows = 1;
+    memset(&launch, 0, sizeof(struct LaunchMessage));
+    launch.lm_Message.mn_Node.ln_Type = NT_MESSAGE;
+    launch.lm_Message.mn_ReplyPort = replyPort;
+    launch.lm_Message.mn_Length = sizeof(struct LaunchMessage);
+    launch.lm_Count = wsState.launchCount;
+    launch.lm_Mode = wsState.defaultMode;
+    if (wsState.pubName) {
+        SNPrintf(launch.lm_PubName, sizeof(launch.lm_PubName), "%s", wsState.pubName);
+    }
+    if (wsState.themeName) {
+        launch.lm_Theme = wsState.defaultTheme;
+    } else {
+        launch.lm_Theme = LAUNCH_THEME_DEFAULT;
+    }
+    if (wsState.backdropImagePath) {
+        if (strlen((char *)wsState.backdropImagePath) >= sizeof(launch.lm_Backdrop)) {
+            LOG_WARN(("Workspace: WARNING - BACKDROP path too long to hand over, ignored\n"));
+        } else {
+            strcpy((char *)launch.lm_Backdrop, (char *)wsState.backdropImagePath);
+        }
+    }
+    WarnManagerOnlyArgs();
     
-    windowWidth = screenWidth / cols;
-    windowHeight = usableHeight / rows;
+    /* The manager may be exiting - it removes its port under Forbid */
+    Forbid();
+    managerPort = FindPort(LAUNCH_PORT_NAME);
+    if (managerPort) {
+        PutMsg(managerPort, (struct Message *)&launch);
+    }
+    Permit();
     
-    /* Validate calculated dimensions */
-    if (windowWidth == 0 || windowHeight == 0) {
-        Printf("Workspace: ERROR - Invalid grid dimensions (windowWidth=%ld, windowHeight=%ld, cols=%ld, rows=%ld)\n",
-               (LONG)windowWidth, (LONG)windowHeight, (LONG)cols, (LONG)rows);
-        return;
+    if (managerPort == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Running Workspace has exited\n"));
+        DeleteMsgPort(replyPort);
+        return FALSE;
     }
+    WaitPort(replyPort);
+    GetMsg(replyPort);
+    DeleteMsgPort(replyPort);
     
-    Printf("Workspace: Grid layout - cols=%ld, rows=%ld, windowWidth=%ld, windowHeight=%ld\n",
-           (LONG)cols, (LONG)rows, (LONG)windowWidth, (LONG)windowHeight);
+    LOG_INFO(("Workspace: Running Workspace opened %lu of %lu desktops\n", launch.lm_Opened, launch.lm_Count));
+    if (launch.lm_Opened == 0) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Say which of our arguments the running manager keeps its own settings for */
+VOID WarnManagerOnlyArgs(VOID)
+{
+    STRPTR ignored[13];
+    ULONG count = 0;
+    ULONG i;
     
-    /* Tile windows in grid */
-    for (i = 0; i < windowCount; i++) {
-        /* Safety check */
-        if (windows[i].window == NULL) {
-            Printf("Workspace: ERROR - window[%ld] is NULL, skipping\n", (LONG)i);
-            continue;
-        }
-        
-        row = i / cols;
-        col = i % cols;
-        
-        windowLeft = col * windowWidth;
-        windowTop = titleBarHeight + (row * windowHeight);
-        
-        Printf("Workspace: Tiling window %ld of %ld (row=%ld, col=%ld, left=%ld, top=%ld, width=%ld, height=%ld)\n",
-               (LONG)(i + 1), (LONG)windowCount, (LONG)row, (LONG)col, 
-               (LONG)windowLeft, (LONG)windowTop, (LONG)windowWidth, (LONG)windowHeight);
-        
-        /* Validate window pointer and dimensions before operations */
-        if (windows[i].window == NULL) {
-            Printf("Workspace: ERROR - window[%ld] is NULL, skipping\n", (LONG)i);
-            continue;
-        }
+    if (wsState.cxName) {
+        ignored[count++] = "CX_NAME";
+    }
+    if (wsState.cxPopKey) {
+        ignored[count++] = "CX_POPKEY";
+    }
+    if (wsState.cxNextKey) {
+        ignored[count++] = "CX_NEXTKEY";
+    }
+    if (wsState.cxPrevKey) {
+        ignored[count++] = "CX_PREVKEY";
+    }
+    if (wsState.cxGotoKey) {
+        ignored[count++] = "CX_GOTOKEY";
+    }
+    if (wsState.cxQuitKey) {
+        ignored[count++] = "CX_QUITKEY";
+    }
+    if (wsState.cxTaskEnabled) {
+        ignored[count++] = "CX_TASK";
+    }
+    if (wsState.lazyDesktops) {
+        ignored[count++] = "LAZY";
+    }
+    if (wsState.hibernateSeconds != 0) {
+        ignored[count++] = "HIBERNATE";
+    }
+    if (wsState.spareEnabled) {
+        ignored[count++] = "SPARE";
+    }
+    if (wsState.chipBudget != 0) {
+        ignored[count++] = "CHIPBUDGET";
+    }
+    if (wsState.headless) {
+        ignored[count++] = "HEADLESS";
+    }
+    if (startupProfile.enabled) {
+        ignored[count++] = "PROFILE";
+    }
+    for (i = 0; i < count; i++) {
+        LOG_WARN(("Workspace: WARNING - %s only applies when starting Workspace, ignored\n", ignored[i]));
+    }
+}
+
+/* Open a desktop for a launch request. With the manager's own THEME and BACKDROP, */
+/* OpenDesktop does it all and may hand out the spare; otherwise the desktop is */
+/* reserved, given the requested look, then opened. */
+struct Desktop *OpenLaunchDesktop(STRPTR pubName, struct LaunchMessage *launch, BOOL materialize)
+{
+    struct Desktop *desktop;
+    
+    if ((launch->lm_Theme == LAUNCH_THEME_DEFAULT || launch->lm_Theme == wsState.defaultTheme) &&
+        launch->lm_Backdrop[0] == '\0') {
+        return OpenDesktop(pubName, &launch->lm_Mode, materialize);
+    }
+    desktop = OpenDesktop(pubName, &launch->lm_Mode, FALSE);
+    if (desktop == NULL) {
+        return NULL;
+    }
+    if (launch->lm_Theme != LAUNCH_THEME_DEFAULT && launch->lm_Theme < THEME_COUNT) {
+        desktop->currentTheme = launch->lm_Theme;
+    }
+    if (launch->lm_Backdrop[0] != '\0') {
+        SetDesktopBackdrop(desktop, launch->lm_Backdrop);
+    }
+    if (materialize && !MaterializeDesktop(desktop, FALSE)) {
+        /* Stays reserved like a LAZY one - the screen opens when first needed */
+        return NULL;
+    }
+    return desktop;
+}
+
+/* Open the desktops later runs of Workspace asked for */
+VOID HandleLaunchMessages(VOID)
+{
+    struct LaunchMessage *launch;
+    
+    while ((launch = (struct LaunchMessage *)GetMsg(wsState.launchPort)) != NULL) {
+        STRPTR pubName = NULL;
+        ULONG i;
         
-        /* Validate dimensions are positive */
-        if (windowWidth <= 0 || windowHeight <= 0) {
-            Printf("Workspace: ERROR - Invalid dimensions for window[%ld] (width=%ld, height=%ld), skipping\n",
-                   (LONG)i, (LONG)windowWidth, (LONG)windowHeight);
-            continue;
+        if (launch->lm_PubName[0] != '\0') {
+            pubName = launch->lm_PubName;
         }
-        
-        /* Validate window is on our screen */
-        if (windows[i].window->WScreen != wsState.workspaceScreen) {
-            Printf("Workspace: ERROR - window[%ld] is not on workspace screen, skipping\n", (LONG)i);
-            continue;
+        launch->lm_Opened = 0;
+        i = 0;
+        if (pubName && FindDesktop(pubName) != NULL) {
+            struct Desktop *reserved = FindDesktop(pubName);
+            
+            /* A desktop we reserved earlier - this is its first use, with the look asked for */
+            if (reserved->workspaceScreen == NULL) {
+                if (launch->lm_Theme != LAUNCH_THEME_DEFAULT && launch->lm_Theme < THEME_COUNT) {
+                    reserved->currentTheme = launch->lm_Theme;
+                }
+                if (launch->lm_Backdrop[0] != '\0') {
+                    SetDesktopBackdrop(reserved, launch->lm_Backdrop);
+                }
+            }
+            if (MaterializeDesktop(reserved, FALSE)) {
+                launch->lm_Opened++;
+            }
+            i++;
+            pubName = NULL;
         }
-        
-        /* For resizable windows, resize them */
-        if (windows[i].isResizable) {
-            Printf("Workspace: Calling ChangeWindowBox for window %ld\n", (LONG)i);
-            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
-            Printf("Workspace: ChangeWindowBox completed for window %ld\n", (LONG)i);
-        } else {
-            /* For fixed-size windows, just move them */
-            /* Calculate delta values */
-            {
-                WORD deltaX = windowLeft - windows[i].window->LeftEdge;
-                WORD deltaY = windowTop - windows[i].window->TopEdge;
-                Printf("Workspace: Calling MoveWindow for window %ld (deltaX=%ld, deltaY=%ld)\n", 
-                       (LONG)i, (LONG)deltaX, (LONG)deltaY);
-                MoveWindow(windows[i].window, deltaX, deltaY);
-                Printf("Workspace: MoveWindow completed for window %ld\n", (LONG)i);
+        for (; i < launch->lm_Count; i++) {
+            /* Whoever asked wants to see at least the first one */
+            if (OpenLaunchDesktop(pubName, launch, (BOOL)(launch->lm_Opened == 0 || !wsState.lazyDesktops)) == NULL) {
+                break;
             }
+            launch->lm_Opened++;
+            pubName = NULL;
         }
+        LOG_INFO(("Workspace: Launch request - opened %lu of %lu desktops\n", launch->lm_Opened, launch->lm_Count));
+        ReplyMsg((struct Message *)launch);
     }
-    
-    Printf("Workspace: Finished tiling all %ld windows in grid\n", (LONG)windowCount);
 }
 
-/* Cascade windows */
-VOID CascadeWindows(VOID)
+/* Find the shared screen registry, or create it if we are the first Workspace */
+BOOL OpenRegistry(VOID)
 {
-    struct WindowInfo windows[32];
-    WORD windowCount;
-    WORD i;
-    WORD screenWidth;
-    WORD screenHeight;
-    WORD titleBarHeight;
-    WORD windowTop;
-    WORD windowLeft;
-    WORD shellHeight = 0;
-    WORD usableHeight;
-    WORD cascadeOffset = 30;  /* Offset for cascade effect */
+    struct WorkspaceRegistry *newRegistry;
     
-    if (!wsState.workspaceScreen) {
-        return;
+    /* Public memory - other processes use it and the last one out frees it */
+    newRegistry = AllocVec(sizeof(struct WorkspaceRegistry), MEMF_PUBLIC | MEMF_CLEAR);
+    if (newRegistry == NULL) {
+        return FALSE;
     }
     
-    /* Get screen dimensions */
-    screenWidth = wsState.workspaceScreen->Width;
-    screenHeight = wsState.workspaceScreen->Height;
-    titleBarHeight = wsState.workspaceScreen->BarHeight + 1;
-    
-    /* Account for shell window at bottom if open */
-    if (wsState.shellWindow && wsState.shellEnabled) {
-        shellHeight = 200;  /* Shell window height */
+    Forbid();
+    registry = (struct WorkspaceRegistry *)FindSemaphore(REGISTRY_NAME);
+    if (registry == NULL) {
+        strcpy((char *)newRegistry->name, REGISTRY_NAME);
+        newRegistry->semaphore.ss_Link.ln_Name = newRegistry->name;
+        newRegistry->semaphore.ss_Link.ln_Pri = 0;
+        NewList((struct List *)&newRegistry->screens);
+        AddSemaphore(&newRegistry->semaphore);
+        registry = newRegistry;
+        newRegistry = NULL;
     }
+    Permit();
     
-    usableHeight = screenHeight - titleBarHeight - shellHeight;
-    
-    /* Get all visitor windows (excluding backdrop, excluding shell) */
-    windowCount = GetVisitorWindows(windows, 32, TRUE);
-    
-    if (windowCount == 0) {
-        Printf("Workspace: No windows to cascade\n");
+    if (newRegistry) {
+        FreeVec(newRegistry);
+    }
+    return TRUE;
+}
+
+/* Leave the registry - free it if no Workspace screens are left in it */
+VOID CloseRegistry(VOID)
+{
+    if (registry == NULL) {
         return;
     }
     
-    Printf("Workspace: Cascading %ld windows\n", (LONG)windowCount);
-    
-    /* Cascade windows with offset */
-    for (i = 0; i < windowCount; i++) {
-        windowLeft = i * cascadeOffset;
-        windowTop = titleBarHeight + (i * cascadeOffset);
-        
-        /* Make sure windows don't go off screen */
-        if (windowLeft + windows[i].window->Width > screenWidth) {
-            windowLeft = screenWidth - windows[i].window->Width;
-        }
-        if (windowTop + windows[i].window->Height > screenHeight - shellHeight) {
-            windowTop = screenHeight - shellHeight - windows[i].window->Height;
-        }
-        
-        /* Move window to cascade position */
-        MoveWindow(windows[i].window, windowLeft - windows[i].window->LeftEdge, 
-                  windowTop - windows[i].window->TopEdge);
+    /* Forbid so nobody finds the semaphore between the check and RemSemaphore */
+    Forbid();
+    ObtainSemaphore(&registry->semaphore);
+    if (registry->screenCount == 0) {
+        RemSemaphore(&registry->semaphore);
+        ReleaseSemaphore(&registry->semaphore);
+        FreeVec(registry);
+    } else {
+        ReleaseSemaphore(&registry->semaphore);
     }
+    Permit();
+    registry = NULL;
 }
 
-/* Maximize all windows */
-VOID MaximizeAllWindows(VOID)
+/* Reserve the desktop's name in the registry, then record its public screen once open */
+/* Called again by CreateWorkspaceScreen for a reserved desktop to attach the screen */
+BOOL RegisterScreen(struct Desktop *desktop)
 {
-    struct WindowInfo windows[32];
-    WORD windowCount;
-    WORD i;
-    WORD screenWidth;
-    WORD screenHeight;
-    WORD titleBarHeight;
-    WORD windowTop;
-    WORD windowLeft;
-    WORD windowWidth;
-    WORD windowHeight;
-    WORD shellHeight = 0;
-    WORD usableHeight;
-    
-    if (!wsState.workspaceScreen) {
-        return;
+    struct RegistryEntry *entry = desktop->registryEntry;
+    struct List *pubScreenList;
+    struct PubScreenNode *psn;
+    struct PubScreenNode *pubNode = NULL;
+    
+    if (entry == NULL) {
+        entry = AllocVec(sizeof(struct RegistryEntry), MEMF_PUBLIC | MEMF_CLEAR);
+        if (entry == NULL) {
+            return FALSE;
+        }
+        entry->owner = wsState.mainTask;
+        SNPrintf(entry->name, sizeof(entry->name), "%s", desktop->workspaceName);
+        
+        ObtainSemaphore(&registry->semaphore);
+        AddTail((struct List *)&registry->screens, (struct Node *)&entry->node);
+        registry->screenCount++;
+        RegistryChanged();
+        ReleaseSemaphore(&registry->semaphore);
+        
+        desktop->registryEntry = entry;
     }
-    
-    /* Get screen dimensions */
-    screenWidth = wsState.workspaceScreen->Width;
-    screenHeight = wsState.workspaceScreen->Height;
-    titleBarHeight = wsState.workspaceScreen->BarHeight + 1;
-    
-    /* Account for shell window at bottom if open */
-    if (wsState.shellWindow && wsState.shellEnabled) {
-        shellHeight = 200;  /* Shell window height */
+    if (desktop->workspaceScreen == NULL) {
+        return TRUE;
     }
     
-    usableHeight = screenHeight - titleBarHeight - shellHeight;
+    /* The screen does not point to its PubScreenNode - look it up once here */
+    pubScreenList = LockPubScreenList();
+    if (pubScreenList) {
+        for (psn = (struct PubScreenNode *)pubScreenList->lh_Head;
+             psn->psn_Node.ln_Succ != NULL;
+             psn = (struct PubScreenNode *)psn->psn_Node.ln_Succ) {
+            if (psn->psn_Screen == desktop->workspaceScreen) {
+                pubNode = psn;
+                break;
+            }
+        }
+        UnlockPubScreenList();
+    }
+    if (pubNode == NULL) {
+        LOG_WARN(("Workspace: WARNING - %s not found in public screen list\n", entry->name));
+    }
     
-    /* Get all visitor windows (excluding backdrop, excluding shell) */
-    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    ObtainSemaphore(&registry->semaphore);
+    entry->screen = desktop->workspaceScreen;
+    entry->pubNode = pubNode;
+    ReleaseSemaphore(&registry->semaphore);
+    return TRUE;
+}
+
+/* Release the desktop's name - once its screen is closed */
+VOID UnregisterScreen(struct Desktop *desktop)
+{
+    struct RegistryEntry *entry = desktop->registryEntry;
     
-    if (windowCount == 0) {
-        Printf("Workspace: No windows to maximize\n");
+    if (entry == NULL) {
         return;
     }
+    ObtainSemaphore(&registry->semaphore);
+    Remove((struct Node *)&entry->node);
+    registry->screenCount--;
+    RegistryChanged();
+    ReleaseSemaphore(&registry->semaphore);
     
-    Printf("Workspace: Maximizing %ld windows\n", (LONG)windowCount);
-    
-    windowLeft = 0;
-    windowTop = titleBarHeight;
-    windowWidth = screenWidth;
-    windowHeight = usableHeight;
+    FreeVec(entry);
+    desktop->registryEntry = NULL;
+}
+
+/* Count a change to the list of Workspace screens and wake the other runs of Workspace */
+/* so they rebuild their Default PubScreen submenus - caller holds the registry semaphore */
+VOID RegistryChanged(VOID)
+{
+    struct RegistryEntry *entry;
+    
+    registry->changeCount++;
+    for (entry = (struct RegistryEntry *)registry->screens.mlh_Head;
+         entry->node.mln_Succ != NULL;
+         entry = (struct RegistryEntry *)entry->node.mln_Succ) {
+        if (entry->owner != wsState.mainTask) {
+            Signal(entry->owner, SIGBREAKF_CTRL_E);
+        }
+    }
+}
+
+/* Find a Workspace screen by name - caller holds the registry semaphore */
+struct RegistryEntry *RegistryFind(STRPTR name)
+{
+    struct RegistryEntry *entry;
     
-    /* Maximize all resizable windows */
-    for (i = 0; i < windowCount; i++) {
-        if (windows[i].isResizable) {
-            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
+    for (entry = (struct RegistryEntry *)registry->screens.mlh_Head;
+         entry->node.mln_Succ != NULL;
+         entry = (struct RegistryEntry *)entry->node.mln_Succ) {
+        if (strcmp((char *)entry->name, (char *)name) == 0) {
+            return entry;
         }
     }
+    return NULL;
 }
 
-/* Handle Windows menu items */
-VOID HandleWindowsMenu(ULONG itemNumber)
+/* Current visitor count of one of our own screens, also cached in the entry */
+WORD RegistryVisitors(struct RegistryEntry *entry)
+{
+    if (entry == NULL || entry->pubNode == NULL) {
+        return 0;
+    }
+    LockPubScreenList();
+    entry->visitorCount = entry->pubNode->psn_VisitorCount;
+    UnlockPubScreenList();
+    return entry->visitorCount;
+}
+
+/* Fill the unset fields of a mode profile from the Workbench screen */
+VOID ResolveModeProfile(struct ModeProfile *mode)
 {
-    Printf("Workspace: HandleWindowsMenu called with itemNumber=%lu\n", itemNumber);
+    struct Screen *wbScreen;
     
-    switch (itemNumber) {
-        case 0:  /* Tile Horizontally */
-            Printf("Workspace: Calling TileWindowsHorizontally\n");
-            TileWindowsHorizontally();
-            Printf("Workspace: TileWindowsHorizontally returned\n");
-            break;
-        
-        case 1:  /* Tile Vertically */
-            Printf("Workspace: Calling TileWindowsVertically\n");
-            TileWindowsVertically();
-            Printf("Workspace: TileWindowsVertically returned\n");
-            break;
-        
-        case 2:  /* Grid Layout */
-            Printf("Workspace: Calling TileWindowsGrid\n");
-            TileWindowsGrid();
-            Printf("Workspace: TileWindowsGrid returned\n");
-            break;
-        
-        default:
-            Printf("Workspace: Unknown Windows menu item: %lu\n", itemNumber);
-            break;
+    if (mode->width == 0 || mode->height == 0 || mode->depth == 0) {
+        wbScreen = LockPubScreen("Workbench");
+        if (wbScreen) {
+            if (mode->width == 0) {
+                mode->width = wbScreen->Width;
+            }
+            if (mode->height == 0) {
+                mode->height = wbScreen->Height;
+            }
+            if (mode->depth == 0) {
+                mode->depth = wbScreen->BitMap.Depth;
+            }
+            UnlockPubScreen(NULL, wbScreen);
+        }
     }
     
-    Printf("Workspace: HandleWindowsMenu returning\n");
+    /* No Workbench to copy from - start at the bottom of the ladder */
+    if (mode->width == 0) {
+        mode->width = MODE_MIN_WIDTH;
+    }
+    if (mode->height == 0) {
+        mode->height = MODE_MIN_HEIGHT;
+    }
+    if (mode->depth == 0) {
+        mode->depth = 1;
+    }
 }
 
-/* Handle Theme menu items */
-VOID HandleThemeMenu(ULONG itemNumber)
+/* One step down the fallback ladder - the next depth in modeDepths, and at 2 colors */
+/* the smallest size. Returns FALSE at the bottom. */
+BOOL NextModeStep(struct ModeProfile *mode)
 {
-    Printf("Workspace: HandleThemeMenu called with itemNumber=%lu\n", itemNumber);
+    BOOL smaller = FALSE;
+    ULONG i;
     
-    /* itemNumber is the theme index (0-4) */
-    if (itemNumber < THEME_COUNT) {
-        if (itemNumber == wsState.currentTheme) {
-            Printf("Workspace: Theme already active, ignoring\n");
-            return;
+    for (i = 0; i < MODE_DEPTHS; i++) {
+        if (modeDepths[i] < mode->depth) {
+            mode->depth = modeDepths[i];
+            return TRUE;
         }
-        Printf("Workspace: Applying theme %lu: %s\n", itemNumber, themeNames[itemNumber]);
-        if (ApplyTheme(itemNumber)) {
-            wsState.currentTheme = itemNumber;
-            Printf("Workspace: Theme applied successfully\n");
-        } else {
-            Printf("Workspace: ERROR - Failed to apply theme\n");
-        }
-    } else {
-        Printf("Workspace: Unknown theme index: %lu\n", itemNumber);
     }
+    if (mode->width > MODE_MIN_WIDTH) {
+        mode->width = MODE_MIN_WIDTH;
+        smaller = TRUE;
+    }
+    if (mode->height > MODE_MIN_HEIGHT) {
+        mode->height = MODE_MIN_HEIGHT;
+        smaller = TRUE;
+    }
+    return smaller;
 }
 
-/* Apply color theme to screen */
-BOOL ApplyTheme(ULONG themeIndex)
+/* The deepest valid depth not deeper than depth - 1 for anything below the table */
+UWORD ValidModeDepth(LONG depth)
 {
-    struct ColorMap *colorMap;
-    ULONG numColors;
     ULONG i;
-    UBYTE r, g, b;
-    ULONG srcR, srcG, srcB;
-    ULONG brightness;
-    ULONG invertedBrightness;
-    ULONG gray;
     
-    if (!wsState.workspaceScreen) {
-        Printf("Workspace: ERROR - No screen available for theme\n");
-        return FALSE;
+    for (i = 0; i < MODE_DEPTHS; i++) {
+        if (modeDepths[i] <= depth) {
+            return modeDepths[i];
+        }
     }
+    return 1;
+}
+
+/* Screens open like the Workbench, so they share its display mode - TRUE when that is */
+/* a chipset mode. An RTG bitmap lives in board memory and stays out of CHIPBUDGET. */
+BOOL WorkbenchIsNative(VOID)
+{
+    struct Screen *wbScreen;
+    struct DisplayInfo displayInfo;
+    ULONG modeID = INVALID_ID;
     
-    colorMap = wsState.workspaceScreen->ViewPort.ColorMap;
-    if (!colorMap) {
-        Printf("Workspace: ERROR - No ColorMap available\n");
-        return FALSE;
+    wbScreen = LockPubScreen("Workbench");
+    if (wbScreen) {
+        modeID = GetVPModeID(&wbScreen->ViewPort);
+        UnlockPubScreen(NULL, wbScreen);
     }
-    
-    /* Always base themes on the original palette captured at screen open */
-    if (!wsState.haveOriginalPalette) {
-        Printf("Workspace: ERROR - No original palette captured\n");
-        return FALSE;
+    if (modeID == INVALID_ID ||
+        GetDisplayInfoData(NULL, (UBYTE *)&displayInfo, sizeof(displayInfo), DTAG_DISP, modeID) == 0) {
+        return TRUE;
     }
-    numColors = wsState.numColors;
-    if (numColors == 0 || numColors > 256) {
-        Printf("Workspace: ERROR - Invalid numColors in original palette: %lu\n", numColors);
+    if (displayInfo.PropertyFlags & DIPF_IS_FOREIGN) {
         return FALSE;
     }
+    return TRUE;
+}
+
+/* Chip RAM a screen bitmap in a resolved native mode is expected to take, checked */
+/* against CHIPBUDGET before opening - rows padded to the widest fetch alignment. */
+/* SA_LikeWorkbench may still grow the screen to the display clip, ScreenChipCost */
+/* gives what it really took once open. */
+ULONG ModeChipCost(struct ModeProfile *mode)
+{
+    ULONG rowBytes;
     
-    Printf("Workspace: Applying theme %lu to screen with %lu colors\n", themeIndex, numColors);
+    rowBytes = ((ULONG)mode->width + MODE_ROW_ALIGN - 1) / MODE_ROW_ALIGN * (MODE_ROW_ALIGN / 8);
+    return rowBytes * (ULONG)mode->height * (ULONG)mode->depth;
+}
+
+/* Chip RAM an open screen's bitmap takes - padded width, final size and depth */
+ULONG ScreenChipCost(struct Screen *screen)
+{
+    struct BitMap *bitMap = screen->RastPort.BitMap;
     
-    /* Like Workbench restores the original palette captured at open */
-    if (themeIndex == THEME_LIKE_WORKBENCH) {
-        for (i = 0; i < numColors; i++) {
-            srcR = wsState.originalRGB[i * 3] >> 24;
-            srcG = wsState.originalRGB[i * 3 + 1] >> 24;
-            srcB = wsState.originalRGB[i * 3 + 2] >> 24;
-            SetRGB32(&wsState.workspaceScreen->ViewPort, i,
-                     (ULONG)srcR << 24, (ULONG)srcG << 24, (ULONG)srcB << 24);
-        }
-        Printf("Workspace: Restored original palette\n");
-        return TRUE;
+    return GetBitMapAttr(bitMap, BMA_WIDTH) / 8 * GetBitMapAttr(bitMap, BMA_HEIGHT) *
+           GetBitMapAttr(bitMap, BMA_DEPTH);
+}
+
+BOOL SameModeProfile(struct ModeProfile *a, struct ModeProfile *b)
+{
+    if (a->width != b->width || a->height != b->height ||
+        a->depth != b->depth || a->interleaved != b->interleaved) {
+        return FALSE;
     }
-    
-    /* Apply theme colors based on theme index */
-    for (i = 0; i < numColors; i++) {
-        /* Source color always from original palette (stable baseline) */
-        srcR = wsState.originalRGB[i * 3] >> 24;
-        srcG = wsState.originalRGB[i * 3 + 1] >> 24;
-        srcB = wsState.originalRGB[i * 3 + 2] >> 24;
-        r = (UBYTE)srcR;
-        g = (UBYTE)srcG;
-        b = (UBYTE)srcB;
-        
-        switch (themeIndex) {
-            case THEME_DARK_MODE:
-                /* Dark mode: invert colors and reduce brightness */
-                brightness = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
-                invertedBrightness = 255 - brightness;
-                /* Scale to dark range (0-128) */
-                r = (UBYTE)((invertedBrightness * 128) / 255);
-                g = (UBYTE)((invertedBrightness * 128) / 255);
-                b = (UBYTE)((invertedBrightness * 128) / 255);
+    return TRUE;
+}
+
+/* Create workspace screen (clone of Workbench in the desktop's mode) */
+/* Out of memory, too deep or over CHIPBUDGET steps down the fallback ladder */
+BOOL CreateWorkspaceScreen(VOID)
+{
+    struct Screen *newScreen = NULL;
+    struct ModeProfile mode;
+    LONG screenError = 0;
+    ULONG numColors;
+    ULONG chipCost;
+    ULONG interleavedTag;
+    BOOL native;
+    BOOL opened = FALSE;
+    struct MemProbe probe;
+    
+    mode = currentDesktop->mode;
+    ResolveModeProfile(&mode);
+    native = WorkbenchIsNative();
+    
+    /* Without INTERLEAVED the layout is inherited through SA_LikeWorkbench */
+    if (mode.interleaved) {
+        interleavedTag = SA_Interleaved;
+    } else {
+        interleavedTag = TAG_IGNORE;
+    }
+    MemProbeBegin(&probe);
+    for (;;) {
+        if (native) {
+            chipCost = ModeChipCost(&mode);
+        } else {
+            chipCost = 0;
+        }
+        if (wsState.chipBudget != 0 && wsState.chipUsed + chipCost > wsState.chipBudget) {
+            LOG_WARN(("Workspace: WARNING - %ldx%ld, %ld planes needs %lu bytes, %lu of %lu budget left\n",
+                      (LONG)mode.width, (LONG)mode.height, (LONG)mode.depth, chipCost,
+                      wsState.chipBudget - wsState.chipUsed, wsState.chipBudget));
+            screenError = OSERR_NOCHIPMEM;
+        } else {
+            /* Create screen using SA_LikeWorkbench (like example.c), the profile overrides */
+            LOG_TRACE(("Workspace: Opening screen with SA_LikeWorkbench, %ldx%ld, %ld planes...\n",
+                       (LONG)mode.width, (LONG)mode.height, (LONG)mode.depth));
+            screenError = 0;
+            newScreen = OpenScreenTags(NULL,
+                SA_Type, PUBLICSCREEN,
+                SA_PubName, currentDesktop->workspaceName,
+                SA_Title, currentDesktop->workspaceName,
+                SA_LikeWorkbench, TRUE,
+                SA_Width, (ULONG)mode.width,
+                SA_Height, (ULONG)mode.height,
+                SA_Depth, (ULONG)mode.depth,
+                interleavedTag, TRUE,
+                SA_Behind, (ULONG)currentDesktop->spare,
+                SA_ErrorCode, &screenError,
+                TAG_DONE);
+            if (newScreen != NULL) {
                 break;
-            
-            case THEME_SEPIA:
-                /* Sepia: warm brown tones */
-                gray = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
-                r = (UBYTE)((gray * 240) / 255);  /* Warm red */
-                g = (UBYTE)((gray * 220) / 255);  /* Warm green */
-                b = (UBYTE)((gray * 180) / 255); /* Warm blue (reduced) */
+            }
+        }
+        
+        /* Only a lack of memory is worth a cheaper mode */
+        if (screenError != OSERR_NOCHIPMEM && screenError != OSERR_NOMEM &&
+            screenError != OSERR_TOODEEP && screenError != OSERR_NORTGBITMAP) {
+            break;
+        }
+        if (!NextModeStep(&mode)) {
+            break;
+        }
+        LOG_WARN(("Workspace: WARNING - Retrying %s with %ldx%ld, %ld planes\n", currentDesktop->workspaceName,
+                  (LONG)mode.width, (LONG)mode.height, (LONG)mode.depth));
+    }
+    
+    if (newScreen == NULL) {
+        /* Check specific error code */
+        switch (screenError) {
+            case OSERR_PUBNOTUNIQUE:
+                LOG_ERROR(("Workspace: ERROR - Public screen name '%s' already in use\n", currentDesktop->workspaceName));
                 break;
-            
-            case THEME_BLUE:
-                /* Blue theme: cool blue tones */
-                gray = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
-                r = (UBYTE)((gray * 180) / 255);  /* Reduced red */
-                g = (UBYTE)((gray * 200) / 255);  /* Slightly reduced green */
-                b = (UBYTE)((gray * 240) / 255);  /* Enhanced blue */
+            case OSERR_NOMEM:
+                LOG_ERROR(("Workspace: ERROR - Out of memory (normal memory)\n"));
                 break;
-            
-            case THEME_GREEN:
-                /* Green theme: natural green tones */
-                gray = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
-                r = (UBYTE)((gray * 200) / 255);  /* Slightly reduced red */
-                g = (UBYTE)((gray * 240) / 255);  /* Enhanced green */
-                b = (UBYTE)((gray * 200) / 255);  /* Slightly reduced blue */
+            case OSERR_NOCHIPMEM:
+                LOG_ERROR(("Workspace: ERROR - Out of memory (chip memory)\n"));
+                break;
+            case OSERR_NOMONITOR:
+                LOG_ERROR(("Workspace: ERROR - Monitor not available\n"));
+                break;
+            case OSERR_NOCHIPS:
+                LOG_ERROR(("Workspace: ERROR - Newer custom chips required\n"));
+                break;
+            case OSERR_UNKNOWNMODE:
+                LOG_ERROR(("Workspace: ERROR - Unknown display mode\n"));
+                break;
+            case OSERR_TOODEEP:
+                LOG_ERROR(("Workspace: ERROR - Screen too deep for hardware\n"));
+                break;
+            case OSERR_ATTACHFAIL:
+                LOG_ERROR(("Workspace: ERROR - Failed to attach screens\n"));
+                break;
+            case OSERR_NOTAVAILABLE:
+                LOG_ERROR(("Workspace: ERROR - Mode not available\n"));
+                break;
+            case OSERR_NORTGBITMAP:
+                LOG_ERROR(("Workspace: ERROR - Could not allocate RTG bitmap\n"));
                 break;
-            
             default:
-                /* Keep original color */
+                LOG_ERROR(("Workspace: ERROR - Failed to open screen (error code: %ld)\n", screenError));
                 break;
         }
-        
-        /* Set the color using SetRGB32 */
-        SetRGB32(&wsState.workspaceScreen->ViewPort, i, (ULONG)r << 24, (ULONG)g << 24, (ULONG)b << 24);
+        goto done;
     }
     
-    Printf("Workspace: Theme applied to %lu colors\n", numColors);
-    return TRUE;
-}
-
-VOID HandleShellConsoleMenu(VOID)
-{
-    /* Toggle shell console - create it if not already enabled */
-    if (!wsState.shellEnabled) {
-        /* Enable shell console */
-        wsState.shellEnabled = TRUE;
-        
-        /* Free backdrop image if loaded (shell and backdrop are mutually exclusive) */
-        if (wsState.backdropImageObj) {
-            FreeBackdropImage();
-        }
-        
-        /* Create shell console */
-        if (!CreateShellConsole()) {
-            Printf("Workspace: ERROR - Failed to create shell console\n");
-            wsState.shellEnabled = FALSE;
+    LOG_INFO(("Workspace: Screen opened successfully\n"));
+    /* Use Screen->RastPort.BitMap instead of Screen->BitMap (recommended in docs) */
+    LOG_TRACE(("Workspace: Screen->Width=%ld, Screen->Height=%ld\n",
+               (LONG)newScreen->Width, (LONG)newScreen->Height));
+    LOG_TRACE(("Workspace: ViewPort.DWidth=%ld, ViewPort.DHeight=%ld\n",
+               (LONG)newScreen->ViewPort.DWidth, (LONG)newScreen->ViewPort.DHeight));
+    
+    /* Get draw info for our screen */
+    currentDesktop->drawInfo = GetScreenDrawInfo(newScreen);
+    
+    /* Make screen public - PubScreenStatus(screen, 0) makes it public */
+    /* A spare stays private until AdoptSpareDesktop hands it out */
+    /* According to docs: Returns 0 in bit 0 if screen wasn't public (success when making public) */
+    /* So bit 0 = 0 means SUCCESS when making public, bit 0 = 1 means was already public or error */
+    if (!currentDesktop->spare) {
+        UWORD statusResult = PubScreenStatus(newScreen, 0);
+        if ((statusResult & 0x0001) == 0) {
+            /* Bit 0 = 0 means screen wasn't public before, so we successfully made it public */
+            LOG_TRACE(("Workspace: Screen is now public\n"));
         } else {
-            Printf("Workspace: Shell console enabled\n");
+            /* Bit 0 = 1 means screen was already public or error occurred */
+            LOG_WARN(("Workspace: WARNING - Screen was already public or error (status: 0x%x)\n", statusResult));
+            /* Continue anyway */
         }
-    } else {
-        /* Shell is already enabled - just inform user */
-        Printf("Workspace: Shell console is already running\n");
     }
-}
-
-/* Check visitor count for all Workspace screens (not Workbench) */
-/* Returns the number of visitor windows (0 if none, or if error) */
-/* Note: Backdrop window IS counted as a visitor window */
-/* psn_VisitorCount only counts windows from other processes, so we add 1 for backdrop */
-WORD CheckWorkspaceVisitors(VOID)
-{
-    struct List *pubScreenList = NULL;
-    struct PubScreenNode *psn = NULL;
-    WORD totalVisitors = 0;
     
-    /* Lock public screen list */
-    pubScreenList = LockPubScreenList();
-    if (!pubScreenList) {
-        Printf("Workspace: WARNING - Could not lock public screen list\n");
-        return 0; /* Return 0 if we can't check */
+    /* Check dimensions after making public */
+        LOG_TRACE(("Workspace: After making public - Width: %ld, Height: %ld\n",
+                   (LONG)newScreen->Width, (LONG)newScreen->Height));
+    
+    currentDesktop->workspaceScreen = newScreen;
+    
+    if (!currentDesktop->spare && !RegisterScreen(currentDesktop)) {
+        LOG_ERROR(("Workspace: ERROR - Failed to register screen\n"));
+        FreeScreenDrawInfo(newScreen, currentDesktop->drawInfo);
+        currentDesktop->drawInfo = NULL;
+        CloseScreen(newScreen);
+        currentDesktop->workspaceScreen = NULL;
+        goto done;
+    }
+    /* Charge what the bitmap really took, the estimate can be short after clipping */
+    if (native) {
+        chipCost = ScreenChipCost(newScreen);
+    }
+    currentDesktop->chipCost = chipCost;
+    wsState.chipUsed += chipCost;
+    MemCharge(MEMACCT_SCREEN, MEMF_CHIP, chipCost);
+    opened = TRUE;
+    
+done:
+    MemProbeEnd(&probe, MEMACCT_SCREEN);
+    if (!opened) {
+        return FALSE;
+    }
+
+    /* No themes without a backdrop window - nothing to capture */
+    if (wsState.headless) {
+        return TRUE;
     }
     
-    /* Iterate through all public screens - correct Exec list iteration */
-    psn = (struct PubScreenNode *)pubScreenList->lh_Head;
-    while (psn && psn->psn_Node.ln_Succ != (struct Node *)&pubScreenList->lh_Tail) {
-        /* Check if this is a Workspace screen (starts with "Workspace.") */
-        if (psn->psn_Node.ln_Name && 
-            strncmp(psn->psn_Node.ln_Name, "Workspace.", 10) == 0) {
-            totalVisitors += (WORD)psn->psn_VisitorCount;
-        }
-        psn = (struct PubScreenNode *)psn->psn_Node.ln_Succ;
+    /* Capture original palette immediately after opening the screen */
+    /* A hibernated desktop keeps the one it first opened with, unless the depth changed */
+    numColors = 1UL << newScreen->BitMap.Depth;
+    if (numColors > 256) {
+        numColors = 256;
+    }
+    if (currentDesktop->hibernated && currentDesktop->originalRGB && currentDesktop->numColors == numColors) {
+        LOG_TRACE(("Workspace: Keeping palette from before hibernation\n"));
+        return TRUE;
     }
+    CapturePalette(newScreen);
     
-    UnlockPubScreenList();
+    return TRUE;
+}
+
+/* Capture the palette screen shows now as the current desktop's original palette */
+/* Sized to the screen and packed - a 4 color screen keeps 12 bytes */
+BOOL CapturePalette(struct Screen *screen)
+{
+    struct MemProbe probe;
+    ULONG numColors;
+    ULONG rgb[3];
+    ULONG i;
     
-    /* Add 1 for the backdrop window (owner's window, not counted in psn_VisitorCount) */
-    if (wsState.backdropWindow != NULL) {
-        totalVisitors += 1;
+    numColors = 1UL << screen->BitMap.Depth;
+    if (numColors > 256) {
+        numColors = 256;
+    }
+    MemProbeBegin(&probe);
+    if (currentDesktop->originalRGB) {
+        MemCharge(MEMACCT_DESKTOP, MEMF_ANY, -(LONG)(currentDesktop->numColors * 3));
+        FreeVec(currentDesktop->originalRGB);
+        currentDesktop->originalRGB = NULL;
+    }
+    currentDesktop->numColors = 0;
+    if (screen->ViewPort.ColorMap != NULL && numColors > 0) {
+        currentDesktop->originalRGB = AllocVec(numColors * 3, MEMF_ANY);
+    }
+    MemProbeEnd(&probe, MEMACCT_DESKTOP);
+    if (currentDesktop->originalRGB == NULL) {
+        LOG_WARN(("Workspace: WARNING - No palette captured, themes unavailable\n"));
+        return FALSE;
+    }
+    MemCharge(MEMACCT_DESKTOP, MEMF_ANY, numColors * 3);
+    wsState.memExhausted = FALSE;
+    for (i = 0; i < numColors; i++) {
+        GetRGB32(screen->ViewPort.ColorMap, i, 1, rgb);
+        currentDesktop->originalRGB[i * 3] = (UBYTE)(rgb[0] >> 24);
+        currentDesktop->originalRGB[i * 3 + 1] = (UBYTE)(rgb[1] >> 24);
+        currentDesktop->originalRGB[i * 3 + 2] = (UBYTE)(rgb[2] >> 24);
     }
+    currentDesktop->numColors = numColors;
     
-    /* Don't log here - let caller log with context */
-    return totalVisitors;
+    return TRUE;
 }
 
-BOOL HandleCloseMenu(VOID)
+/* Close workspace screen - shows warning if visitors exist, then returns FALSE */
+/* Returns TRUE if screen was closed successfully, FALSE if visitors prevent closing */
+BOOL CloseWorkspaceScreen(VOID)
 {
+    WORD visitorCount = 0;
     struct EasyStruct es;
     STRPTR titleStr;
     STRPTR textStr;
     STRPTR okStr;
-    struct Window *reqWindow;
-    WORD visitorCount;
-    char textBuffer[256];
     
-    /* Check for visitor windows before allowing quit */
-    Printf("Workspace: HandleCloseMenu called - checking for visitors...\n");
-    visitorCount = CheckWorkspaceVisitors();
-    Printf("Workspace: Visitor count: %ld\n", (LONG)visitorCount);
-    if (visitorCount > 0) {
-        /* Show EasyRequest dialog warning user */
-        Printf("Workspace: Visitors detected (%ld windows) - showing warning dialog\n", (LONG)visitorCount);
-        titleStr = "Cannot Exit Workspace";
-        
-        /* Format message with visitor count */
-        if (visitorCount == 1) {
-            SNPrintf(textBuffer, sizeof(textBuffer), 
-                     "Cannot exit Workspace.\n\nThere is 1 window open on a Workspace screen.\n\nPlease close all windows and try again.");
-        } else {
-            SNPrintf(textBuffer, sizeof(textBuffer), 
-                     "Cannot exit Workspace.\n\nThere are %d windows open on Workspace screens.\n\nPlease close all windows and try again.", 
-                     (int)visitorCount);
-        }
-        textStr = textBuffer;
-        okStr = "OK";
-        
-        es.es_StructSize = sizeof(struct EasyStruct);
-        es.es_Flags = 0;
-        es.es_Title = titleStr;
-        es.es_TextFormat = textStr;
-        es.es_GadgetFormat = okStr;
-        
-        /* Ensure our screen is in front and use a valid window on our screen */
-        if (wsState.workspaceScreen) {
-            ScreenToFront(wsState.workspaceScreen);
-        }
-        reqWindow = wsState.backdropWindow;
-        if (reqWindow == NULL || reqWindow->WScreen != wsState.workspaceScreen) {
-            if (wsState.workspaceScreen && wsState.workspaceScreen->FirstWindow) {
-                reqWindow = wsState.workspaceScreen->FirstWindow;
+    if (!currentDesktop->workspaceScreen) {
+        return TRUE;  /* No screen to close - consider it successful */
+    }
+    
+    /* Check for visitor windows once - don't loop */
+    {
+        /* Only this desktop's screen - other desktops keep their visitors */
+        visitorCount = RegistryVisitors(currentDesktop->registryEntry);
+        
+        LOG_TRACE(("Workspace: Visitor windows on %s: %d\n", currentDesktop->workspaceName, visitorCount));
+        
+        /* Check if we can close - no visitors allowed */
+        if (visitorCount > 0) {
+            /* Show EasyRequest dialog warning user */
+            titleStr = "Cannot Exit Workspace";
+            textStr = "Cannot close Workspace screen.\n\nAll windows on this screen must be closed before exiting.\n\nPlease close all windows and try again.";
+            okStr = "OK";
+            
+            es.es_StructSize = sizeof(struct EasyStruct);
+            es.es_Flags = 0;
+            es.es_Title = titleStr;
+            es.es_TextFormat = textStr;
+            es.es_GadgetFormat = okStr;
+            
+            /* Ensure our screen is in front and use a valid window on our screen */
+            if (currentDesktop->workspaceScreen) {
+                ScreenToFront(currentDesktop->workspaceScreen);
+            }
+            /* Use backdrop window if available and valid, otherwise try to use screen's first window */
+            {
+                struct Window *reqWindow = currentDesktop->backdropWindow;
+                /* If backdrop window is NULL or not on our screen, try to find another window */
+                if (reqWindow == NULL || reqWindow->WScreen != currentDesktop->workspaceScreen) {
+                    /* Try to use the screen's first window if available */
+                    if (currentDesktop->workspaceScreen && currentDesktop->workspaceScreen->FirstWindow) {
+                        reqWindow = currentDesktop->workspaceScreen->FirstWindow;
+                    }
+                }
+                OpenRequester(reqWindow, &es);
             }
+        LOG_WARN(("Workspace: Cannot close - %ld visitor windows still open, user must close them\n", (LONG)visitorCount));
+        /* Return FALSE - screen was not closed */
+        return FALSE;
         }
-        EasyRequestArgs(reqWindow, &es, NULL, NULL);
-        Printf("Workspace: User dismissed dialog - NOT setting quitFlag, NOT exiting\n");
+        
+        /* No visitors - try to close screen */
+        /* Take screen private before closing */
         {
-            STRPTR quitFlagStr;
-            if (wsState.quitFlag) {
-                quitFlagStr = "TRUE";
+            UWORD statusResult = PubScreenStatus(currentDesktop->workspaceScreen, PSNF_PRIVATE);
+            if ((statusResult & 0x0001) == 0) {
+                /* Bit 0 = 0 means can't make private (visitors are open) */
+                LOG_WARN(("Workspace: WARNING - Could not make screen private (status: 0x%x), may have visitors\n", statusResult));
+                /* Show warning and return */
+                titleStr = "Cannot Close Screen";
+                textStr = "Cannot close Workspace screen.\n\nAll windows on this screen must be closed before exiting.\n\nPlease close all windows and try again.";
+                okStr = "OK";
+                
+                es.es_StructSize = sizeof(struct EasyStruct);
+                es.es_Flags = 0;
+                es.es_Title = titleStr;
+                es.es_TextFormat = textStr;
+                es.es_GadgetFormat = okStr;
+                
+                if (currentDesktop->workspaceScreen) {
+                    ScreenToFront(currentDesktop->workspaceScreen);
+                }
+                {
+                    struct Window *reqWindow = currentDesktop->backdropWindow;
+                    if (reqWindow == NULL || reqWindow->WScreen != currentDesktop->workspaceScreen) {
+                        if (currentDesktop->workspaceScreen && currentDesktop->workspaceScreen->FirstWindow) {
+                            reqWindow = currentDesktop->workspaceScreen->FirstWindow;
+                        }
+                    }
+                    OpenRequester(reqWindow, &es);
+                }
+            LOG_WARN(("Workspace: Cannot make screen private, user must close windows\n"));
+            return FALSE;
             } else {
-                quitFlagStr = "FALSE";
+                /* Bit 0 = 1 means successfully made private */
+                LOG_TRACE(("Workspace: Screen made private\n"));
             }
-            Printf("Workspace: quitFlag is currently: %s\n", quitFlagStr);
         }
-        /* CRITICAL: Do NOT set quitFlag - this prevents the event loop from exiting */
-        /* Do NOT proceed with cleanup - just return FALSE and let event loop continue */
-        return FALSE;
+        
+        /* Close screen - returns TRUE if closed, FALSE if windows still open */
+        if (!ClosePrivateScreen()) {
+            /* Public again so visitors can finish what they are doing */
+            PubScreenStatus(currentDesktop->workspaceScreen, 0);
+            titleStr = "Cannot Close Screen";
+            textStr = "Cannot close Workspace screen.\n\nAll windows on this screen must be closed before exiting.\n\nPlease close all windows and try again.";
+            okStr = "OK";
+            
+            es.es_StructSize = sizeof(struct EasyStruct);
+            es.es_Flags = 0;
+            es.es_Title = titleStr;
+            es.es_TextFormat = textStr;
+            es.es_GadgetFormat = okStr;
+            
+            /* Ensure our screen is in front and use a valid window on our screen */
+            if (currentDesktop->workspaceScreen) {
+                ScreenToFront(currentDesktop->workspaceScreen);
+            }
+            /* Use backdrop window if available and valid, otherwise try to use screen's first window */
+            {
+                struct Window *reqWindow = currentDesktop->backdropWindow;
+                /* If backdrop window is NULL or not on our screen, try to find another window */
+                if (reqWindow == NULL || reqWindow->WScreen != currentDesktop->workspaceScreen) {
+                    /* Try to use the screen's first window if available */
+                    if (currentDesktop->workspaceScreen && currentDesktop->workspaceScreen->FirstWindow) {
+                        reqWindow = currentDesktop->workspaceScreen->FirstWindow;
+                    }
+                }
+                OpenRequester(reqWindow, &es);
+            }
+            LOG_WARN(("Workspace: CloseScreen failed, user must close windows\n"));
+            /* Return FALSE - screen was not closed */
+            return FALSE;
+        }
     }
     
-    /* No visitors - safe to quit */
-    Printf("Workspace: No visitors detected - setting quitFlag to exit\n");
-    wsState.quitFlag = TRUE;
     return TRUE;
 }
 
-VOID HandleDefaultPubScreenSubMenu(STRPTR screenName)
+/* Close the current desktop's screen once it is private (no new visitors can come) */
+/* - callers that made it private themselves (hibernation) or never made it public */
+/* (the spare) start here. No requester: FALSE if a window still keeps it open. */
+BOOL ClosePrivateScreen(VOID)
 {
-    if (screenName == NULL) {
-        /* Workbench (NULL) */
-        SetDefaultPubScreen(NULL);
-        Printf("Workspace: Set Workbench as default pubscreen\n");
-    } else {
-        /* Workspace.n screen */
-        SetDefaultPubScreen(screenName);
-        Printf("Workspace: Set as default pubscreen: %s\n", screenName);
+    struct Screen *screen = currentDesktop->workspaceScreen;
+    struct MemProbe probe;
+    BOOL closeSucceeded;
+    
+    if (screen == NULL) {
+        return TRUE;
+    }
+    
+    /* Held exclusively so the commodity task cannot bring a closing screen to front */
+    /* The registry too, so no other process finds the screen once it is gone */
+    ObtainSemaphore(&wsState.screenSemaphore);
+    ObtainSemaphore(&registry->semaphore);
+    MemProbeBegin(&probe);
+    closeSucceeded = CloseScreen(screen);
+    if (closeSucceeded) {
+        MemProbeEnd(&probe, MEMACCT_SCREEN);
+        currentDesktop->workspaceScreen = NULL;
+        wsState.chipUsed -= currentDesktop->chipCost;
+        MemCharge(MEMACCT_SCREEN, MEMF_CHIP, -(LONG)currentDesktop->chipCost);
+        currentDesktop->chipCost = 0;
+        /* The name stays reserved until UnregisterScreen */
+        if (currentDesktop->registryEntry) {
+            currentDesktop->registryEntry->screen = NULL;
+            currentDesktop->registryEntry->pubNode = NULL;
+            currentDesktop->registryEntry->visitorCount = 0;
+        }
+    }
+    ReleaseSemaphore(&registry->semaphore);
+    ReleaseSemaphore(&wsState.screenSemaphore);
+    if (!closeSucceeded) {
+        LOG_WARN(("Workspace: CloseScreen failed on %s - windows still open\n", currentDesktop->workspaceName));
+        return FALSE;
     }
+    
+    /* Only free draw info after successful close */
+    if (currentDesktop->drawInfo) {
+        FreeScreenDrawInfo(screen, currentDesktop->drawInfo);
+        currentDesktop->drawInfo = NULL;
+    }
+    
+    LOG_INFO(("Workspace: Screen closed successfully\n"));
+    return TRUE;
 }
 
-/* Find all Workspace.n screens and build menu structure */
-struct NewMenu *BuildDefaultPubScreenMenu(ULONG *menuCount)
+/* Create backdrop window using standard Intuition OpenWindowTags() */
+BOOL CreateBackdropWindow(VOID)
 {
-    struct List *pubScreenList = NULL;
-    struct PubScreenNode *psn = NULL;
-    struct NewMenu *newMenu = NULL;
-    struct NewMenu *newMenu2 = NULL;
-    ULONG count = 0;
-    ULONG maxCount = 32; /* Start with space for 32 screens */
-    ULONG idx = 0;
-    STRPTR screenName = NULL;
-    STRPTR nameCopy = NULL;
-    ULONG nameLen = 0;
-    ULONG subItemCount = 1; /* Start with Workbench */
-    ULONG subIdx;
-    ULONG workbenchIdx = 1; /* Workbench is at index 1 (after title) */
-    ULONG totalSubItems;
-    
-    /* Allocate menu array - start with base menu items + space for screens */
-    newMenu = AllocMem(sizeof(struct NewMenu) * (maxCount + 10), MEMF_CLEAR);
-    if (!newMenu) {
-        Printf("Workspace: ERROR - Failed to allocate menu array\n");
-        return NULL;
+    WORD screenWidth, screenHeight;
+    WORD titleBarHeight, windowTop, windowHeight;
+    BOOL opened = FALSE;
+    struct MemProbe probe;
+    
+    if (currentDesktop->workspaceScreen == NULL) {
+        return FALSE;
     }
     
-    /* Start with menu title */
-    newMenu[idx].nm_Type = NM_TITLE;
-    newMenu[idx].nm_Label = "Workspace";
-    idx++;
-    
-    /* Add "Default PubScreen" menu item */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "Default PubScreen";
-    newMenu[idx].nm_CommKey = NULL;
-    newMenu[idx].nm_Flags = 0;
-    newMenu[idx].nm_MutualExclude = 0;
-    newMenu[idx].nm_UserData = NULL;
-    idx++;
-    
-    /* Add "Workbench" as first sub-item (corresponds to NULL) */
-    newMenu[idx].nm_Type = NM_SUB;
-    newMenu[idx].nm_Label = "Workbench";
-    newMenu[idx].nm_Flags = CHECKIT | CHECKED; /* Checkmark item, initially checked */
-    newMenu[idx].nm_MutualExclude = 0; /* Will be set after we know total count */
-    newMenu[idx].nm_UserData = (APTR)((0UL << 16) | (0UL << 8) | 0UL); /* Menu 0, Item 0, Sub 0 */
-    idx++;
-    subItemCount++;
-    
-    /* First, add our own screen if it exists */
-    if (wsState.workspaceScreen && wsState.workspaceName) {
-        nameLen = 0;
-        if (wsState.workspaceName) {
-            while (wsState.workspaceName[nameLen] != '\0') nameLen++;
-        }
-        if (nameLen > 0) {
-            nameCopy = AllocMem(nameLen + 1, MEMF_CLEAR);
-            if (nameCopy) {
-                strcpy(nameCopy, wsState.workspaceName);
-                
-                newMenu[idx].nm_Type = NM_SUB;
-                newMenu[idx].nm_Label = nameCopy;
-                newMenu[idx].nm_Flags = CHECKIT; /* Checkmark item */
-                newMenu[idx].nm_MutualExclude = 0; /* Will be set after we know total count */
-                newMenu[idx].nm_UserData = (APTR)((0UL << 16) | (0UL << 8) | (subItemCount - 1));
-                idx++;
-                count++;
-                subItemCount++;
+    LOG_TRACE(("Workspace: Creating backdrop window on workspace screen...\n"));
+    
+    /* Get screen dimensions - Width and Height are the RastPort dimensions */
+    /* According to docs: "Width = the width for this screen's RastPort" */
+    /* For SA_LikeWorkbench screens, use ViewPort dimensions if Screen->Width is 0 */
+    if (currentDesktop->workspaceScreen->Width == 0 && currentDesktop->workspaceScreen->ViewPort.DWidth > 0) {
+        screenWidth = 640; /*currentDesktop->workspaceScreen->ViewPort.DWidth;*/
+        screenHeight = 480; /*currentDesktop->workspaceScreen->ViewPort.DHeight;*/
+        LOG_TRACE(("Workspace: Using ViewPort dimensions: Width=%ld, Height=%ld\n",
+                   (LONG)screenWidth, (LONG)screenHeight));
+    } else {
+        screenWidth = currentDesktop->workspaceScreen->Width;
+        screenHeight = currentDesktop->workspaceScreen->Height;
+        LOG_TRACE(("Workspace: Using Screen dimensions: Width=%ld, Height=%ld\n",
+                   (LONG)screenWidth, (LONG)screenHeight));
+    }
+    
+    /* Calculate title bar height - BarHeight is one less than actual height */
+    titleBarHeight = currentDesktop->workspaceScreen->BarHeight + 1;
+    windowTop = titleBarHeight;
+    windowHeight = screenHeight - titleBarHeight;
+    
+    LOG_TRACE(("Workspace: Screen BarHeight=%ld, TitleBarHeight=%ld\n", 
+               (LONG)currentDesktop->workspaceScreen->BarHeight, (LONG)titleBarHeight));
+    LOG_TRACE(("Workspace: Creating window: Left=0, Top=%ld, Width=%ld, Height=%ld\n", 
+               (LONG)windowTop, (LONG)screenWidth, (LONG)windowHeight));
+    
+    /* Validate dimensions - OpenWindowTags will fail or create invalid window if dimensions are 0 */
+    if (screenWidth <= 0 || windowHeight <= 0) {
+        LOG_ERROR(("Workspace: ERROR - Invalid window dimensions: Width=%ld, Height=%ld\n",
+                   (LONG)screenWidth, (LONG)windowHeight));
+        return FALSE;
+    }
+    
+    /* Open backdrop window - positioned below title bar */
+    /* Don't activate initially - will activate after menu is set */
+    MemProbeBegin(&probe);
+    currentDesktop->backdropWindow = OpenWindowTags(NULL,
+        WA_Left, 0,
+        WA_Top, windowTop,
+        WA_Width, screenWidth,
+        WA_Height, windowHeight,
+        WA_CustomScreen, currentDesktop->workspaceScreen,
+        WA_Backdrop, TRUE,
+        WA_Borderless, TRUE,
+        WA_DragBar, FALSE,
+        WA_IDCMP, 0,  /* No port yet - ModifyIDCMP below after UserPort is set */
+        WA_DetailPen, -1,
+        WA_BlockPen, -1,
+        WA_Activate, FALSE,  /* Don't activate yet - will activate after menu is set */
+        WA_NewLookMenus, TRUE,  /* Required for GadTools NewLook menus */
+        TAG_DONE);
+    
+    if (currentDesktop->backdropWindow == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Failed to open window (OpenWindowTags returned NULL)\n"));
+        goto done;
+    }
+    
+    LOG_TRACE(("Workspace: Window opened successfully: 0x%lx\n", (ULONG)currentDesktop->backdropWindow));
+    LOG_TRACE(("Workspace: Window actual dimensions: LeftEdge=%ld, TopEdge=%ld, Width=%ld, Height=%ld\n",
+               (LONG)currentDesktop->backdropWindow->LeftEdge, (LONG)currentDesktop->backdropWindow->TopEdge,
+               (LONG)currentDesktop->backdropWindow->Width, (LONG)currentDesktop->backdropWindow->Height));
+    LOG_TRACE(("Workspace: Window Flags: 0x%lx\n", (ULONG)currentDesktop->backdropWindow->Flags));
+    
+    /* Check if window was created with valid dimensions */
+    if (currentDesktop->backdropWindow->Width == 0 || currentDesktop->backdropWindow->Height == 0) {
+        LOG_ERROR(("Workspace: ERROR - Window created with invalid dimensions (Width=%ld, Height=%ld)\n",
+                   (LONG)currentDesktop->backdropWindow->Width, (LONG)currentDesktop->backdropWindow->Height));
+        goto done;
+    }
+    
+    /* All backdrop windows share wsState.windowPort - UserData leads back to the desktop */
+    currentDesktop->backdropWindow->UserData = (BYTE *)currentDesktop;
+    currentDesktop->backdropWindow->UserPort = wsState.windowPort;
+    if (!ModifyIDCMP(currentDesktop->backdropWindow,
+                     IDCMP_MENUPICK | IDCMP_CLOSEWINDOW | IDCMP_REFRESHWINDOW |
+                     IDCMP_ACTIVEWINDOW)) {
+        LOG_ERROR(("Workspace: ERROR - ModifyIDCMP failed on backdrop window\n"));
+        goto done;
+    }
+    opened = TRUE;
+    
+done:
+    MemProbeEnd(&probe, MEMACCT_WINDOW);
+    if (!opened) {
+        /* CloseWindowSafely gives the window back to MEMACCT_WINDOW itself */
+        if (currentDesktop->backdropWindow) {
+            CloseWindowSafely(currentDesktop->backdropWindow);
+            currentDesktop->backdropWindow = NULL;
+        }
+        return FALSE;
+    }
+    {
+        LONG signalBit;
+        if (currentDesktop->backdropWindow && currentDesktop->backdropWindow->UserPort) {
+            signalBit = currentDesktop->backdropWindow->UserPort->mp_SigBit;
+        } else {
+            signalBit = -1;
+        }
+        LOG_TRACE(("Workspace: Window UserPort: 0x%lx, Signal bit: %ld\n", 
+                   (ULONG)currentDesktop->backdropWindow->UserPort, signalBit));
+    }
+    
+    /* Window is now open - menu will be created separately after this function returns */
+    
+    return TRUE;
+}
+
+/* Close backdrop window */
+VOID CloseBackdropWindow(VOID)
+{
+    if (currentDesktop->backdropWindow) {
+        /* Clear menu strip before closing window (required by Intuition API) */
+        if (currentDesktop->menuStrip) {
+            ClearMenuStrip(currentDesktop->backdropWindow);
+        }
+        /* The port is shared - take our messages off it before CloseWindow */
+        CloseWindowSafely(currentDesktop->backdropWindow);
+        currentDesktop->backdropWindow = NULL;
+    }
+}
+
+/* Close a window whose UserPort is shared with other windows */
+/* Its queued messages are replied under Forbid so Intuition cannot add more, */
+/* and UserPort is cleared so CloseWindow does not delete the port */
+VOID CloseWindowSafely(struct Window *window)
+{
+    struct IntuiMessage *imsg;
+    struct Node *succ;
+    struct MemProbe probe;
+    
+    Forbid();
+    if (window->UserPort != NULL) {
+        imsg = (struct IntuiMessage *)window->UserPort->mp_MsgList.lh_Head;
+        while ((succ = imsg->ExecMessage.mn_Node.ln_Succ) != NULL) {
+            if (imsg->IDCMPWindow == window) {
+                Remove((struct Node *)imsg);
+                ReplyMsg((struct Message *)imsg);
+            }
+            imsg = (struct IntuiMessage *)succ;
+        }
+    }
+    window->UserPort = NULL;
+    ModifyIDCMP(window, 0);
+    Permit();
+    MemProbeBegin(&probe);
+    CloseWindow(window);
+    MemProbeEnd(&probe, MEMACCT_WINDOW);
+}
+
+/* Menu item handlers */
+VOID HandleAboutMenu(VOID)
+{
+    struct EasyStruct es;
+    STRPTR titleStr = "About Workspace";
+    STRPTR textStr = "Workspace\n\nA public screen manager for AmigaOS\n\nVersion 1.0";
+    STRPTR okStr = "OK";
+    struct Window *reqWindow;
+    
+    es.es_StructSize = sizeof(struct EasyStruct);
+    es.es_Flags = 0;
+    es.es_Title = titleStr;
+    es.es_TextFormat = textStr;
+    es.es_GadgetFormat = okStr;
+    
+    /* Ensure our screen is in front */
+    if (currentDesktop->workspaceScreen) {
+        ScreenToFront(currentDesktop->workspaceScreen);
+    }
+    
+    /* Use backdrop window if available and valid, otherwise try to use screen's first window */
+    reqWindow = currentDesktop->backdropWindow;
+    if (reqWindow == NULL || reqWindow->WScreen != currentDesktop->workspaceScreen) {
+        if (currentDesktop->workspaceScreen && currentDesktop->workspaceScreen->FirstWindow) {
+            reqWindow = currentDesktop->workspaceScreen->FirstWindow;
+        }
+    }
+    
+    OpenRequester(reqWindow, &es);
+}
+
+/* Show a requester without blocking - the event loop keeps serving hotkeys */
+/* and Exchange while it is open. A new requester replaces the previous one. */
+/* Only for OK-only requesters, the answer is not reported. */
+VOID OpenRequester(struct Window *refWindow, struct EasyStruct *es)
+{
+    struct Window *reqWindow;
+    
+    CloseRequester();
+    reqWindow = BuildEasyRequestArgs(refWindow, es, 0, NULL);
+    
+    /* 0 = could not be built, 1 = answered already (e.g. no screen to show it on) */
+    if (reqWindow == NULL || reqWindow == (struct Window *)1) {
+        LOG_WARN(("Workspace: WARNING - Could not open requester: %s\n", es->es_Title));
+        return;
+    }
+    currentDesktop->requesterWindow = reqWindow;
+}
+
+/* Requester window signalled - free it once a gadget has been selected */
+VOID HandleRequester(VOID)
+{
+    LONG result;
+    
+    if (currentDesktop->requesterWindow == NULL) {
+        return;
+    }
+    /* -2 means the input did not end the requester */
+    result = SysReqHandler(currentDesktop->requesterWindow, NULL, FALSE);
+    if (result != -2) {
+        CloseRequester();
+    }
+}
+
+VOID CloseRequester(VOID)
+{
+    if (currentDesktop->requesterWindow) {
+        FreeSysRequest(currentDesktop->requesterWindow);
+        currentDesktop->requesterWindow = NULL;
+    }
+}
+
+/* Structure to hold window information for tiling */
+struct WindowInfo {
+    struct Window *window;
+    WORD minWidth;
+    WORD minHeight;
+    WORD maxWidth;
+    WORD maxHeight;
+    BOOL isResizable;
+    BOOL isShellWindow;
+};
+
+/* Get all visitor windows on the workspace screen */
+/* Returns number of windows found, stores pointers in windows array */
+/* Excludes backdrop window and shell window if specified */
+WORD GetVisitorWindows(struct WindowInfo *windows, WORD maxWindows, BOOL excludeShell)
+{
+    struct Window *win;
+    WORD count = 0;
+    WORD titleBarHeight;
+    
+    if (!currentDesktop->workspaceScreen || !windows || maxWindows == 0) {
+        return 0;
+    }
+    
+    /* Get title bar height for screen */
+    titleBarHeight = currentDesktop->workspaceScreen->BarHeight + 1;
+    
+    /* Iterate through all windows on the screen */
+    win = currentDesktop->workspaceScreen->FirstWindow;
+    LOG_TRACE(("Workspace: GetVisitorWindows - backdropWindow=0x%lx, shellWindow=0x%lx\n",
+               (ULONG)currentDesktop->backdropWindow, (ULONG)currentDesktop->shellWindow));
+    while (win != NULL && count < maxWindows) {
+        LOG_TRACE(("Workspace: GetVisitorWindows - checking window 0x%lx\n", (ULONG)win));
+        
+        /* ALWAYS skip backdrop window - it's our own window, never tile it */
+        if (win == currentDesktop->backdropWindow) {
+            LOG_TRACE(("Workspace: GetVisitorWindows - skipping backdrop window\n"));
+            win = win->NextWindow;
+            continue;
+        }
+        
+        /* ALWAYS skip shell window - it's our own window, never tile it */
+        /* Check both by pointer and by checking if it's a backdrop window at the bottom */
+        if (win == currentDesktop->shellWindow) {
+            LOG_TRACE(("Workspace: GetVisitorWindows - skipping shell window (by pointer match)\n"));
+            win = win->NextWindow;
+            continue;
+        }
+        
+        /* Also check if this window matches shell window characteristics:
+         * - Backdrop window
+         * - Borderless
+         * - At bottom of screen (TopEdge near screen height - 200)
+         * - Height is approximately 200
+         * This works even if currentDesktop->shellWindow is NULL (after shell ends)
+         */
+        if ((win->Flags & WFLG_BACKDROP) != 0 &&
+            (win->Flags & WFLG_BORDERLESS) != 0 &&
+            win->WScreen == currentDesktop->workspaceScreen) {
+            WORD expectedTop = currentDesktop->workspaceScreen->Height - 200;
+            WORD expectedHeight = 200;
+            /* Check if window is at bottom of screen with ~200px height */
+            /* Use a wider tolerance for TopEdge since it might vary slightly */
+            if (win->TopEdge >= expectedTop - 20 && win->TopEdge <= expectedTop + 20 &&
+                win->Height >= expectedHeight - 20 && win->Height <= expectedHeight + 20) {
+                LOG_TRACE(("Workspace: GetVisitorWindows - skipping shell window (by characteristics: TopEdge=%ld, Height=%ld, expected Top=%ld, Height=%ld)\n",
+                           (LONG)win->TopEdge, (LONG)win->Height, (LONG)expectedTop, (LONG)expectedHeight));
+                win = win->NextWindow;
+                continue;
+            }
+        }
+        
+        /* Store window info */
+        windows[count].window = win;
+        windows[count].isShellWindow = FALSE;  /* We've already excluded shell window above */
+        LOG_TRACE(("Workspace: GetVisitorWindows - including window 0x%lx in tiling list\n", (ULONG)win));
+        
+        /* Check if window is resizable */
+        /* Windows with WFLG_SIZEGADGET or WFLG_DRAGBAR are typically resizable */
+        windows[count].isResizable = ((win->Flags & WFLG_SIZEGADGET) != 0);
+        
+        /* Get window size limits if available */
+        /* For now, use reasonable defaults */
+        windows[count].minWidth = 64;
+        windows[count].minHeight = 32;
+        windows[count].maxWidth = win->WScreen->Width;
+        windows[count].maxHeight = win->WScreen->Height - titleBarHeight;
+        
+        count++;
+        /* Split Printf to avoid potential stack corruption */
+        LOG_TRACE(("Workspace: GetVisitorWindows - count is now %ld\n", (LONG)count));
+        LOG_TRACE(("Workspace: GetVisitorWindows - included window 0x%lx\n", (ULONG)win));
+        win = win->NextWindow;
+    }
+    
+    LOG_TRACE(("Workspace: GetVisitorWindows - final count before return: %ld\n", (LONG)count));
+    return count;
+}
+
+/* Tile windows horizontally */
+VOID TileWindowsHorizontally(VOID)
+{
+    struct WindowInfo windows[32];
+    WORD windowCount;
+    WORD i;
+    WORD screenWidth;
+    WORD screenHeight;
+    WORD titleBarHeight;
+    WORD windowWidth;
+    WORD windowHeight;
+    WORD windowTop;
+    WORD windowLeft;
+    WORD shellHeight = 0;
+    WORD usableHeight;
+    
+    if (!currentDesktop->workspaceScreen) {
+        return;
+    }
+    
+    /* Get screen dimensions */
+    screenWidth = currentDesktop->workspaceScreen->Width;
+    screenHeight = currentDesktop->workspaceScreen->Height;
+    titleBarHeight = currentDesktop->workspaceScreen->BarHeight + 1;
+    
+    /* Account for shell window at bottom if open */
+    if (currentDesktop->shellWindow && currentDesktop->shellEnabled) {
+        shellHeight = 200;  /* Shell window height */
+    }
+    
+    usableHeight = screenHeight - titleBarHeight - shellHeight;
+    
+    /* Get all visitor windows (excluding backdrop, excluding shell) */
+    LOG_TRACE(("Workspace: Getting visitor windows...\n"));
+    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    LOG_TRACE(("Workspace: GetVisitorWindows returned %ld windows\n", (LONG)windowCount));
+    
+    /* Early return if no windows - check immediately after function call */
+    if (windowCount == 0) {
+        LOG_TRACE(("Workspace: No windows to tile - returning early\n"));
+        return;
+    }
+    
+    /* Double-check windowCount before proceeding */
+    if (windowCount == 0 || windowCount > 32) {
+        LOG_ERROR(("Workspace: ERROR - invalid windowCount=%ld, aborting\n", (LONG)windowCount));
+        return;
+    }
+    
+    LOG_TRACE(("Workspace: Tiling %ld windows horizontally\n", (LONG)windowCount));
+    
+    /* Calculate window dimensions - prevent division by zero */
+    if (windowCount == 0) {
+        LOG_ERROR(("Workspace: ERROR - windowCount is 0, returning early\n"));
+        return;
+    }
+    
+    windowWidth = screenWidth / windowCount;
+    if (windowWidth == 0) {
+        LOG_ERROR(("Workspace: ERROR - calculated windowWidth is 0, returning early\n"));
+        return;
+    }
+    windowHeight = usableHeight;
+    windowTop = titleBarHeight;
+    
+    LOG_TRACE(("Workspace: Calculated windowWidth=%ld, windowHeight=%ld, windowTop=%ld\n", 
+               (LONG)windowWidth, (LONG)windowHeight, (LONG)windowTop));
+    
+    /* Tile windows */
+    LOG_TRACE(("Workspace: Starting tile loop for %ld windows\n", (LONG)windowCount));
+    
+    /* Safety check - should never happen if early return worked */
+    if (windowCount == 0 || windowCount > 32) {
+        LOG_ERROR(("Workspace: ERROR - invalid windowCount=%ld, aborting tile operation\n", (LONG)windowCount));
+        return;
+    }
+    
+    for (i = 0; i < windowCount; i++) {
+        /* Safety check - ensure window pointer is valid */
+        if (windows[i].window == NULL) {
+            LOG_ERROR(("Workspace: ERROR - window[%ld] is NULL, skipping\n", (LONG)i));
+            continue;
+        }
+        
+#if WS_LOG_LEVEL >= WS_LOG_TRACE
+        {
+            char *resizableStr;
+            if (windows[i].isResizable) {
+                resizableStr = "YES";
+            } else {
+                resizableStr = "NO";
+            }
+            LOG_TRACE(("Workspace: Tiling window %ld of %ld (window=0x%lx, resizable=%s)\n", 
+                       (LONG)(i + 1), (LONG)windowCount, (ULONG)windows[i].window, resizableStr));
+        }
+#endif
+        windowLeft = i * windowWidth;
+        
+        /* For resizable windows, resize them */
+        if (windows[i].isResizable) {
+            LOG_TRACE(("Workspace: Calling ChangeWindowBox for window %ld: left=%ld, top=%ld, width=%ld, height=%ld\n",
+                       (LONG)i, (LONG)windowLeft, (LONG)windowTop, (LONG)windowWidth, (LONG)windowHeight));
+            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
+        } else {
+            /* For fixed-size windows, just move them */
+            LOG_TRACE(("Workspace: Calling MoveWindow for window %ld: deltaX=%ld, deltaY=%ld\n",
+                       (LONG)i, 
+                       (LONG)(windowLeft - windows[i].window->LeftEdge),
+                       (LONG)(windowTop - windows[i].window->TopEdge)));
+            MoveWindow(windows[i].window, windowLeft - windows[i].window->LeftEdge, 
+                      windowTop - windows[i].window->TopEdge);
+        }
+        LOG_TRACE(("Workspace: Finished tiling window %ld\n", (LONG)i));
+    }
+    LOG_TRACE(("Workspace: Finished tiling all %ld windows\n", (LONG)windowCount));
+}
+
+/* Tile windows vertically */
+VOID TileWindowsVertically(VOID)
+{
+    struct WindowInfo windows[32];
+    WORD windowCount;
+    WORD i;
+    WORD screenWidth;
+    WORD screenHeight;
+    WORD titleBarHeight;
+    WORD windowWidth;
+    WORD windowHeight;
+    WORD windowTop;
+    WORD windowLeft;
+    WORD shellHeight = 0;
+    WORD usableHeight;
+    
+    if (!currentDesktop->workspaceScreen) {
+        return;
+    }
+    
+    /* Get screen dimensions */
+    screenWidth = currentDesktop->workspaceScreen->Width;
+    screenHeight = currentDesktop->workspaceScreen->Height;
+    titleBarHeight = currentDesktop->workspaceScreen->BarHeight + 1;
+    
+    /* Account for shell window at bottom if open */
+    if (currentDesktop->shellWindow && currentDesktop->shellEnabled) {
+        shellHeight = 200;  /* Shell window height */
+    }
+    
+    usableHeight = screenHeight - titleBarHeight - shellHeight;
+    
+    /* Get all visitor windows (excluding backdrop, excluding shell) */
+    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    
+    if (windowCount == 0) {
+        LOG_TRACE(("Workspace: No windows to tile\n"));
+        return;
+    }
+    
+    LOG_TRACE(("Workspace: Tiling %ld windows vertically\n", (LONG)windowCount));
+    
+    /* Calculate window dimensions - prevent division by zero */
+    if (windowCount == 0) {
+        LOG_ERROR(("Workspace: ERROR - windowCount is 0, returning early\n"));
+        return;
+    }
+    
+    windowWidth = screenWidth;
+    windowHeight = usableHeight / windowCount;
+    if (windowHeight == 0) {
+        LOG_ERROR(("Workspace: ERROR - calculated windowHeight is 0, returning early\n"));
+        return;
+    }
+    windowLeft = 0;
+    
+    /* Tile windows */
+    for (i = 0; i < windowCount; i++) {
+        windowTop = titleBarHeight + (i * windowHeight);
+        
+        /* For resizable windows, resize them */
+        if (windows[i].isResizable) {
+            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
+        } else {
+            /* For fixed-size windows, just move them */
+            MoveWindow(windows[i].window, windowLeft - windows[i].window->LeftEdge, 
+                      windowTop - windows[i].window->TopEdge);
+        }
+    }
+}
+
+/* Tile windows in a grid layout */
+VOID TileWindowsGrid(VOID)
+{
+    struct WindowInfo windows[32];
+    WORD windowCount;
+    WORD i;
+    WORD screenWidth;
+    WORD screenHeight;
+    WORD titleBarHeight;
+    WORD windowWidth;
+    WORD windowHeight;
+    WORD windowTop;
+    WORD windowLeft;
+    WORD shellHeight = 0;
+    WORD usableHeight;
+    WORD cols;
+    WORD rows;
+    WORD col;
+    WORD row;
+    
+    if (!currentDesktop->workspaceScreen) {
+        return;
+    }
+    
+    /* Get screen dimensions */
+    screenWidth = currentDesktop->workspaceScreen->Width;
+    screenHeight = currentDesktop->workspaceScreen->Height;
+    titleBarHeight = currentDesktop->workspaceScreen->BarHeight + 1;
+    
+    /* Account for shell window at bottom if open */
+    if (currentDesktop->shellWindow && currentDesktop->shellEnabled) {
+        shellHeight = 200;  /* Shell window height */
+    }
+    
+    usableHeight = screenHeight - titleBarHeight - shellHeight;
+    
+    /* Get all visitor windows (excluding backdrop, excluding shell) */
+    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    
+    if (windowCount == 0) {
+        LOG_TRACE(("Workspace: No windows to tile\n"));
+        return;
+    }
+    
+    LOG_TRACE(("Workspace: Tiling %ld windows in grid\n", (LONG)windowCount));
+    
+    /* Calculate grid dimensions (aim for roughly square grid) */
+    cols = (WORD)((windowCount + 1) / 2);  /* Roughly square */
+    if (cols == 0) cols = 1;
+    rows = (windowCount + cols - 1) / cols;  /* Ceiling division */
+    if (rows == 0) rows = 1;
+    
+    windowWidth = screenWidth / cols;
+    windowHeight = usableHeight / rows;
+    
+    /* Validate calculated dimensions */
+    if (windowWidth == 0 || windowHeight == 0) {
+        LOG_ERROR(("Workspace: ERROR - Invalid grid dimensions (windowWidth=%ld, windowHeight=%ld, cols=%ld, rows=%ld)\n",
+                   (LONG)windowWidth, (LONG)windowHeight, (LONG)cols, (LONG)rows));
+        return;
+    }
+    
+    LOG_TRACE(("Workspace: Grid layout - cols=%ld, rows=%ld, windowWidth=%ld, windowHeight=%ld\n",
+               (LONG)cols, (LONG)rows, (LONG)windowWidth, (LONG)windowHeight));
+    
+    /* Tile windows in grid */
+    for (i = 0; i < windowCount; i++) {
+        /* Safety check */
+        if (windows[i].window == NULL) {
+            LOG_ERROR(("Workspace: ERROR - window[%ld] is NULL, skipping\n", (LONG)i));
+            continue;
+        }
+        
+        row = i / cols;
+        col = i % cols;
+        
+        windowLeft = col * windowWidth;
+        windowTop = titleBarHeight + (row * windowHeight);
+        
+        LOG_TRACE(("Workspace: Tiling window %ld of %ld (row=%ld, col=%ld, left=%ld, top=%ld, width=%ld, height=%ld)\n",
+                   (LONG)(i + 1), (LONG)windowCount, (LONG)row, (LONG)col, 
+                   (LONG)windowLeft, (LONG)windowTop, (LONG)windowWidth, (LONG)windowHeight));
+        
+        /* Validate window pointer and dimensions before operations */
+        if (windows[i].window == NULL) {
+            LOG_ERROR(("Workspace: ERROR - window[%ld] is NULL, skipping\n", (LONG)i));
+            continue;
+        }
+        
+        /* Validate dimensions are positive */
+        if (windowWidth <= 0 || windowHeight <= 0) {
+            LOG_ERROR(("Workspace: ERROR - Invalid dimensions for window[%ld] (width=%ld, height=%ld), skipping\n",
+                       (LONG)i, (LONG)windowWidth, (LONG)windowHeight));
+            continue;
+        }
+        
+        /* Validate window is on our screen */
+        if (windows[i].window->WScreen != currentDesktop->workspaceScreen) {
+            LOG_ERROR(("Workspace: ERROR - window[%ld] is not on workspace screen, skipping\n", (LONG)i));
+            continue;
+        }
+        
+        /* For resizable windows, resize them */
+        if (windows[i].isResizable) {
+            LOG_TRACE(("Workspace: Calling ChangeWindowBox for window %ld\n", (LONG)i));
+            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
+            LOG_TRACE(("Workspace: ChangeWindowBox completed for window %ld\n", (LONG)i));
+        } else {
+            /* For fixed-size windows, just move them */
+            /* Calculate delta values */
+            {
+                WORD deltaX = windowLeft - windows[i].window->LeftEdge;
+                WORD deltaY = windowTop - windows[i].window->TopEdge;
+                LOG_TRACE(("Workspace: Calling MoveWindow for window %ld (deltaX=%ld, deltaY=%ld)\n", 
+                           (LONG)i, (LONG)deltaX, (LONG)deltaY));
+                MoveWindow(windows[i].window, deltaX, deltaY);
+                LOG_TRACE(("Workspace: MoveWindow completed for window %ld\n", (LONG)i));
+            }
+        }
+    }
+    
+    LOG_TRACE(("Workspace: Finished tiling all %ld windows in grid\n", (LONG)windowCount));
+}
+
+/* Cascade windows */
+VOID CascadeWindows(VOID)
+{
+    struct WindowInfo windows[32];
+    WORD windowCount;
+    WORD i;
+    WORD screenWidth;
+    WORD screenHeight;
+    WORD titleBarHeight;
+    WORD windowTop;
+    WORD windowLeft;
+    WORD shellHeight = 0;
+    WORD usableHeight;
+    WORD cascadeOffset = 30;  /* Offset for cascade effect */
+    
+    if (!currentDesktop->workspaceScreen) {
+        return;
+    }
+    
+    /* Get screen dimensions */
+    screenWidth = currentDesktop->workspaceScreen->Width;
+    screenHeight = currentDesktop->workspaceScreen->Height;
+    titleBarHeight = currentDesktop->workspaceScreen->BarHeight + 1;
+    
+    /* Account for shell window at bottom if open */
+    if (currentDesktop->shellWindow && currentDesktop->shellEnabled) {
+        shellHeight = 200;  /* Shell window height */
+    }
+    
+    usableHeight = screenHeight - titleBarHeight - shellHeight;
+    
+    /* Get all visitor windows (excluding backdrop, excluding shell) */
+    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    
+    if (windowCount == 0) {
+        LOG_TRACE(("Workspace: No windows to cascade\n"));
+        return;
+    }
+    
+    LOG_TRACE(("Workspace: Cascading %ld windows\n", (LONG)windowCount));
+    
+    /* Cascade windows with offset */
+    for (i = 0; i < windowCount; i++) {
+        windowLeft = i * cascadeOffset;
+        windowTop = titleBarHeight + (i * cascadeOffset);
+        
+        /* Make sure windows don't go off screen */
+        if (windowLeft + windows[i].window->Width > screenWidth) {
+            windowLeft = screenWidth - windows[i].window->Width;
+        }
+        if (windowTop + windows[i].window->Height > screenHeight - shellHeight) {
+            windowTop = screenHeight - shellHeight - windows[i].window->Height;
+        }
+        
+        /* Move window to cascade position */
+        MoveWindow(windows[i].window, windowLeft - windows[i].window->LeftEdge, 
+                  windowTop - windows[i].window->TopEdge);
+    }
+}
+
+/* Maximize all windows */
+VOID MaximizeAllWindows(VOID)
+{
+    struct WindowInfo windows[32];
+    WORD windowCount;
+    WORD i;
+    WORD screenWidth;
+    WORD screenHeight;
+    WORD titleBarHeight;
+    WORD windowTop;
+    WORD windowLeft;
+    WORD windowWidth;
+    WORD windowHeight;
+    WORD shellHeight = 0;
+    WORD usableHeight;
+    
+    if (!currentDesktop->workspaceScreen) {
+        return;
+    }
+    
+    /* Get screen dimensions */
+    screenWidth = currentDesktop->workspaceScreen->Width;
+    screenHeight = currentDesktop->workspaceScreen->Height;
+    titleBarHeight = currentDesktop->workspaceScreen->BarHeight + 1;
+    
+    /* Account for shell window at bottom if open */
+    if (currentDesktop->shellWindow && currentDesktop->shellEnabled) {
+        shellHeight = 200;  /* Shell window height */
+    }
+    
+    usableHeight = screenHeight - titleBarHeight - shellHeight;
+    
+    /* Get all visitor windows (excluding backdrop, excluding shell) */
+    windowCount = GetVisitorWindows(windows, 32, TRUE);
+    
+    if (windowCount == 0) {
+        LOG_TRACE(("Workspace: No windows to maximize\n"));
+        return;
+    }
+    
+    LOG_TRACE(("Workspace: Maximizing %ld windows\n", (LONG)windowCount));
+    
+    windowLeft = 0;
+    windowTop = titleBarHeight;
+    windowWidth = screenWidth;
+    windowHeight = usableHeight;
+    
+    /* Maximize all resizable windows */
+    for (i = 0; i < windowCount; i++) {
+        if (windows[i].isResizable) {
+            ChangeWindowBox(windows[i].window, windowLeft, windowTop, windowWidth, windowHeight);
+        }
+    }
+}
+
+/* Handle Windows menu items */
+VOID HandleWindowsMenu(ULONG itemNumber)
+{
+    LOG_TRACE(("Workspace: HandleWindowsMenu called with itemNumber=%lu\n", itemNumber));
+    
+    switch (itemNumber) {
+        case 0:  /* Tile Horizontally */
+            LOG_TRACE(("Workspace: Calling TileWindowsHorizontally\n"));
+            TileWindowsHorizontally();
+            LOG_TRACE(("Workspace: TileWindowsHorizontally returned\n"));
+            break;
+        
+        case 1:  /* Tile Vertically */
+            LOG_TRACE(("Workspace: Calling TileWindowsVertically\n"));
+            TileWindowsVertically();
+            LOG_TRACE(("Workspace: TileWindowsVertically returned\n"));
+            break;
+        
+        case 2:  /* Grid Layout */
+            LOG_TRACE(("Workspace: Calling TileWindowsGrid\n"));
+            TileWindowsGrid();
+            LOG_TRACE(("Workspace: TileWindowsGrid returned\n"));
+            break;
+        
+        default:
+            LOG_WARN(("Workspace: Unknown Windows menu item: %lu\n", itemNumber));
+            break;
+    }
+    
+    LOG_TRACE(("Workspace: HandleWindowsMenu returning\n"));
+}
+
+/* Handle Theme menu items */
+VOID HandleThemeMenu(ULONG itemNumber)
+{
+    LOG_TRACE(("Workspace: HandleThemeMenu called with itemNumber=%lu\n", itemNumber));
+    
+    /* itemNumber is the theme index (0-4) */
+    if (itemNumber < THEME_COUNT) {
+        if (itemNumber == currentDesktop->currentTheme) {
+            LOG_TRACE(("Workspace: Theme already active, ignoring\n"));
+            return;
+        }
+        LOG_TRACE(("Workspace: Applying theme %lu: %s\n", itemNumber, themeNames[itemNumber]));
+        if (ApplyTheme(itemNumber)) {
+            currentDesktop->currentTheme = itemNumber;
+            LOG_INFO(("Workspace: Theme applied successfully\n"));
+        } else {
+            LOG_ERROR(("Workspace: ERROR - Failed to apply theme\n"));
+        }
+    } else {
+        LOG_WARN(("Workspace: Unknown theme index: %lu\n", itemNumber));
+    }
+}
+
+/* Apply color theme to screen */
+BOOL ApplyTheme(ULONG themeIndex)
+{
+    struct ColorMap *colorMap;
+    ULONG numColors;
+    ULONG i;
+    UBYTE r, g, b;
+    ULONG srcR, srcG, srcB;
+    ULONG brightness;
+    ULONG invertedBrightness;
+    ULONG gray;
+    
+    if (!currentDesktop->workspaceScreen) {
+        LOG_ERROR(("Workspace: ERROR - No screen available for theme\n"));
+        return FALSE;
+    }
+    
+    colorMap = currentDesktop->workspaceScreen->ViewPort.ColorMap;
+    if (!colorMap) {
+        LOG_ERROR(("Workspace: ERROR - No ColorMap available\n"));
+        return FALSE;
+    }
+    
+    /* Dropped by ShedPalettes - while Like Workbench is on, the screen still shows it */
+    if (!currentDesktop->originalRGB && currentDesktop->currentTheme == THEME_LIKE_WORKBENCH) {
+        CapturePalette(currentDesktop->workspaceScreen);
+    }
+    
+    /* Always base themes on the original palette captured at screen open */
+    if (!currentDesktop->originalRGB) {
+        LOG_ERROR(("Workspace: ERROR - No original palette captured\n"));
+        return FALSE;
+    }
+    numColors = currentDesktop->numColors;
+    if (numColors == 0 || numColors > 256) {
+        LOG_ERROR(("Workspace: ERROR - Invalid numColors in original palette: %lu\n", numColors));
+        return FALSE;
+    }
+    
+    LOG_TRACE(("Workspace: Applying theme %lu to screen with %lu colors\n", themeIndex, numColors));
+    
+    /* Like Workbench restores the original palette captured at open */
+    if (themeIndex == THEME_LIKE_WORKBENCH) {
+        for (i = 0; i < numColors; i++) {
+            srcR = currentDesktop->originalRGB[i * 3];
+            srcG = currentDesktop->originalRGB[i * 3 + 1];
+            srcB = currentDesktop->originalRGB[i * 3 + 2];
+            SetRGB32(&currentDesktop->workspaceScreen->ViewPort, i,
+                     RGB32_GUN(srcR), RGB32_GUN(srcG), RGB32_GUN(srcB));
+        }
+        LOG_TRACE(("Workspace: Restored original palette\n"));
+        return TRUE;
+    }
+    
+    /* Apply theme colors based on theme index */
+    for (i = 0; i < numColors; i++) {
+        /* Source color always from original palette (stable baseline) */
+        srcR = currentDesktop->originalRGB[i * 3];
+        srcG = currentDesktop->originalRGB[i * 3 + 1];
+        srcB = currentDesktop->originalRGB[i * 3 + 2];
+        r = (UBYTE)srcR;
+        g = (UBYTE)srcG;
+        b = (UBYTE)srcB;
+        
+        switch (themeIndex) {
+            case THEME_DARK_MODE:
+                /* Dark mode: invert colors and reduce brightness */
+                brightness = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
+                invertedBrightness = 255 - brightness;
+                /* Scale to dark range (0-128) */
+                r = (UBYTE)((invertedBrightness * 128) / 255);
+                g = (UBYTE)((invertedBrightness * 128) / 255);
+                b = (UBYTE)((invertedBrightness * 128) / 255);
+                break;
+            
+            case THEME_SEPIA:
+                /* Sepia: warm brown tones */
+                gray = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
+                r = (UBYTE)((gray * 240) / 255);  /* Warm red */
+                g = (UBYTE)((gray * 220) / 255);  /* Warm green */
+                b = (UBYTE)((gray * 180) / 255); /* Warm blue (reduced) */
+                break;
+            
+            case THEME_BLUE:
+                /* Blue theme: cool blue tones */
+                gray = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
+                r = (UBYTE)((gray * 180) / 255);  /* Reduced red */
+                g = (UBYTE)((gray * 200) / 255);  /* Slightly reduced green */
+                b = (UBYTE)((gray * 240) / 255);  /* Enhanced blue */
+                break;
+            
+            case THEME_GREEN:
+                /* Green theme: natural green tones */
+                gray = ((ULONG)r + (ULONG)g + (ULONG)b) / 3;
+                r = (UBYTE)((gray * 200) / 255);  /* Slightly reduced red */
+                g = (UBYTE)((gray * 240) / 255);  /* Enhanced green */
+                b = (UBYTE)((gray * 200) / 255);  /* Slightly reduced blue */
+                break;
+            
+            default:
+                /* Keep original color */
+                break;
+        }
+        
+        /* Set the color using SetRGB32 */
+        SetRGB32(&currentDesktop->workspaceScreen->ViewPort, i, RGB32_GUN(r), RGB32_GUN(g), RGB32_GUN(b));
+    }
+    
+    LOG_TRACE(("Workspace: Theme applied to %lu colors\n", numColors));
+    return TRUE;
+}
+
+VOID HandleShellConsoleMenu(VOID)
+{
+    /* Toggle shell console - create it if not already enabled */
+    if (!currentDesktop->shellEnabled) {
+        /* Enable shell console */
+        currentDesktop->shellEnabled = TRUE;
+        
+        /* Free backdrop image if loaded (shell and backdrop are mutually exclusive) */
+        if (currentDesktop->backdropImageObj) {
+            FreeBackdropImage();
+        }
+        
+        /* Create shell console */
+        if (!CreateShellConsole()) {
+            LOG_ERROR(("Workspace: ERROR - Failed to create shell console\n"));
+            currentDesktop->shellEnabled = FALSE;
+        } else {
+            LOG_INFO(("Workspace: Shell console enabled\n"));
+        }
+    } else {
+        /* Shell is already enabled - just inform user */
+        LOG_TRACE(("Workspace: Shell console is already running\n"));
+    }
+}
+
+/* Check visitor count for the current desktop's screen */
+/* Returns the number of visitor windows (0 if none, or if error) */
+/* psn_VisitorCount only counts windows from other processes - our backdrop window */
+/* (absent when headless) is not a visitor */
+WORD CheckWorkspaceVisitors(VOID)
+{
+    /* Straight from the screen's PubScreenNode, no list walk */
+    /* Don't log here - let caller log with context */
+    return RegistryVisitors(currentDesktop->registryEntry);
+}
+
+/* Close the current desktop - the last one to close ends Workspace */
+/* Returns TRUE if it will close, FALSE if blocked by visitors */
+BOOL HandleCloseMenu(VOID)
+{
+    WORD visitorCount;
+    
+    /* Check for visitor windows before allowing close */
+    LOG_TRACE(("Workspace: HandleCloseMenu called - checking for visitors...\n"));
+    visitorCount = CheckWorkspaceVisitors();
+    LOG_TRACE(("Workspace: Visitor count: %ld\n", (LONG)visitorCount));
+    
+    if (visitorCount > 0) {
+        LOG_TRACE(("Workspace: Visitors detected (%ld windows) - showing warning dialog\n", (LONG)visitorCount));
+        ShowVisitorRequester(visitorCount);
+        return FALSE;
+    }
+    
+    /* No visitors - the event loop closes the desktop once the batch has run */
+    LOG_TRACE(("Workspace: No visitors detected - closing %s\n", currentDesktop->workspaceName));
+    currentDesktop->closeRequested = TRUE;
+    return TRUE;
+}
+
+/* Tell the user why the current desktop cannot close */
+VOID ShowVisitorRequester(WORD otherWindows)
+{
+    struct EasyStruct es;
+    char textBuffer[256];
+    struct Window *reqWindow;
+    
+    if (otherWindows == 1) {
+        SNPrintf(textBuffer, sizeof(textBuffer), 
+                 "Cannot close %s.\n\nThere is 1 window open on this screen.\n\nPlease close all windows and try again.",
+                 currentDesktop->workspaceName);
+    } else {
+        SNPrintf(textBuffer, sizeof(textBuffer), 
+                 "Cannot close %s.\n\nThere are %ld windows open on this screen.\n\nPlease close all windows and try again.", 
+                 currentDesktop->workspaceName, (LONG)otherWindows);
+    }
+    
+    es.es_StructSize = sizeof(struct EasyStruct);
+    es.es_Flags = 0;
+    es.es_Title = "Cannot Close Workspace";
+    es.es_TextFormat = textBuffer;
+    es.es_GadgetFormat = "OK";
+    
+    /* Ensure our screen is in front and use a valid window on our screen */
+    if (currentDesktop->workspaceScreen) {
+        ScreenToFront(currentDesktop->workspaceScreen);
+    }
+    reqWindow = currentDesktop->backdropWindow;
+    if (reqWindow == NULL || reqWindow->WScreen != currentDesktop->workspaceScreen) {
+        if (currentDesktop->workspaceScreen && currentDesktop->workspaceScreen->FirstWindow) {
+            reqWindow = currentDesktop->workspaceScreen->FirstWindow;
+        }
+    }
+    OpenRequester(reqWindow, &es);
+}
+
+/* Tell the user the current desktop's shell has to end before it can close */
+VOID ShowShellRequester(VOID)
+{
+    struct EasyStruct es;
+    char textBuffer[256];
+    
+    SNPrintf(textBuffer, sizeof(textBuffer),
+             "Cannot close %s.\n\nIts shell is still running.\n\nPlease end the shell (EndCLI) and try again.",
+             currentDesktop->workspaceName);
+    
+    es.es_StructSize = sizeof(struct EasyStruct);
+    es.es_Flags = 0;
+    es.es_Title = "Cannot Close Workspace";
+    es.es_TextFormat = textBuffer;
+    es.es_GadgetFormat = "OK";
+    
+    if (currentDesktop->workspaceScreen) {
+        ScreenToFront(currentDesktop->workspaceScreen);
+    }
+    OpenRequester(currentDesktop->backdropWindow, &es);
+}
+
+VOID HandleDefaultPubScreenSubMenu(STRPTR screenName)
+{
+    if (screenName == NULL) {
+        /* Workbench (NULL) */
+        SetDefaultPubScreen(NULL);
+        LOG_INFO(("Workspace: Set Workbench as default pubscreen\n"));
+    } else {
+        /* Workspace.n screen */
+        struct Desktop *desktop = FindDesktop(screenName);
+        struct Desktop *previous = currentDesktop;
+        
+        /* Windows will open on it from now on - a reserved desktop needs its screen */
+        if (desktop && desktop->workspaceScreen == NULL) {
+            if (!MaterializeDesktop(desktop, FALSE)) {
+                LOG_ERROR(("Workspace: ERROR - Failed to open %s, default pubscreen unchanged\n", screenName));
+                currentDesktop = previous;
+                return;
+            }
+            /* Stay on the desktop the menu was used on */
+            currentDesktop = previous;
+            if (currentDesktop && currentDesktop->workspaceScreen) {
+                ScreenToFront(currentDesktop->workspaceScreen);
+                SetFrontDesktop(currentDesktop);
+            }
+        }
+        SetDefaultPubScreen(screenName);
+        LOG_INFO(("Workspace: Set as default pubscreen: %s\n", screenName));
+    }
+}
+
+/* Run a command - seconds/micros is the timestamp of the input event that triggered it */
+/* Returns TRUE when Workspace should quit */
+BOOL RunCommand(struct WsCommand *command, ULONG seconds, ULONG micros)
+{
+    struct LatencyProbe probe;
+    BOOL quit;
+    
+    LOG_TRACE(("Workspace: Running command: %s\n", command->name));
+    LatencyBegin(&probe, seconds, micros);
+    quit = command->handler(command);
+    LatencyEnd(&probe, command->latencyAction);
+    return quit;
+}
+
+/* Collect all pending window messages into batch, replying to each right away */
+/* Menu picks become commands; a command supersedes an earlier one of its group */
+/* picked on the same desktop */
+VOID DrainWindowPort(struct MsgPort *userPort, struct WindowBatch *batch)
+{
+    struct IntuiMessage *imsg;
+    
+    batch->full = FALSE;
+    batch->messageCount = 0;
+    batch->commandCount = 0;
+    
+    while (!batch->full && (imsg = (struct IntuiMessage *)GetMsg(userPort)) != NULL) {
+        ULONG imsgClass = imsg->Class;
+        UWORD menuCode = imsg->Code;
+        ULONG seconds = imsg->Seconds;
+        ULONG micros = imsg->Micros;
+        struct Desktop *desktop = (struct Desktop *)imsg->IDCMPWindow->UserData;
+        
+        /* Everything we need is copied - the menu strip is ours, not part of the message */
+        ReplyMsg((struct Message *)imsg);
+        batch->messageCount++;
+        
+        switch (imsgClass) {
+            case IDCMP_CLOSEWINDOW:
+                desktop->closeRequested = TRUE;
+                break;
+            
+            case IDCMP_REFRESHWINDOW:
+                /* Damage accumulates in the layer until RunWindowBatch refreshes */
+                desktop->needsRefresh = TRUE;
+                break;
+            
+            case IDCMP_ACTIVEWINDOW:
+                /* The desktop is in use again - RunWindowBatch rebuilds what was shed */
+                desktop->wasActivated = TRUE;
+                break;
+            
+            case IDCMP_MENUPICK:
+                while (menuCode != MENUNULL) {
+                    struct MenuItem *item = ItemAddress(desktop->menuStrip, menuCode);
+                    struct WsCommand *command;
+                    ULONG i;
+                    
+                    if (!item) {
+                        LOG_WARN(("Workspace: WARNING - ItemAddress returned NULL for menuCode=0x%x\n", menuCode));
+                        break;
+                    }
+                    menuCode = item->NextSelect;
+                    
+                    /* UserData is the command record set up by BuildDefaultPubScreenMenu */
+                    command = (struct WsCommand *)GTMENUITEM_USERDATA(item);
+                    if (!command) {
+                        LOG_WARN(("Workspace: WARNING - Menu item has no UserData\n"));
+                        continue;
+                    }
+                    
+                    /* Drop an earlier command of the same group, keeping the order of the rest */
+                    if (command->group != WSGROUP_NONE) {
+                        for (i = 0; i < batch->commandCount; i++) {
+                            if (batch->commands[i].command->group == command->group &&
+                                batch->commands[i].desktop == desktop) {
+                                LOG_TRACE(("Workspace: Command %s superseded by %s\n",
+                                           batch->commands[i].command->name, command->name));
+                                batch->commandCount--;
+                                if (i < batch->commandCount) {
+                                    CopyMem(&batch->commands[i + 1], &batch->commands[i],
+                                            sizeof(struct BatchedCommand) * (batch->commandCount - i));
+                                }
+                                break;
+                            }
+                        }
+                    }
+                    
+                    if (batch->commandCount < BATCH_MAX_COMMANDS) {
+                        batch->commands[batch->commandCount].command = command;
+                        batch->commands[batch->commandCount].desktop = desktop;
+                        batch->commands[batch->commandCount].seconds = seconds;
+                        batch->commands[batch->commandCount].micros = micros;
+                        batch->commandCount++;
+                    } else {
+                        LOG_WARN(("Workspace: WARNING - Too many menu selections, dropped %s\n", command->name));
+                    }
+                }
+                /* Leave the rest queued when another full multi-select might not fit */
+                if (batch->commandCount >= BATCH_MAX_COMMANDS / 2) {
+                    batch->full = TRUE;
+                }
+                break;
+            
+            default:
+                break;
+        }
+    }
+}
+
+/* Run a drained batch, each command on the desktop it was picked on */
+VOID RunWindowBatch(struct WindowBatch *batch)
+{
+    struct Desktop *desktop;
+    ULONG i;
+    
+    if (batch->messageCount > 1) {
+        LOG_TRACE(("Workspace: Window batch - %lu messages, %lu commands\n",
+                   batch->messageCount, batch->commandCount));
+    }
+    
+    for (i = 0; i < batch->commandCount; i++) {
+        desktop = batch->commands[i].desktop;
+        
+        /* Nothing more to do on a desktop that is about to close */
+        if (desktop->closeRequested || desktop->backdropWindow == NULL) {
+            continue;
+        }
+        currentDesktop = desktop;
+        RunCommand(batch->commands[i].command, batch->commands[i].seconds, batch->commands[i].micros);
+    }
+    
+    /* One refresh pass per desktop repairs the union of all damage reported in the batch */
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (desktop->wasActivated) {
+            desktop->wasActivated = FALSE;
+            currentDesktop = desktop;
+            if (wsState.frontDesktop != desktop) {
+                SetFrontDesktop(desktop);
+            }
+            RestoreShedResources();
+        }
+        if (desktop->needsRefresh) {
+            desktop->needsRefresh = FALSE;
+            currentDesktop = desktop;
+            RefreshBackdropWindow();
+        }
+    }
+}
+
+/* Repair damaged parts of the backdrop window (clipped to the damage by BeginRefresh) */
+VOID RefreshBackdropWindow(VOID)
+{
+    struct Window *window = currentDesktop->backdropWindow;
+    
+    if (window == NULL) {
+        return;
+    }
+    BeginRefresh(window);
+    if (currentDesktop->backdropImageObj) {
+        DrawDTObjectA(window->RPort, currentDesktop->backdropImageObj,
+                      0, 0, window->Width, window->Height,
+                      0, 0, TAG_DONE);
+    }
+    EndRefresh(window, TRUE);
+}
+
+/* Set default public screen - arg is the screen name, 0 for Workbench */
+BOOL CmdDefaultPubScreen(struct WsCommand *command)
+{
+    HandleDefaultPubScreenSubMenu((STRPTR)command->arg);
+    return FALSE;
+}
+
+BOOL CmdAbout(struct WsCommand *command)
+{
+    HandleAboutMenu();
+    return FALSE;
+}
+
+/* HandleCloseMenu closes the desktop only when no visitor windows are open */
+BOOL CmdQuit(struct WsCommand *command)
+{
+    BOOL allowQuit = HandleCloseMenu();
+    
+#if WS_LOG_LEVEL >= WS_LOG_TRACE
+    {
+        STRPTR returnStr;
+        if (allowQuit) {
+            returnStr = "TRUE";
+        } else {
+            returnStr = "FALSE";
+        }
+        LOG_TRACE(("Workspace: HandleCloseMenu returned %s\n", returnStr));
+    }
+#endif
+    return allowQuit;
+}
+
+BOOL CmdShell(struct WsCommand *command)
+{
+    HandleShellConsoleMenu();
+    return FALSE;
+}
+
+/* Arrange windows - arg is the Windows menu layout (0 = horizontal, 1 = vertical, 2 = grid) */
+BOOL CmdWindows(struct WsCommand *command)
+{
+    HandleWindowsMenu(command->arg);
+    return FALSE;
+}
+
+/* Apply theme - arg is the theme index */
+BOOL CmdTheme(struct WsCommand *command)
+{
+    HandleThemeMenu(command->arg);
+    return FALSE;
+}
+
+BOOL CmdScreenToFront(struct WsCommand *command)
+{
+    ShowDesktop();
+    return FALSE;
+}
+
+/* Next (arg 0) or previous (arg 1) desktop in the ring, wrapping around */
+BOOL CmdCycleDesktop(struct WsCommand *command)
+{
+    ULONG index;
+    
+    if (currentDesktop == NULL) {
+        return FALSE;
+    }
+    index = currentDesktop->ringIndex;
+    if (command->arg == 0) {
+        index++;
+        if (index >= wsState.desktopCount) {
+            index = 0;
+        }
+    } else {
+        if (index == 0) {
+            index = wsState.desktopCount;
+        }
+        index--;
+    }
+    SwitchDesktop(wsState.ring[index]);
+    return FALSE;
+}
+
+/* Desktop at ring position arg (0 = first opened) */
+BOOL CmdGotoDesktop(struct WsCommand *command)
+{
+    if (command->arg < wsState.desktopCount) {
+        SwitchDesktop(wsState.ring[command->arg]);
+    }
+    return FALSE;
+}
+
+/* Next (arg 0) or previous (arg 1) page of the Default PubScreen submenu */
+/* Later commands of the batch may still point into the current items, so the */
+/* new page is built by RefreshPubScreenMenus once the batch has run */
+BOOL CmdPubScreenPage(struct WsCommand *command)
+{
+    if (command->arg == 0) {
+        currentDesktop->pubScreenPage++;
+    } else if (currentDesktop->pubScreenPage > 0) {
+        currentDesktop->pubScreenPage--;
+    }
+    currentDesktop->menuDirty = TRUE;
+    return FALSE;
+}
+
+/* Make desktop current and bring it to front - opens its screen if it has none */
+VOID SwitchDesktop(struct Desktop *desktop)
+{
+    currentDesktop = desktop;
+    ShowDesktop();
+}
+
+/* Open another Workspace.n - from the warm spare if there is one */
+BOOL CmdNewDesktop(struct WsCommand *command)
+{
+    if (OpenDesktop(NULL, &wsState.defaultMode, TRUE) == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Failed to open new desktop\n"));
+    }
+    return FALSE;
+}
+
+/* Create a Default PubScreen command for a Workspace.n screen in the menu pool */
+/* The record lives as long as the menu generation, so the name can also serve as menu label */
+struct WsCommand *NewScreenCommand(STRPTR screenName)
+{
+    struct ScreenCommand *screenCommand;
+    ULONG nameLen = strlen((char *)screenName);
+    
+    screenCommand = AllocMenuMemory(sizeof(struct ScreenCommand) + nameLen);
+    if (!screenCommand) {
+        return NULL;
+    }
+    strcpy((char *)screenCommand->screenName, (char *)screenName);
+    screenCommand->command.name = screenCommand->screenName;
+    screenCommand->command.handler = CmdDefaultPubScreen;
+    screenCommand->command.arg = (ULONG)screenCommand->screenName;
+    screenCommand->command.latencyAction = LATENCY_MENU;
+    screenCommand->command.group = WSGROUP_PUBSCREEN;
+    return &screenCommand->command;
+}
+
+/* Free the current desktop's menu generation in one go - only once its menu strip */
+/* no longer uses it */
+VOID FreeMenuPool(VOID)
+{
+    if (currentDesktop->menuPool) {
+        DeletePool(currentDesktop->menuPool);
+        currentDesktop->menuPool = NULL;
+        MemCharge(MEMACCT_MENUS, MEMF_ANY, -(LONG)currentDesktop->menuPoolBytes);
+        currentDesktop->menuPoolBytes = 0;
+    }
+}
+
+/* Allocate from the current desktop's menu pool, charging MEMACCT_MENUS until the */
+/* pool goes */
+APTR AllocMenuMemory(ULONG size)
+{
+    APTR memory;
+    
+    if (currentDesktop->menuPool == NULL) {
+        return NULL;
+    }
+    memory = AllocPooled(currentDesktop->menuPool, size);
+    if (memory != NULL) {
+        currentDesktop->menuPoolBytes += size;
+        MemCharge(MEMACCT_MENUS, MEMF_ANY, size);
+    }
+    return memory;
+}
+
+/* Build the menu structure in the menu pool - the fixed templates are copied around */
+/* the Default PubScreen sub-items, which list the registered screens. FreeMenuPool frees it. */
+struct NewMenu *BuildDefaultPubScreenMenu(VOID)
+{
+    struct NewMenu *newMenu = NULL;
+    struct NewMenu *tail;
+    ULONG count = 0;
+    
+    /* Allocate menu array - fixed parts plus a full page of sub-items */
+    newMenu = AllocMenuMemory(sizeof(struct NewMenu) * (MENU_HEAD_ENTRIES + PUBSCREEN_MAX_ITEMS + MENU_TAIL_ENTRIES));
+    if (!newMenu) {
+        LOG_ERROR(("Workspace: ERROR - Failed to allocate menu array\n"));
+        return NULL;
+    }
+    
+    CopyMem((APTR)menuHead, newMenu, sizeof(menuHead));
+    
+    /* Workbench and the Workspace screens as sub-items */
+    count = BuildPubScreenItems(&newMenu[MENU_HEAD_ENTRIES], PUBSCREEN_MAX_ITEMS);
+    
+    /* Rest of the Workspace menu, Windows and Prefs - mark the current theme */
+    tail = &newMenu[MENU_HEAD_ENTRIES + count];
+    CopyMem((APTR)menuTail, tail, sizeof(menuTail));
+    tail[MENU_TAIL_THEMES + currentDesktop->currentTheme].nm_Flags |= CHECKED;
+    
+    LOG_TRACE(("Workspace: Built menu with %lu items (%lu Default PubScreen entries, 3 menus)\n", MENU_HEAD_ENTRIES + count + MENU_TAIL_ENTRIES, count));
+    return newMenu;
+}
+
+/* Fill in the Default PubScreen sub-items - Workbench, this desktop's screen, then */
+/* the desktop's page of the other registered Workspace screens, with the current */
+/* default checked, then the page switches that apply */
+/* Returns the number of entries used, at most maxItems */
+ULONG BuildPubScreenItems(struct NewMenu *items, ULONG maxItems)
+{
+    struct RegistryEntry *entry;
+    struct WsCommand *command;
+    UBYTE defaultName[MAXPUBSCREENNAME + 1];
+    ULONG count = 0;
+    ULONG checkCount;
+    ULONG others;
+    ULONG first;
+    ULONG skipped = 0;
+    BOOL more = FALSE;
+    ULONG i;
+    
+    GetDefaultPubScreen(defaultName);
+    
+    AddPubScreenItem(&items[count], &wsCommands[WSCMD_PUBSCREEN_WORKBENCH], defaultName);
+    count++;
+    
+    ObtainSemaphoreShared(&registry->semaphore);
+    others = registry->screenCount;
+    entry = currentDesktop->registryEntry;
+    if (entry) {
+        others--;
+        command = NewScreenCommand(entry->name);
+        if (command) {
+            AddPubScreenItem(&items[count], command, defaultName);
+            count++;
+        }
+    }
+    
+    /* Screens went away since the page was picked - show the last page there is */
+    first = currentDesktop->pubScreenPage * PUBSCREEN_PAGE_SIZE;
+    if (first >= others && first > 0) {
+        if (others == 0) {
+            currentDesktop->pubScreenPage = 0;
+        } else {
+            currentDesktop->pubScreenPage = (others - 1) / PUBSCREEN_PAGE_SIZE;
+        }
+        first = currentDesktop->pubScreenPage * PUBSCREEN_PAGE_SIZE;
+    }
+    
+    for (entry = (struct RegistryEntry *)registry->screens.mlh_Head;
+         entry->node.mln_Succ != NULL;
+         entry = (struct RegistryEntry *)entry->node.mln_Succ) {
+        /* Skip our own screen, already added */
+        if (entry == currentDesktop->registryEntry) {
+            continue;
+        }
+        if (skipped < first) {
+            skipped++;
+            continue;
+        }
+        if (count >= maxItems - 2 || count >= 2 + PUBSCREEN_PAGE_SIZE) {
+            more = TRUE;
+            break;
+        }
+        /* Command record holds a persistent copy of the name, used as label too */
+        command = NewScreenCommand(entry->name);
+        if (command) {
+            AddPubScreenItem(&items[count], command, defaultName);
+            count++;
+        }
+    }
+    currentDesktop->menuChangeCount = registry->changeCount;
+    ReleaseSemaphore(&registry->semaphore);
+    
+    /* Each screen item excludes all other screen items - bit i is sub-item i */
+    checkCount = count;
+    for (i = 0; i < checkCount; i++) {
+        items[i].nm_MutualExclude = ((1UL << checkCount) - 1) & ~(1UL << i);
+    }
+    
+    /* Page switches - plain items, outside the mutual exclude */
+    if (more) {
+        items[count].nm_Type = NM_SUB;
+        items[count].nm_Label = "More Screens >>";
+        items[count].nm_UserData = &wsCommands[WSCMD_PUBSCREEN_NEXT_PAGE];
+        count++;
+    }
+    if (currentDesktop->pubScreenPage > 0) {
+        items[count].nm_Type = NM_SUB;
+        items[count].nm_Label = "<< Previous Screens";
+        items[count].nm_UserData = &wsCommands[WSCMD_PUBSCREEN_PREV_PAGE];
+        count++;
+    }
+    return count;
+}
+
+/* One Default PubScreen sub-item - arg of the command is the screen name, 0 for Workbench */
+VOID AddPubScreenItem(struct NewMenu *item, struct WsCommand *command, STRPTR defaultName)
+{
+    STRPTR name = (STRPTR)command->arg;
+    
+    if (name == NULL) {
+        name = "Workbench";
+    }
+    item->nm_Type = NM_SUB;
+    item->nm_Label = name;
+    item->nm_CommKey = NULL;
+    item->nm_Flags = CHECKIT;
+    if (strcmp((char *)name, (char *)defaultName) == 0) {
+        item->nm_Flags |= CHECKED;
+    }
+    item->nm_MutualExclude = 0;  /* Set once the number of items is known */
+    item->nm_UserData = command;
+}
+
+/* Bring the Default PubScreen submenus up to date - called from the main loop, between */
+/* window batches, so no queued command points into the items being freed. Items are */
+/* rebuilt when dirty; otherwise only the checkmark may move, as someone else can call */
+/* SetDefaultPubScreen. No IDCMP_MENUVERIFY - it would hold the menus of every window */
+/* on the screen until we reply. */
+VOID RefreshPubScreenMenus(VOID)
+{
+    struct Desktop *previous = currentDesktop;
+    struct Desktop *desktop;
+    
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (desktop->menuStrip == NULL || desktop->backdropWindow == NULL) {
+            continue;
+        }
+        if (desktop->menuChangeCount != registry->changeCount) {
+            desktop->menuDirty = TRUE;
+        }
+        currentDesktop = desktop;
+        /* "Default PubScreen" is the first item of the first menu */
+        if (!desktop->menuDirty) {
+            SyncPubScreenChecks(desktop->menuStrip->FirstItem);
+            continue;
+        }
+        LOG_TRACE(("Workspace: Rebuilding Default PubScreen submenu of %s\n", desktop->workspaceName));
+        if (RebuildPubScreenItems(desktop->menuStrip->FirstItem)) {
+            desktop->menuDirty = FALSE;
+        }
+    }
+    currentDesktop = previous;
+}
+
+/* Replace the sub-items of parent with a fresh set, laying out only the Workspace menu */
+/* The new items are made by CreateMenus on a scratch strip and swapped with the old */
+/* ones, so FreeMenus on the scratch strip frees the old items */
+BOOL RebuildPubScreenItems(struct MenuItem *parent)
+{
+    struct NewMenu newMenu[PUBSCREEN_MAX_ITEMS + 3];
+    struct Menu *scratch;
+    struct MenuItem *oldItems;
+    APTR oldPool;
+    ULONG oldPoolBytes;
+    APTR visInfo;
+    ULONG count;
+    BOOL rebuilt = FALSE;
+    struct MemProbe probe;
+    
+    memset(newMenu, 0, sizeof(newMenu));
+    newMenu[0].nm_Type = NM_TITLE;
+    newMenu[0].nm_Label = "";
+    newMenu[1].nm_Type = NM_ITEM;
+    newMenu[1].nm_Label = "";
+    
+    /* A new generation - the old one stays valid until the old items are gone */
+    MemProbeBegin(&probe);
+    oldPool = currentDesktop->menuPool;
+    oldPoolBytes = currentDesktop->menuPoolBytes;
+    currentDesktop->menuPool = CreatePool(MEMF_ANY | MEMF_CLEAR, MENU_POOL_PUDDLE, MENU_POOL_THRESHOLD);
+    currentDesktop->menuPoolBytes = 0;
+    if (currentDesktop->menuPool == NULL) {
+        LOG_WARN(("Workspace: WARNING - No memory to rebuild Default PubScreen submenu\n"));
+        currentDesktop->menuPool = oldPool;
+        currentDesktop->menuPoolBytes = oldPoolBytes;
+        goto done;
+    }
+    count = BuildPubScreenItems(&newMenu[2], PUBSCREEN_MAX_ITEMS);
+    newMenu[2 + count].nm_Type = NM_END;
+    
+    scratch = CreateMenus(newMenu, TAG_DONE);
+    visInfo = GetVisualInfo(currentDesktop->workspaceScreen, TAG_END);
+    if (scratch == NULL || visInfo == NULL) {
+        LOG_WARN(("Workspace: WARNING - Could not rebuild Default PubScreen submenu\n"));
+        if (visInfo) {
+            FreeVisualInfo(visInfo);
+        }
+        if (scratch) {
+            FreeMenus(scratch);
+        }
+        FreeMenuPool();
+        currentDesktop->menuPool = oldPool;
+        currentDesktop->menuPoolBytes = oldPoolBytes;
+        goto done;
+    }
+    
+    ClearMenuStrip(currentDesktop->backdropWindow);
+    oldItems = parent->SubItem;
+    parent->SubItem = scratch->FirstItem->SubItem;
+    scratch->FirstItem->SubItem = oldItems;
+    LayoutMenuItems(currentDesktop->menuStrip->FirstItem, visInfo,
+                    GTMN_Menu, currentDesktop->menuStrip,
+                    GTMN_NewLookMenus, TRUE,
+                    TAG_END);
+    SetMenuStrip(currentDesktop->backdropWindow, currentDesktop->menuStrip);
+    
+    FreeVisualInfo(visInfo);
+    FreeMenus(scratch);
+    DeletePool(oldPool);
+    MemCharge(MEMACCT_MENUS, MEMF_ANY, -(LONG)oldPoolBytes);
+    rebuilt = TRUE;
+    LOG_TRACE(("Workspace: Default PubScreen submenu rebuilt with %lu entries\n", count));
+    
+done:
+    MemProbeEnd(&probe, MEMACCT_MENUS);
+    return rebuilt;
+}
+
+/* Move the Default PubScreen checkmark to the current default public screen */
+/* It changes when someone else calls SetDefaultPubScreen */
+VOID SyncPubScreenChecks(struct MenuItem *parent)
+{
+    UBYTE defaultName[MAXPUBSCREENNAME + 1];
+    struct MenuItem *item;
+    struct WsCommand *command;
+    STRPTR name;
+    BOOL stale = FALSE;
+    
+    GetDefaultPubScreen(defaultName);
+    
+    /* Look for a wrong checkmark with the strip still attached - usually there is none */
+    for (item = parent->SubItem; item != NULL; item = item->NextItem) {
+        command = (struct WsCommand *)GTMENUITEM_USERDATA(item);
+        if (command->handler != CmdDefaultPubScreen) {
+            continue;  /* Page switch */
+        }
+        name = (STRPTR)command->arg;
+        if (name == NULL) {
+            name = "Workbench";
+        }
+        if (strcmp((char *)name, (char *)defaultName) == 0) {
+            if (!(item->Flags & CHECKED)) {
+                stale = TRUE;
+            }
+        } else if (item->Flags & CHECKED) {
+            stale = TRUE;
+        }
+    }
+    if (!stale) {
+        return;
+    }
+    
+    ClearMenuStrip(currentDesktop->backdropWindow);
+    for (item = parent->SubItem; item != NULL; item = item->NextItem) {
+        command = (struct WsCommand *)GTMENUITEM_USERDATA(item);
+        if (command->handler != CmdDefaultPubScreen) {
+            continue;
+        }
+        name = (STRPTR)command->arg;
+        if (name == NULL) {
+            name = "Workbench";
+        }
+        if (strcmp((char *)name, (char *)defaultName) == 0) {
+            item->Flags |= CHECKED;
+        } else {
+            item->Flags &= ~CHECKED;
+        }
+    }
+    ResetMenuStrip(currentDesktop->backdropWindow, currentDesktop->menuStrip);
+}
+
+/* Create menu strip and bring the desktop forward - MUST be called AFTER window is open */
+BOOL CreateMenuStrip(VOID)
+{
+    if (!AttachMenuStrip()) {
+        return FALSE;
+    }
+    
+    /* Activate window and refresh frame to make menu visible - a spare stays behind */
+    if (!currentDesktop->spare) {
+        ActivateWindow(currentDesktop->backdropWindow);
+    }
+    WindowToFront(currentDesktop->backdropWindow);
+    RefreshWindowFrame(currentDesktop->backdropWindow);
+    if (!currentDesktop->spare) {
+        ScreenToFront(currentDesktop->workspaceScreen);
+    }
+    
+    LOG_TRACE(("Workspace: Menu strip created and attached successfully\n"));
+    return TRUE;
+}
+
+/* Build the menu strip using GadTools and attach it to the backdrop window - leaves */
+/* window activation and screen depth alone */
+BOOL AttachMenuStrip(VOID)
+{
+    struct NewMenu *newMenu = NULL;
+    struct Menu *menuStrip = NULL;
+    struct VisualInfo *visInfo = NULL;
+    BOOL built = FALSE;
+    struct MemProbe probe;
+    
+    /* Window must exist */
+    if (!currentDesktop->backdropWindow) {
+        LOG_ERROR(("Workspace: ERROR - Window must exist before creating menu strip\n"));
+        return FALSE;
+    }
+    
+    LOG_TRACE(("Workspace: Creating menu strip using GadTools...\n"));
+    
+    /* Everything built for this strip comes from one pool, freed with it */
+    MemProbeBegin(&probe);
+    currentDesktop->menuPool = CreatePool(MEMF_ANY | MEMF_CLEAR, MENU_POOL_PUDDLE, MENU_POOL_THRESHOLD);
+    if (!currentDesktop->menuPool) {
+        LOG_ERROR(("Workspace: ERROR - Failed to create menu pool\n"));
+        goto done;
+    }
+    
+    /* Build menu structure dynamically */
+    newMenu = BuildDefaultPubScreenMenu();
+    if (!newMenu) {
+        LOG_ERROR(("Workspace: ERROR - Failed to build menu structure\n"));
+        goto done;
+    }
+    
+    /* Create menu strip from NewMenu array */
+    menuStrip = CreateMenus(newMenu, TAG_DONE);
+    if (!menuStrip) {
+        LOG_ERROR(("Workspace: ERROR - CreateMenus failed\n"));
+        goto done;
+    }
+    
+    /* Get visual info for layout (required for GadTools menus) */
+    visInfo = GetVisualInfo(currentDesktop->backdropWindow->WScreen, TAG_END);
+    if (!visInfo) {
+        LOG_ERROR(("Workspace: ERROR - GetVisualInfo failed\n"));
+        goto done;
+    }
+    
+    /* Layout menus with visual info */
+    if (!LayoutMenus(menuStrip, visInfo, 
+                     GTMN_NewLookMenus, TRUE,
+                     TAG_END)) {
+        LOG_ERROR(("Workspace: ERROR - LayoutMenus failed\n"));
+        goto done;
+    }
+    
+    /* Set menu strip on window */
+    if (!SetMenuStrip(currentDesktop->backdropWindow, menuStrip)) {
+        LOG_ERROR(("Workspace: ERROR - SetMenuStrip failed\n"));
+        goto done;
+    }
+    
+    /* Verify menu is actually attached to window */
+    if (currentDesktop->backdropWindow->MenuStrip != menuStrip) {
+        LOG_ERROR(("Workspace: ERROR - Menu strip not found in window structure!\n"));
+        goto done;
+    }
+    
+    LOG_TRACE(("Workspace: Menu strip verified in window (MenuStrip=0x%lx)\n", (ULONG)currentDesktop->backdropWindow->MenuStrip));
+    
+    /* Store menu strip */
+    currentDesktop->menuStrip = menuStrip;
+    currentDesktop->menusShed = FALSE;
+    currentDesktop->menuDirty = FALSE;
+    wsState.memExhausted = FALSE;
+    built = TRUE;
+    
+done:
+    /* Free visual info (no longer needed after LayoutMenus and SetMenuStrip) */
+    if (visInfo) {
+        FreeVisualInfo(visInfo);
+    }
+    if (!built) {
+        if (menuStrip) {
+            FreeMenus(menuStrip);
+        }
+        FreeMenuPool();
+    }
+    MemProbeEnd(&probe, MEMACCT_MENUS);
+    return built;
+}
+
+/* Free menu strip */
+VOID FreeMenuStrip(VOID)
+{
+    struct MemProbe probe;
+    
+    MemProbeBegin(&probe);
+    if (currentDesktop->menuStrip) {
+        /* Use FreeMenus() to properly free GadTools menu structure */
+        FreeMenus(currentDesktop->menuStrip);
+        currentDesktop->menuStrip = NULL;
+    }
+    FreeMenuPool();
+    MemProbeEnd(&probe, MEMACCT_MENUS);
+}
+
+/* Create shell backdrop window - separate from main backdrop */
+BOOL CreateShellWindow(VOID)
+{
+    ULONG screenWidth, screenHeight;
+    WORD windowTop;
+    WORD windowHeight = 200;  /* Fixed height: 200px at bottom */
+    
+    /* Prerequisites check */
+    if (!currentDesktop->workspaceScreen) {
+        LOG_WARN(("Workspace: Cannot create shell window - screen not available\n"));
+        return FALSE;
+    }
+    
+    /* Get screen dimensions */
+    screenWidth = currentDesktop->workspaceScreen->Width;
+    screenHeight = currentDesktop->workspaceScreen->Height;
+    
+    /* Handle case where screen dimensions might be 0 (use ViewPort dimensions) */
+    if (screenWidth == 0 && currentDesktop->workspaceScreen->ViewPort.DWidth > 0) {
+        screenWidth = currentDesktop->workspaceScreen->ViewPort.DWidth;
+        screenHeight = currentDesktop->workspaceScreen->ViewPort.DHeight;
+    }
+    
+    /* Calculate window position - at bottom of screen */
+    windowTop = screenHeight - windowHeight;
+    
+    /* Validate dimensions */
+    if (screenWidth <= 0 || windowHeight <= 0 || windowTop < 0) {
+        LOG_ERROR(("Workspace: ERROR - Invalid dimensions for shell window (Width=%lu, Height=%ld, Top=%ld)\n",
+                   screenWidth, (LONG)windowHeight, (LONG)windowTop));
+        return FALSE;
+    }
+    
+    LOG_TRACE(("Workspace: Creating shell window: Left=0, Top=%ld, Width=%lu, Height=%ld\n",
+               (LONG)windowTop, screenWidth, (LONG)windowHeight));
+    
+    /* Open shell backdrop window - positioned at bottom of screen */
+    currentDesktop->shellWindow = OpenWindowTags(NULL,
+        WA_Left, 0,
+        WA_Top, windowTop,
+        WA_Width, screenWidth,
+        WA_Height, windowHeight,
+        WA_CustomScreen, currentDesktop->workspaceScreen,
+        WA_Backdrop, TRUE,
+        WA_Borderless, TRUE,
+        WA_DragBar, FALSE,
+        WA_IDCMP, 0,  /* No IDCMP needed - shell will handle it */
+        WA_DetailPen, -1,
+        WA_BlockPen, -1,
+        WA_Activate, FALSE,
+        TAG_DONE);
+    
+    if (currentDesktop->shellWindow == NULL) {
+        LOG_ERROR(("Workspace: ERROR - Failed to open shell window (OpenWindowTags returned NULL)\n"));
+        return FALSE;
+    }
+    
+    LOG_TRACE(("Workspace: Shell window opened successfully: 0x%lx\n", (ULONG)currentDesktop->shellWindow));
+    LOG_TRACE(("Workspace: Shell window dimensions: LeftEdge=%ld, TopEdge=%ld, Width=%ld, Height=%ld\n",
+               (LONG)currentDesktop->shellWindow->LeftEdge, (LONG)currentDesktop->shellWindow->TopEdge,
+               (LONG)currentDesktop->shellWindow->Width, (LONG)currentDesktop->shellWindow->Height));
+    
+    return TRUE;
+}
+
+/* Create shell console */
+BOOL CreateShellConsole(VOID)
+{
+    STRPTR conspec = NULL;
+    UBYTE conspecBuffer[256];
+    UBYTE processName[80];
+    WORD windowWidth, windowHeight;
+    LONG result;
+    
+    /* Prerequisites check */
+    if (!currentDesktop->workspaceScreen || !currentDesktop->shellEnabled) {
+        LOG_WARN(("Workspace: Cannot create shell console - prerequisites not met\n"));
+        return FALSE;
+    }
+    /* The shell replaces the backdrop, a shed image is not reloaded behind it */
+    currentDesktop->backdropShed = FALSE;
+    
+    /* Signal for ShellExitCode - kept until Cleanup, shared by the shells of all desktops */
+    if (wsState.shellSigBit == -1) {
+        wsState.shellSigBit = AllocSignal(-1);
+        if (wsState.shellSigBit == -1) {
+            LOG_ERROR(("Workspace: ERROR - No free signal for shell exit notification\n"));
+            return FALSE;
+        }
+    }
+    currentDesktop->shellExited = FALSE;
+    
+    /* Create shell backdrop window if it doesn't exist */
+    if (!currentDesktop->shellWindow) {
+        if (!CreateShellWindow()) {
+            LOG_ERROR(("Workspace: ERROR - Failed to create shell window\n"));
+            return FALSE;
+        }
+    }
+    
+    /* Get dimensions from the shell window */
+    windowWidth = currentDesktop->shellWindow->Width;
+    windowHeight = currentDesktop->shellWindow->Height;
+    
+    /* Validate dimensions */
+    if (windowWidth <= 0 || windowHeight <= 0) {
+        LOG_ERROR(("Workspace: ERROR - Invalid dimensions for shell console (Width=%ld, Height=%ld)\n",
+                   (LONG)windowWidth, (LONG)windowHeight));
+        return FALSE;
+    }
+    
+    LOG_TRACE(("Workspace: Shell console dimensions - width=%ld, height=%ld\n",
+               (LONG)windowWidth, (LONG)windowHeight));
+    
+    /* Build CON: device specifier using WINDOW parameter */
+    /* According to RKM: WINDOW instructs the console to hijack an already open window */
+    /* Format: CON:x/y/width/height/title/WINDOW 0x<hex_address> */
+    if (wsState.shellPath && wsState.shellPath[0] != '\0') {
+        /* Use custom shell path */
+        SNPrintf(conspecBuffer, sizeof(conspecBuffer), wsState.shellPath, currentDesktop->workspaceName);
+        conspec = conspecBuffer;
+        currentDesktop->shellWindowDonated = FALSE;
+    } else {
+        /* Use default: CON:0/0/width/height//WINDOW 0x<hex_address> */
+        {
+            struct Window *win = currentDesktop->shellWindow;
+            ULONG windowAddr;
+            
+            /* Get window address */
+            windowAddr = (ULONG)win;
+            
+            /* Build CON: specifier */
+            SNPrintf(conspecBuffer, sizeof(conspecBuffer),
+                     "CON:0/0/%ld/%ld//WINDOW 0x%08lX",
+                     (LONG)windowWidth, (LONG)windowHeight, windowAddr);
+            conspec = conspecBuffer;
+            currentDesktop->shellWindowDonated = TRUE;
+            
+            LOG_TRACE(("Workspace: CON: specifier: '%s'\n", conspec));
+            LOG_TRACE(("Workspace: Shell window pointer: 0x%lx\n", windowAddr));
+        }
+    }
+    
+    LOG_TRACE(("Workspace: Creating shell console with CON: spec: %s\n", conspec));
+    
+    /* Ensure window is on the workspace screen and active before hijacking */
+    if (currentDesktop->shellWindow && currentDesktop->shellWindow->WScreen != currentDesktop->workspaceScreen) {
+        LOG_WARN(("Workspace: WARNING - Shell window is not on workspace screen!\n"));
+    }
+    
+    /* Activate window and bring to front */
+    if (currentDesktop->shellWindow) {
+        ActivateWindow(currentDesktop->shellWindow);
+        WindowToFront(currentDesktop->shellWindow);
+        ScreenToFront(currentDesktop->workspaceScreen);
+    }
+    
+    /* Use System() directly instead of NewShell command */
+    /* According to RKM: NewShell uses System() with SYS_InName pointing to CON: specifier */
+    /* Format: SystemTags(NULL, SYS_InName, window, SYS_CmdStream, ..., SYS_Output, 0, ...) */
+    {
+        BPTR cmdStream = 0;
+        BPTR startupFile = 0;
+        struct TagItem tags[10];
+        
+        /* Open startup file (default is S:Shell-Startup) */
+        startupFile = Open("S:Shell-Startup", MODE_OLDFILE);
+        if (startupFile != 0) {
+            cmdStream = startupFile;
+        }
+        
+        /* Build TagItem array - can't use variables in initializers in C89 */
+        /* According to RKM: With SYS_Asynch, must provide SYS_Input/InName AND SYS_Output/OutName */
+        /* Setting SYS_Output to ZERO makes it clone from input (the CON: device) */
+        tags[0].ti_Tag = SYS_InName;
+        tags[0].ti_Data = (ULONG)conspec;  /* CON: specifier with WINDOW parameter */
+        tags[1].ti_Tag = SYS_CmdStream;
+        tags[1].ti_Data = (ULONG)cmdStream;  /* Startup file stream */
+        tags[2].ti_Tag = SYS_Output;
+        tags[2].ti_Data = 0;  /* ZERO - clone from input (CON: device) to preserve our stdout */
+        tags[3].ti_Tag = SYS_Asynch;
+        tags[3].ti_Data = TRUE;  /* Must be TRUE to avoid blocking */
+        tags[4].ti_Tag = SYS_UserShell;
+        tags[4].ti_Data = TRUE;  /* Use user shell */
+        tags[5].ti_Tag = NP_StackSize;
+        tags[5].ti_Data = 4096;
+        tags[6].ti_Tag = NP_Name;
+        tags[6].ti_Data = (ULONG)processName;
+        tags[7].ti_Tag = NP_ExitCode;
+        tags[7].ti_Data = (ULONG)ShellExitCode;  /* Signals us when the shell process ends */
+        tags[8].ti_Tag = NP_ExitData;
+        tags[8].ti_Data = (ULONG)currentDesktop;  /* Also how FindShellProcess knows it */
+        tags[9].ti_Tag = TAG_DONE;
+        tags[9].ti_Data = 0;
+        
+        SNPrintf(processName, sizeof(processName), "%s Shell", currentDesktop->workspaceName);
+        
+        /* Call System() directly with CON: specifier using WINDOW parameter */
+        /* Pass NULL as command since we're using SYS_CmdStream for startup file */
+        /* With NULL command and SYS_Asynch, shell reads from SYS_CmdStream then SYS_InName */
+        result = SystemTagList(NULL, tags);
+        
+        /* Remember the process so CloseShellConsole can unhook ShellExitCode */
+        /* If it has already exited, it is gone (or going) and must not be touched */
+        if (result != -1) {
+            Forbid();
+            if (!currentDesktop->shellExited) {
+                currentDesktop->shellProcess = FindShellProcess(currentDesktop);
+            }
+            Permit();
+            if (currentDesktop->shellProcess == NULL && !currentDesktop->shellExited) {
+                LOG_WARN(("Workspace: WARNING - Shell process on %s not found, it must end before the desktop can close\n",
+                          currentDesktop->workspaceName));
+            }
+        }
+        
+        /* Note: cmdStream will be closed by System() when shell terminates */
+        if (result == -1 && startupFile != 0) {
+            Close(startupFile);
+        }
+    }
+    
+    /* With SYS_Asynch, SystemTagList returns 0 once the shell is started, -1 if it could not be */
+    if (result == -1) {
+        LOG_ERROR(("Workspace: ERROR - Failed to create shell console (SystemTagList returned -1)\n"));
+        currentDesktop->shellWindowDonated = FALSE;
+        if (currentDesktop->shellWindow) {
+            CloseWindow(currentDesktop->shellWindow);
+            currentDesktop->shellWindow = NULL;
+        }
+        return FALSE;
+    }
+    
+    /* IMPORTANT: When using WINDOW parameter, the console takes ownership of the window */
+    /* The console will close the window when it exits - never touch it again after this */
+    /* ShellExitCode sets shellExited and signals shellSigBit when the shell process ends */
+    LOG_TRACE(("Workspace: Shell console launched successfully (process 0x%lx)\n", (ULONG)currentDesktop->shellProcess));
+    
+    /* Disable "Open AmigaShell" menu item since shell is now open */
+    if (currentDesktop->backdropWindow) {
+        OffMenu(currentDesktop->backdropWindow, SHELL_MENUNUM);
+        LOG_TRACE(("Workspace: Disabled 'Open AmigaShell' menu item\n"));
+    }
+    
+    LOG_INFO(("Workspace: Shell console created successfully\n"));
+    return TRUE;
+}
+
+/* Close shell console */
+VOID CloseShellConsole(VOID)
+{
+    /* Shell still running - unhook ShellExitCode, our code goes away when we exit */
+    /* Under Forbid a shell that has not set shellExited has not reached its exit code */
+    if (currentDesktop->shellProcess != NULL) {
+        Forbid();
+        if (!currentDesktop->shellExited) {
+            currentDesktop->shellProcess->pr_ExitCode = NULL;
+        }
+        Permit();
+        currentDesktop->shellProcess = NULL;
+    }
+    
+    /* If shell window exists and hasn't been donated to the console, close it */
+    if (currentDesktop->shellWindow != NULL) {
+        if (!currentDesktop->shellWindowDonated) {
+            /* We still own the window - close it */
+            LOG_TRACE(("Workspace: Closing shell window (not donated to console)\n"));
+            CloseWindow(currentDesktop->shellWindow);
+        } else {
+            /* Window was donated to console - don't close it, console will close it */
+            LOG_TRACE(("Workspace: Shell window was donated to console - console will close it\n"));
+        }
+        currentDesktop->shellWindow = NULL;
+    }
+    
+    currentDesktop->shellWindowDonated = FALSE;
+    currentDesktop->shellEnabled = FALSE;
+    
+    /* Re-enable "Open AmigaShell" menu item since shell is now closed */
+    if (currentDesktop->backdropWindow) {
+        OnMenu(currentDesktop->backdropWindow, SHELL_MENUNUM);
+        LOG_TRACE(("Workspace: Re-enabled 'Open AmigaShell' menu item\n"));
+    }
+    
+    LOG_TRACE(("Workspace: Shell console cleanup complete\n"));
+}
+
+/* NP_ExitCode of the shell process - runs on the shell's context as it exits */
+/* exitData is the desktop the shell was opened on */
+__saveds __asm LONG ShellExitCode(register __d0 LONG returnCode, register __d1 LONG exitData)
+{
+    ((struct Desktop *)exitData)->shellExited = TRUE;
+    Signal(wsState.mainTask, 1L << wsState.shellSigBit);
+    return returnCode;
+}
+
+/* The shell started for desktop - the process that will run ShellExitCode with the */
+/* desktop as exit data. Its name may be shared by other tasks, these fields are not. */
+/* The exec task lists change under interrupts, so they are walked under Disable. */
+struct Process *FindShellProcess(struct Desktop *desktop)
+{
+    struct List *taskLists[2];
+    struct Node *node;
+    struct Process *process;
+    ULONG i;
+    
+    taskLists[0] = &SysBase->TaskReady;
+    taskLists[1] = &SysBase->TaskWait;
+    Disable();
+    for (i = 0; i < 2; i++) {
+        for (node = taskLists[i]->lh_Head; node->ln_Succ != NULL; node = node->ln_Succ) {
+            process = (struct Process *)node;
+            if (node->ln_Type == NT_PROCESS &&
+                process->pr_ExitCode == (APTR)ShellExitCode &&
+                process->pr_ExitData == (LONG)desktop) {
+                Enable();
+                return process;
             }
         }
     }
+    Enable();
+    return NULL;
+}
+
+/* Shell processes have ended - their consoles have closed (or are closing) their windows */
+VOID HandleShellExit(VOID)
+{
+    struct Desktop *desktop;
+    
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (desktop->shellExited && desktop->shellEnabled) {
+            LOG_INFO(("Workspace: Shell console on %s ended\n", desktop->workspaceName));
+            currentDesktop = desktop;
+            desktop->shellProcess = NULL;
+            CloseShellConsole();
+        }
+    }
+}
+
+/* Load backdrop image */
+/* Parse command line arguments */
+BOOL ParseCommandLine(VOID)
+{
+    LONG argArray[23];
+    STRPTR pubNameArg = NULL;
+    STRPTR cxNameArg = NULL;
+    STRPTR backdropArg = NULL;
+    STRPTR cxPopKeyArg = NULL;
+    STRPTR themeArg = NULL;
+    STRPTR logFileArg = NULL;
+    STRPTR profileFileArg = NULL;
+    
+    /* Initialize arg array */
+    argArray[0] = 0;
+    argArray[1] = 0;
+    argArray[2] = 0;
+    argArray[3] = 0;
+    argArray[4] = 0;
+    argArray[5] = 0;
+    argArray[6] = 0;
+    argArray[7] = 0;
+    argArray[8] = 0;
+    argArray[9] = 0;
+    argArray[10] = 0;
+    argArray[11] = 0;
+    argArray[12] = 0;
+    argArray[13] = 0;
+    argArray[14] = 0;
+    argArray[15] = 0;
+    argArray[16] = 0;
+    argArray[17] = 0;
+    argArray[18] = 0;
+    argArray[19] = 0;
+    argArray[20] = 0;
+    argArray[21] = 0;
+    argArray[22] = 0;
+    
+    /* Clear IoErr before ReadArgs */
+    SetIoErr(0);
+    
+    /* Parse arguments: PUBNAME/K, CX_NAME/K, BACKDROP/K, CX_POPKEY/K, THEME/K, LOGFILE/K, */
+    /* PROFILE/S, PROFILEFILE/K, CX_TASK/S, COUNT/K/N, LAZY/S, HIBERNATE/K/N, SPARE/S, */
+    /* CX_NEXTKEY/K, CX_PREVKEY/K, CX_GOTOKEY/K, WIDTH/K/N, HEIGHT/K/N, DEPTH/K/N, INTERLEAVED/S, */
+    /* CHIPBUDGET/K/N, HEADLESS/S, CX_QUITKEY/K */
+    wsState.rda = ReadArgs("PUBNAME/K,CX_NAME/K,BACKDROP/K,CX_POPKEY/K,THEME/K,LOGFILE/K,PROFILE/S,PROFILEFILE/K,CX_TASK/S,COUNT/K/N,LAZY/S,HIBERNATE/K/N,SPARE/S,CX_NEXTKEY/K,CX_PREVKEY/K,CX_GOTOKEY/K,WIDTH/K/N,HEIGHT/K/N,DEPTH/K/N,INTERLEAVED/S,CHIPBUDGET/K/N,HEADLESS/S,CX_QUITKEY/K", argArray, NULL);
+    if (!wsState.rda) {
+        LONG errorCode = IoErr();
+        if (errorCode != 0) {
+            LOG_WARN(("Workspace: ReadArgs failed with error: %ld\n", errorCode));
+        }
+        /* ReadArgs can return NULL even on success if no args provided */
+        /* Set defaults */
+        wsState.pubName = NULL;
+        wsState.cxName = NULL;
+        wsState.backdropImagePath = NULL;
+        wsState.cxPopKey = NULL;
+        wsState.themeName = NULL;
+        return TRUE; /* Not a fatal error */
+    }
     
-    /* Lock public screen list to enumerate other screens */
-    pubScreenList = LockPubScreenList();
-    if (pubScreenList) {
-        /* Iterate through all public screens */
-        for (psn = (struct PubScreenNode *)pubScreenList->lh_Head;
-             psn->psn_Node.ln_Succ != (struct Node *)&pubScreenList->lh_Tail;
-             psn = (struct PubScreenNode *)psn->psn_Node.ln_Succ) {
-            
-            screenName = psn->psn_Node.ln_Name;
-            /* Check if screen name starts with "Workspace." and is not our own screen */
-            nameLen = 0;
-            if (screenName) {
-                while (screenName[nameLen] != '\0') nameLen++;
-            }
-            if (screenName && nameLen >= 10 && 
-                strncmp(screenName, "Workspace.", 10) == 0) {
-                /* Skip our own screen if we already added it */
-                if (wsState.workspaceName && strcmp(screenName, wsState.workspaceName) == 0) {
-                    continue;
-                }
-                /* This is a Workspace screen - add to menu */
-                if (idx >= maxCount + 5) {
-                    /* Need more space - reallocate by allocating new and copying */
-                    maxCount *= 2;
-                    newMenu2 = AllocMem(sizeof(struct NewMenu) * (maxCount + 10), MEMF_CLEAR);
-                    if (!newMenu2) {
-                        Printf("Workspace: ERROR - Failed to reallocate menu array\n");
-                        UnlockPubScreenList();
-                        FreeMem(newMenu, sizeof(struct NewMenu) * (maxCount / 2 + 10));
-                        return NULL;
-                    }
-                    CopyMem(newMenu, newMenu2, sizeof(struct NewMenu) * idx);
-                    FreeMem(newMenu, sizeof(struct NewMenu) * (maxCount / 2 + 10));
-                    newMenu = newMenu2;
-                }
-                
-                /* Allocate persistent copy of name */
-                nameCopy = AllocMem(nameLen + 1, MEMF_CLEAR);
-                if (nameCopy) {
-                    strcpy(nameCopy, screenName);
-                    
-                    newMenu[idx].nm_Type = NM_SUB;
-                    newMenu[idx].nm_Label = nameCopy;
-                    newMenu[idx].nm_Flags = CHECKIT; /* Checkmark item */
-                    newMenu[idx].nm_MutualExclude = 0; /* Will be set after we know total count */
-                    newMenu[idx].nm_UserData = (APTR)((0UL << 16) | (0UL << 8) | (subItemCount - 1)); /* Menu 0, Item 0, Sub (subItemCount-1) */
-                    idx++;
-                    count++;
-                    subItemCount++;
-                }
-            }
+    /* Extract arguments - the strings stay in wsState.rda, which Cleanup frees last */
+    pubNameArg = (STRPTR)argArray[0];
+    cxNameArg = (STRPTR)argArray[1];
+    backdropArg = (STRPTR)argArray[2];
+    cxPopKeyArg = (STRPTR)argArray[3];
+    themeArg = (STRPTR)argArray[4];
+    logFileArg = (STRPTR)argArray[5];
+    profileFileArg = (STRPTR)argArray[7];
+    
+    /* Store pubname if provided */
+    if (pubNameArg && pubNameArg[0] != '\0') {
+        wsState.pubName = pubNameArg;
+        LOG_INFO(("Workspace: PUBNAME set to: %s\n", wsState.pubName));
+    } else {
+        wsState.pubName = NULL;
+    }
+    
+    /* Store cxname if provided */
+    if (cxNameArg && cxNameArg[0] != '\0') {
+        wsState.cxName = cxNameArg;
+        LOG_INFO(("Workspace: CXNAME set to: %s\n", wsState.cxName));
+    } else {
+        wsState.cxName = NULL;
+    }
+    
+    /* Store backdrop path if provided */
+    if (backdropArg && backdropArg[0] != '\0') {
+        wsState.backdropImagePath = backdropArg;
+        LOG_INFO(("Workspace: BACKDROP set to: %s\n", wsState.backdropImagePath));
+    } else {
+        wsState.backdropImagePath = NULL;
+    }
+    
+    /* Store CX_POPKEY if provided */
+    if (cxPopKeyArg && cxPopKeyArg[0] != '\0') {
+        wsState.cxPopKey = cxPopKeyArg;
+        LOG_INFO(("Workspace: CX_POPKEY set to: %s\n", wsState.cxPopKey));
+    } else {
+        wsState.cxPopKey = NULL;
+    }
+    
+    /* Store THEME if provided */
+    if (themeArg && themeArg[0] != '\0') {
+        wsState.themeName = themeArg;
+        LOG_INFO(("Workspace: THEME set to: %s\n", wsState.themeName));
+        
+        /* Map theme name to index */
+        if (strcmp(themeArg, "dark") == 0 || strcmp(themeArg, "Dark Mode") == 0) {
+            wsState.defaultTheme = THEME_DARK_MODE;
+        } else if (strcmp(themeArg, "sepia") == 0 || strcmp(themeArg, "Sepia") == 0) {
+            wsState.defaultTheme = THEME_SEPIA;
+        } else if (strcmp(themeArg, "blue") == 0 || strcmp(themeArg, "Blue") == 0) {
+            wsState.defaultTheme = THEME_BLUE;
+        } else if (strcmp(themeArg, "green") == 0 || strcmp(themeArg, "Green") == 0) {
+            wsState.defaultTheme = THEME_GREEN;
+        } else {
+            /* Default to Like Workbench */
+            wsState.defaultTheme = THEME_LIKE_WORKBENCH;
         }
-        UnlockPubScreenList();
+    } else {
+        wsState.themeName = NULL;
     }
     
-    /* Now set mutual exclusion for all sub-items */
-    /* Each item excludes all other items */
-    /* Bit 0 = first item (Workbench), bit 1 = second item, etc. */
-    /* For item i, set all bits except bit i (exclude all other items) */
-    totalSubItems = subItemCount - 1; /* Total number of sub-items */
-    for (subIdx = 0; subIdx < totalSubItems; subIdx++) {
-        ULONG menuIdx = workbenchIdx + subIdx;
-        /* Set all bits for items 0..(totalSubItems-1), except bit subIdx */
-        /* Example: 3 items -> item 0 excludes 1,2 = 0x6, item 1 excludes 0,2 = 0x5, item 2 excludes 0,1 = 0x3 */
-        ULONG excludeMask = ((1UL << totalSubItems) - 1) & ~(1UL << subIdx);
-        newMenu[menuIdx].nm_MutualExclude = excludeMask;
-    }
-    
-    /* Add separator */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = NM_BARLABEL;
-    idx++;
-    
-    /* Add "About" - this is a regular menu item, not a sub-item */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "About";
-    newMenu[idx].nm_CommKey = "?";
-    newMenu[idx].nm_UserData = (APTR)((0UL << 16) | (1UL << 8) | 0UL); /* Menu 0, Item 1, Sub 0 */
-    idx++;
-    
-    /* Add "Shell Console" - this is a regular menu item, not a sub-item */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "Open AmigaShell";
-    newMenu[idx].nm_CommKey = "S";
-    newMenu[idx].nm_UserData = (APTR)((0UL << 16) | (3UL << 8) | 0UL); /* Menu 0, Item 3, Sub 0 */
-    idx++;
-    
-    /* Add "Quit" - this is a regular menu item, not a sub-item */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "Close Workspace";
-    newMenu[idx].nm_CommKey = "Q";
-    newMenu[idx].nm_UserData = (APTR)((0UL << 16) | (2UL << 8) | 0UL); /* Menu 0, Item 2, Sub 0 */
-    idx++;
-    
-    /* Ensure we have enough space for second menu (need ~10 more entries) */
-    if (idx >= maxCount + 5) {
-        /* Need more space - reallocate */
-        maxCount *= 2;
-        newMenu2 = AllocMem(sizeof(struct NewMenu) * (maxCount + 10), MEMF_CLEAR);
-        if (!newMenu2) {
-            Printf("Workspace: ERROR - Failed to reallocate menu array for second menu\n");
-            FreeMem(newMenu, sizeof(struct NewMenu) * (maxCount / 2 + 10));
-            return NULL;
+    /* Send log output to an in-memory ring flushed to LOGFILE while idle */
+    if (logFileArg && logFileArg[0] != '\0') {
+        if (StartLogRing(logFileArg)) {
+            LOG_INFO(("Workspace: LOGFILE set to: %s\n", logFileArg));
         }
-        CopyMem(newMenu, newMenu2, sizeof(struct NewMenu) * idx);
-        FreeMem(newMenu, sizeof(struct NewMenu) * (maxCount / 2 + 10));
-        newMenu = newMenu2;
-    }
-    
-    /* Start second menu - Windows (NO NM_END between menus!) */
-    newMenu[idx].nm_Type = NM_TITLE;
-    newMenu[idx].nm_Label = "Windows";
-    newMenu[idx].nm_CommKey = NULL;
-    newMenu[idx].nm_Flags = 0;
-    newMenu[idx].nm_MutualExclude = 0;
-    newMenu[idx].nm_UserData = NULL;
-    idx++;
-    
-    /* Add "Tile Horizontally" */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "Tile Horizontally";
-    newMenu[idx].nm_CommKey = "H";
-    newMenu[idx].nm_UserData = (APTR)((1UL << 16) | (0UL << 8) | 0UL); /* Menu 1, Item 0, Sub 0 */
-    idx++;
-    
-    /* Add "Tile Vertically" */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "Tile Vertically";
-    newMenu[idx].nm_CommKey = "V";
-    newMenu[idx].nm_UserData = (APTR)((1UL << 16) | (1UL << 8) | 0UL); /* Menu 1, Item 1, Sub 0 */
-    idx++;
-    
-    /* Add "Grid Layout" */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "Grid Layout";
-    newMenu[idx].nm_CommKey = "G";
-    newMenu[idx].nm_UserData = (APTR)((1UL << 16) | (2UL << 8) | 0UL); /* Menu 1, Item 2, Sub 0 */
-    idx++;
-    
-    /* Ensure we have enough space for third menu (Prefs) */
-    if (idx >= maxCount + 5) {
-        /* Need more space - reallocate */
-        maxCount *= 2;
-        newMenu2 = AllocMem(sizeof(struct NewMenu) * (maxCount + 10), MEMF_CLEAR);
-        if (!newMenu2) {
-            Printf("Workspace: ERROR - Failed to reallocate menu array for third menu\n");
-            FreeMem(newMenu, sizeof(struct NewMenu) * (maxCount / 2 + 10));
-            return NULL;
+    }
+    
+    /* Write a startup profile report - PROFILEFILE implies PROFILE */
+    if (argArray[6] != 0) {
+        startupProfile.enabled = TRUE;
+    }
+    if (profileFileArg && profileFileArg[0] != '\0') {
+        startupProfile.reportFile = profileFileArg;
+        startupProfile.enabled = TRUE;
+    }
+    
+    /* Service hotkeys and Exchange from a separate high-priority process */
+    if (argArray[8] != 0) {
+        wsState.cxTaskEnabled = TRUE;
+    }
+    
+    /* Number of desktops to open */
+    if (argArray[9] != 0) {
+        LONG count = *(LONG *)argArray[9];
+        
+        if (count < 1) {
+            count = 1;
+        } else if (count > WS_MAX_DESKTOPS) {
+            count = WS_MAX_DESKTOPS;
         }
-        CopyMem(newMenu, newMenu2, sizeof(struct NewMenu) * idx);
-        FreeMem(newMenu, sizeof(struct NewMenu) * (maxCount / 2 + 10));
-        newMenu = newMenu2;
-    }
-    
-    /* Start third menu - Prefs (NO NM_END between menus!) */
-    newMenu[idx].nm_Type = NM_TITLE;
-    newMenu[idx].nm_Label = "Prefs";
-    newMenu[idx].nm_CommKey = NULL;
-    newMenu[idx].nm_Flags = 0;
-    newMenu[idx].nm_MutualExclude = 0;
-    newMenu[idx].nm_UserData = NULL;
-    idx++;
-    
-    /* Add "Theme" menu item */
-    newMenu[idx].nm_Type = NM_ITEM;
-    newMenu[idx].nm_Label = "Theme";
-    newMenu[idx].nm_CommKey = NULL;
-    newMenu[idx].nm_Flags = 0;
-    newMenu[idx].nm_MutualExclude = 0;
-    newMenu[idx].nm_UserData = NULL;
-    idx++;
-    
-    /* Add theme sub-items with mutex */
-    {
-        ULONG themeSubIdx;
-        ULONG themeSubItemCount = THEME_COUNT;
-        ULONG themeStartIdx = idx;
+        wsState.launchCount = (ULONG)count;
+        LOG_INFO(("Workspace: COUNT set to: %lu\n", wsState.launchCount));
+    }
+    
+    /* Desktops after the first only reserve their name until they are used */
+    if (argArray[10] != 0) {
+        wsState.lazyDesktops = TRUE;
+    }
+    
+    /* Seconds an unused screen stays open before it is closed to save memory */
+    if (argArray[11] != 0) {
+        LONG seconds = *(LONG *)argArray[11];
         
-        for (themeSubIdx = 0; themeSubIdx < themeSubItemCount; themeSubIdx++) {
-            STRPTR themeLabel = (STRPTR)themeNames[themeSubIdx];
-            ULONG checkFlags = CHECKIT;
-            
-            /* Mark current theme as checked */
-            if (themeSubIdx == wsState.currentTheme) {
-                checkFlags |= CHECKED;
-            }
-            
-            newMenu[idx].nm_Type = NM_SUB;
-            newMenu[idx].nm_Label = themeLabel;
-            newMenu[idx].nm_Flags = checkFlags;
-            newMenu[idx].nm_MutualExclude = 0; /* Will be set after loop */
-            newMenu[idx].nm_UserData = (APTR)((2UL << 16) | (0UL << 8) | themeSubIdx); /* Menu 2, Item 0, Sub themeSubIdx */
-            idx++;
+        if (seconds > 0) {
+            wsState.hibernateSeconds = (ULONG)seconds;
+            LOG_INFO(("Workspace: HIBERNATE set to: %lu\n", wsState.hibernateSeconds));
         }
+    }
+    
+    /* Keep a prepared desktop behind the others for New Workspace */
+    if (argArray[12] != 0) {
+        wsState.spareEnabled = TRUE;
+    }
+    
+    /* Hotkeys to step through the desktops, and CX_GOTOKEY plus 1..9 to pick one */
+    if (argArray[13] != 0 && ((STRPTR)argArray[13])[0] != '\0') {
+        wsState.cxNextKey = (STRPTR)argArray[13];
+        LOG_INFO(("Workspace: CX_NEXTKEY set to: %s\n", wsState.cxNextKey));
+    }
+    if (argArray[14] != 0 && ((STRPTR)argArray[14])[0] != '\0') {
+        wsState.cxPrevKey = (STRPTR)argArray[14];
+        LOG_INFO(("Workspace: CX_PREVKEY set to: %s\n", wsState.cxPrevKey));
+    }
+    if (argArray[15] != 0 && ((STRPTR)argArray[15])[0] != '\0') {
+        wsState.cxGotoKey = (STRPTR)argArray[15];
+        LOG_INFO(("Workspace: CX_GOTOKEY set to: %s\n", wsState.cxGotoKey));
+    }
+    
+    /* Screen mode of the desktops this run opens - unset values follow the Workbench */
+    if (argArray[16] != 0 && *(LONG *)argArray[16] > 0) {
+        wsState.defaultMode.width = (UWORD)*(LONG *)argArray[16];
+    }
+    if (argArray[17] != 0 && *(LONG *)argArray[17] > 0) {
+        wsState.defaultMode.height = (UWORD)*(LONG *)argArray[17];
+    }
+    if (argArray[18] != 0) {
+        LONG depth = *(LONG *)argArray[18];
         
-        /* Set mutual exclusion for theme sub-items */
-        for (themeSubIdx = 0; themeSubIdx < themeSubItemCount; themeSubIdx++) {
-            ULONG excludeMask = ((1UL << themeSubItemCount) - 1) & ~(1UL << themeSubIdx);
-            newMenu[themeStartIdx + themeSubIdx].nm_MutualExclude = excludeMask;
+        wsState.defaultMode.depth = ValidModeDepth(depth);
+        if (wsState.defaultMode.depth != depth) {
+            LOG_WARN(("Workspace: WARNING - DEPTH %ld is not a screen depth, using %ld\n",
+                      depth, (LONG)wsState.defaultMode.depth));
         }
     }
+    if (argArray[19] != 0) {
+        wsState.defaultMode.interleaved = TRUE;
+    }
+    LOG_INFO(("Workspace: Screen mode: %ldx%ld, %ld planes (0 = like Workbench)\n",
+              (LONG)wsState.defaultMode.width, (LONG)wsState.defaultMode.height, (LONG)wsState.defaultMode.depth));
     
-    /* Terminate third menu (this also terminates the entire menu strip) */
-    newMenu[idx].nm_Type = NM_END;
-    newMenu[idx].nm_Label = NULL;
-    newMenu[idx].nm_CommKey = NULL;
-    newMenu[idx].nm_Flags = 0;
-    newMenu[idx].nm_MutualExclude = 0;
-    newMenu[idx].nm_UserData = NULL;
-    idx++;
+    /* Chip RAM all screen bitmaps may take together, in KB - a screen about to open is */
+    /* checked at its estimated size (ModeChipCost), open screens count as allocated */
+    if (argArray[20] != 0 && *(LONG *)argArray[20] > 0) {
+        wsState.chipBudget = (ULONG)*(LONG *)argArray[20] * 1024UL;
+        LOG_INFO(("Workspace: CHIPBUDGET set to: %lu bytes\n", wsState.chipBudget));
+    }
     
-    *menuCount = idx;  /* Count includes final NM_END entry */
-    Printf("Workspace: Built menu with %lu items (%lu Workspace screens, 3 menus)\n", *menuCount, count);
-    return newMenu;
+    /* Public screens only - show, quit and visitor checks come through Exchange and hotkeys */
+    if (argArray[21] != 0) {
+        wsState.headless = TRUE;
+        LOG_INFO(("Workspace: HEADLESS mode\n"));
+        if (wsState.spareEnabled) {
+            /* The spare saves building a window and menus, which headless never does */
+            LOG_WARN(("Workspace: WARNING - SPARE has no use in HEADLESS mode, ignored\n"));
+            wsState.spareEnabled = FALSE;
+        }
+    }
+    if (argArray[22] != 0 && ((STRPTR)argArray[22])[0] != '\0') {
+        wsState.cxQuitKey = (STRPTR)argArray[22];
+        LOG_INFO(("Workspace: CX_QUITKEY set to: %s\n", wsState.cxQuitKey));
+    }
+    
+    return TRUE;
 }
 
-/* Create menu strip using GadTools - MUST be called AFTER window is open */
-BOOL CreateMenuStrip(VOID)
+BOOL LoadBackdropImage(STRPTR imagePath)
 {
-    struct NewMenu *newMenu = NULL;
-    ULONG menuCount = 0;
-    struct Menu *menuStrip = NULL;
-    struct VisualInfo *visInfo = NULL;
+    Object *dtObject = NULL;
+    APTR drawHandle = NULL;
+    struct RastPort *rp = NULL;
+    LONG drawResult;
+    WORD screenWidth;
+    WORD screenHeight;
+    BOOL loaded = FALSE;
+    struct MemProbe probe;
     
-    /* Window must exist */
-    if (!wsState.backdropWindow) {
-        Printf("Workspace: ERROR - Window must exist before creating menu strip\n");
+    if (!imagePath || imagePath[0] == '\0') {
+        LOG_TRACE(("Workspace: No backdrop image path provided\n"));
         return FALSE;
     }
     
-    Printf("Workspace: Creating menu strip using GadTools...\n");
-    
-    /* Build menu structure dynamically */
-    newMenu = BuildDefaultPubScreenMenu(&menuCount);
-    if (!newMenu) {
-        Printf("Workspace: ERROR - Failed to build menu structure\n");
+    if (!currentDesktop->backdropWindow || !currentDesktop->workspaceScreen) {
+        LOG_TRACE(("Workspace: Window or screen not available for backdrop image\n"));
         return FALSE;
     }
     
-    /* Create menu strip from NewMenu array */
-    menuStrip = CreateMenus(newMenu, TAG_DONE);
-    if (!menuStrip) {
-        Printf("Workspace: ERROR - CreateMenus failed\n");
+    if (!DataTypesBase) {
+        LOG_TRACE(("Workspace: datatypes.library not available\n"));
         return FALSE;
     }
     
-    /* Free the dynamically allocated menu structure (CreateMenus copies it) */
-    FreeMem(newMenu, sizeof(struct NewMenu) * menuCount);
+    LOG_TRACE(("Workspace: Loading backdrop image: %s\n", imagePath));
     
-    /* Get visual info for layout (required for GadTools menus) */
-    visInfo = GetVisualInfo(wsState.backdropWindow->WScreen, TAG_END);
-    if (!visInfo) {
-        Printf("Workspace: ERROR - GetVisualInfo failed\n");
-        FreeMenus(menuStrip);
-        return FALSE;
+    /* Create datatype object for the image */
+    MemProbeBegin(&probe);
+    dtObject = NewDTObject((APTR)imagePath,
+                           DTA_GroupID, GID_PICTURE,
+                           PDTA_Screen, (ULONG)currentDesktop->workspaceScreen,
+                           PDTA_Remap, TRUE,
+                           PDTA_DestMode, PMODE_V43,
+                           TAG_DONE);
+    
+    if (!dtObject) {
+        LONG errorCode = IoErr();
+        LOG_WARN(("Workspace: Failed to create datatype object (error: %ld)\n", errorCode));
+        goto done;
+    }
+    
+    LOG_TRACE(("Workspace: Datatype object created successfully\n"));
+    
+    /* Obtain draw info (required before DrawDTObjectA) */
+    {
+        struct TagItem drawTags[2];
+        drawTags[0].ti_Tag = PDTA_Screen;
+        drawTags[0].ti_Data = (ULONG)currentDesktop->workspaceScreen;
+        drawTags[1].ti_Tag = TAG_DONE;
+        drawHandle = ObtainDTDrawInfoA(dtObject, drawTags);
+    }
+    
+    if (!drawHandle) {
+        LOG_WARN(("Workspace: Failed to obtain draw info for backdrop image\n"));
+        DisposeDTObject(dtObject);
+        goto done;
+    }
+    
+    LOG_TRACE(("Workspace: Draw info obtained successfully\n"));
+    
+    /* Get window dimensions */
+    rp = currentDesktop->backdropWindow->RPort;
+    screenWidth = currentDesktop->backdropWindow->Width;
+    screenHeight = currentDesktop->backdropWindow->Height;
+    
+    /* Draw the image to fill the backdrop window */
+    drawResult = DrawDTObjectA(rp, dtObject,
+                               0, 0,  /* x, y */
+                               screenWidth, screenHeight,  /* width, height */
+                               0, 0,  /* th, tv */
+                               TAG_DONE);
+    
+    if (!drawResult) {
+        LOG_WARN(("Workspace: Failed to draw backdrop image\n"));
+        ReleaseDTDrawInfo(dtObject, drawHandle);
+        DisposeDTObject(dtObject);
+        goto done;
+    }
+    
+    LOG_INFO(("Workspace: Backdrop image drawn successfully\n"));
+    
+    /* Store object and draw handle for cleanup */
+    currentDesktop->backdropImageObj = dtObject;
+    currentDesktop->backdropDrawHandle = drawHandle;
+    currentDesktop->backdropShed = FALSE;
+    wsState.memExhausted = FALSE;
+    loaded = TRUE;
+    
+done:
+    MemProbeEnd(&probe, MEMACCT_BACKDROP);
+    return loaded;
+}
+
+/* Free backdrop image */
+VOID FreeBackdropImage(VOID)
+{
+    struct MemProbe probe;
+    
+    if (currentDesktop->backdropImageObj) {
+        MemProbeBegin(&probe);
+        /* Release draw info if obtained */
+        if (currentDesktop->backdropDrawHandle) {
+            ReleaseDTDrawInfo(currentDesktop->backdropImageObj, currentDesktop->backdropDrawHandle);
+            currentDesktop->backdropDrawHandle = NULL;
+        }
+        
+        /* Dispose of datatype object */
+        DisposeDTObject(currentDesktop->backdropImageObj);
+        currentDesktop->backdropImageObj = NULL;
+        MemProbeEnd(&probe, MEMACCT_BACKDROP);
+        LOG_TRACE(("Workspace: Backdrop image freed\n"));
+    }
+}
+
+/* Process commodity messages from Exchange program */
+VOID ProcessCommodityMessages(VOID)
+{
+    CxMsg *cxmsg;
+    
+    if (CommoditiesBase == NULL || wsState.commodityPort == NULL) {
+        return;
+    }
+    
+    while ((cxmsg = (CxMsg *)GetMsg(wsState.commodityPort)) != NULL) {
+        /* Not tied to a window - act on the desktop in front, as the commodity task does */
+        if (wsState.frontDesktop) {
+            currentDesktop = wsState.frontDesktop;
+        }
+        if (CxMsgType(cxmsg) & CXM_COMMAND) {
+            switch (CxMsgID(cxmsg)) {
+                case CXCMD_DISABLE:
+                    /* Disable commodity - deactivate broker */
+                    if (wsState.commodityActive && wsState.commodityBroker) {
+                        /* ActivateCxObj returns previous state */
+                        ActivateCxObj(wsState.commodityBroker, FALSE);
+                        wsState.commodityActive = FALSE;
+                        LOG_INFO(("Workspace: Commodity disabled\n"));
+                    }
+                    break;
+                
+                case CXCMD_ENABLE:
+                    /* Enable commodity - reactivate broker */
+                    if (!wsState.commodityActive && wsState.commodityBroker) {
+                        /* ActivateCxObj returns previous state */
+                        LONG prevState = ActivateCxObj(wsState.commodityBroker, TRUE);
+                        if (prevState == 0) {
+                            /* Was inactive, now active - expected */
+                            wsState.commodityActive = TRUE;
+                            LOG_INFO(("Workspace: Commodity enabled\n"));
+                        } else {
+                            /* Was already active - unexpected */
+                            wsState.commodityActive = TRUE;
+                            LOG_WARN(("Workspace: WARNING - Broker was already active when enabling\n"));
+                        }
+                    }
+                    break;
+                
+                case CXCMD_APPEAR:
+                    /* Show/bring workspace screen to front */
+                    LOG_INFO(("Workspace: Received CXCMD_APPEAR\n"));
+                    /* Note: Backdrop windows cannot be depth-arranged, so WindowToFront() is invalid */
+                    ShowDesktop();
+                    break;
+                
+                case CXCMD_DISAPPEAR:
+                    /* Hide workspace - safely ignore for now to prevent lockups */
+                    /* Just acknowledge and reply - do not perform any operations */
+                    LOG_INFO(("Workspace: Received CXCMD_DISAPPEAR (ignored)\n"));
+                    /* Immediately reply to prevent lockup */
+                    ReplyMsg((struct Message *)cxmsg);
+                    continue; /* Skip the ReplyMsg at end of loop */
+                
+                case CXCMD_KILL:
+                    /* Quit application - each desktop checks its visitors as it closes */
+                    LOG_INFO(("Workspace: Received CXCMD_KILL\n"));
+                    RequestCloseAllDesktops();
+                    break;
+                
+                case CXCMD_UNIQUE:
+                    /* Another instance tried to start - show ourselves */
+                    LOG_INFO(("Workspace: Received CXCMD_UNIQUE (another instance tried to start)\n"));
+                    /* Note: Backdrop windows cannot be depth-arranged, so WindowToFront() is invalid */
+                    ShowDesktop();
+                    break;
+                
+                default:
+                    LOG_INFO(("Workspace: Received unknown commodity command: %ld\n", CxMsgID(cxmsg)));
+                    break;
+            }
+        } else if (CxMsgType(cxmsg) & CXM_IEVENT) {
+            /* Input event message from our hotkey sender - its ID is the command to run */
+            struct WsCommand *command = (struct WsCommand *)CxMsgID(cxmsg);
+            
+            if (command) {
+                struct InputEvent *ie = (struct InputEvent *)CxMsgData(cxmsg);
+                
+                LOG_TRACE(("Workspace: Hotkey pressed\n"));
+                if (ie) {
+                    RunCommand(command, ie->ie_TimeStamp.tv_secs, ie->ie_TimeStamp.tv_micro);
+                } else {
+                    RunCommand(command, 0, 0);
+                }
+            }
+        }
+        
+        /* Always reply to the message */
+        ReplyMsg((struct Message *)cxmsg);
+    }
+}
+
+/* Parse tooltypes */
+VOID ParseToolTypes(VOID)
+{
+    /* TODO: Implement tooltype parsing */
+    /* Tooltypes to support:
+     * - SHELL/S or SHELLENABLED/S: Enable shell console
+     * - SHELLPATH/K: Path to shell (default: CON:...)
+     * - BACKDROP/K: Path to backdrop image
+     */
+}
+
+/* Get tooltype value */
+BOOL GetToolType(STRPTR toolType, STRPTR defaultValue, STRPTR buffer, ULONG bufferSize)
+{
+    /* TODO: Implement tooltype retrieval */
+    if (defaultValue) {
+        Strncpy(buffer, defaultValue, bufferSize);
+        return TRUE;
     }
-    
-    /* Layout menus with visual info */
-    if (!LayoutMenus(menuStrip, visInfo, 
-                     GTMN_NewLookMenus, TRUE,
-                     TAG_END)) {
-        Printf("Workspace: ERROR - LayoutMenus failed\n");
-        FreeVisualInfo(visInfo);
-        FreeMenus(menuStrip);
+    return FALSE;
+}
+
+/* Open timer.device for E-Clock timestamps (optional - timestamps are zero without it) */
+BOOL InitializeTimer(VOID)
+{
+    TimerPort = CreateMsgPort();
+    if (TimerPort == NULL) {
         return FALSE;
     }
-    
-    /* Set menu strip on window */
-    if (!SetMenuStrip(wsState.backdropWindow, menuStrip)) {
-        Printf("Workspace: ERROR - SetMenuStrip failed\n");
-        FreeVisualInfo(visInfo);
-        FreeMenus(menuStrip);
+    TimerIO = (struct timerequest *)CreateIORequest(TimerPort, sizeof(struct timerequest));
+    if (TimerIO == NULL) {
+        DeleteMsgPort(TimerPort);
+        TimerPort = NULL;
         return FALSE;
     }
-    
-    /* Set Workbench as initially checked (default pubscreen) after SetMenuStrip */
-    if (menuStrip && menuStrip->FirstItem && menuStrip->FirstItem->SubItem) {
-        struct MenuItem *workbenchItem = menuStrip->FirstItem->SubItem;
-        if (workbenchItem) {
-            workbenchItem->Flags |= CHECKED;
-            Printf("Workspace: Set Workbench as initially checked\n");
-            /* Refresh menu to show checkmark */
-            ClearMenuStrip(wsState.backdropWindow);
-            ResetMenuStrip(wsState.backdropWindow, menuStrip);
-        }
-    }
-    
-    /* Store menu strip */
-    wsState.menuStrip = menuStrip;
-    
-    /* Verify menu is actually attached to window */
-    if (wsState.backdropWindow->MenuStrip != menuStrip) {
-        Printf("Workspace: ERROR - Menu strip not found in window structure!\n");
-        FreeVisualInfo(visInfo);
-        FreeMenus(menuStrip);
-        wsState.menuStrip = NULL;
+    if (OpenDevice(TIMERNAME, UNIT_MICROHZ, (struct IORequest *)TimerIO, 0) != 0) {
+        DeleteIORequest((struct IORequest *)TimerIO);
+        TimerIO = NULL;
+        DeleteMsgPort(TimerPort);
+        TimerPort = NULL;
         return FALSE;
     }
-    
-    Printf("Workspace: Menu strip verified in window (MenuStrip=0x%lx)\n", (ULONG)wsState.backdropWindow->MenuStrip);
-    
-    /* Free visual info (no longer needed after LayoutMenus and SetMenuStrip) */
-    FreeVisualInfo(visInfo);
-    
-    /* Activate window and refresh frame to make menu visible */
-    ActivateWindow(wsState.backdropWindow);
-    WindowToFront(wsState.backdropWindow);
-    RefreshWindowFrame(wsState.backdropWindow);
-    ScreenToFront(wsState.workspaceScreen);
-    
-    Printf("Workspace: Menu strip created and attached successfully\n");
+    TimerBase = TimerIO->tr_node.io_Device;
+    eclockFrequency = ReadEClock(&logRing.startTime);
     return TRUE;
 }
 
-/* Free menu strip */
-VOID FreeMenuStrip(VOID)
+/* Close timer.device */
+VOID CleanupTimer(VOID)
 {
-    if (wsState.menuStrip) {
-        /* Use FreeMenus() to properly free GadTools menu structure */
-        FreeMenus(wsState.menuStrip);
-        wsState.menuStrip = NULL;
+    if (scheduler.requestPending) {
+        AbortIO((struct IORequest *)TimerIO);
+        WaitIO((struct IORequest *)TimerIO);
+        scheduler.requestPending = FALSE;
+    }
+    scheduler.head = NULL;
+    if (TimerIO != NULL) {
+        CloseDevice((struct IORequest *)TimerIO);
+        DeleteIORequest((struct IORequest *)TimerIO);
+        TimerIO = NULL;
+        TimerBase = NULL;
+    }
+    if (TimerPort != NULL) {
+        DeleteMsgPort(TimerPort);
+        TimerPort = NULL;
     }
 }
 
-/* Create shell backdrop window - separate from main backdrop */
-BOOL CreateShellWindow(VOID)
+/* Schedule timer to fire after delayMicros, then every intervalMicros if set */
+/* Rescheduling an already scheduled timer moves it */
+VOID ScheduleTimer(struct ScheduledTimer *timer, ULONG delayMicros)
 {
-    ULONG screenWidth, screenHeight;
-    WORD windowTop;
-    WORD windowHeight = 200;  /* Fixed height: 200px at bottom */
+    struct ScheduledTimer **link;
+    struct ScheduledTimer *other;
+    struct timeval latest;
     
-    /* Prerequisites check */
-    if (!wsState.workspaceScreen) {
-        Printf("Workspace: Cannot create shell window - screen not available\n");
-        return FALSE;
+    if (!TimerBase) {
+        return;
     }
-    
-    /* Get screen dimensions */
-    screenWidth = wsState.workspaceScreen->Width;
-    screenHeight = wsState.workspaceScreen->Height;
-    
-    /* Handle case where screen dimensions might be 0 (use ViewPort dimensions) */
-    if (screenWidth == 0 && wsState.workspaceScreen->ViewPort.DWidth > 0) {
-        screenWidth = wsState.workspaceScreen->ViewPort.DWidth;
-        screenHeight = wsState.workspaceScreen->ViewPort.DHeight;
+    if (timer->scheduled) {
+        CancelTimer(timer);
     }
     
-    /* Calculate window position - at bottom of screen */
-    windowTop = screenHeight - windowHeight;
-    
-    /* Validate dimensions */
-    if (screenWidth <= 0 || windowHeight <= 0 || windowTop < 0) {
-        Printf("Workspace: ERROR - Invalid dimensions for shell window (Width=%lu, Height=%ld, Top=%ld)\n",
-               screenWidth, (LONG)windowHeight, (LONG)windowTop);
-        return FALSE;
+    GetSysTime(&timer->due);
+    timer->due.tv_secs += delayMicros / 1000000UL;
+    timer->due.tv_micro += delayMicros % 1000000UL;
+    if (timer->due.tv_micro >= 1000000UL) {
+        timer->due.tv_secs++;
+        timer->due.tv_micro -= 1000000UL;
     }
     
-    Printf("Workspace: Creating shell window: Left=0, Top=%ld, Width=%lu, Height=%ld\n",
-           (LONG)windowTop, screenWidth, (LONG)windowHeight);
-    
-    /* Open shell backdrop window - positioned at bottom of screen */
-    wsState.shellWindow = OpenWindowTags(NULL,
-        WA_Left, 0,
-        WA_Top, windowTop,
-        WA_Width, screenWidth,
-        WA_Height, windowHeight,
-        WA_CustomScreen, wsState.workspaceScreen,
-        WA_Backdrop, TRUE,
-        WA_Borderless, TRUE,
-        WA_DragBar, FALSE,
-        WA_IDCMP, 0,  /* No IDCMP needed - shell will handle it */
-        WA_DetailPen, -1,
-        WA_BlockPen, -1,
-        WA_Activate, FALSE,
-        TAG_DONE);
-    
-    if (wsState.shellWindow == NULL) {
-        Printf("Workspace: ERROR - Failed to open shell window (OpenWindowTags returned NULL)\n");
-        return FALSE;
+    /* Coalesce - fire together with a timer already due within our slack */
+    latest = timer->due;
+    latest.tv_secs += timer->slackMicros / 1000000UL;
+    latest.tv_micro += timer->slackMicros % 1000000UL;
+    if (latest.tv_micro >= 1000000UL) {
+        latest.tv_secs++;
+        latest.tv_micro -= 1000000UL;
+    }
+    for (other = scheduler.head; other != NULL; other = other->next) {
+        /* CmpTime(a, b) is negative when a is later than b */
+        if (CmpTime(&other->due, &timer->due) <= 0 && CmpTime(&latest, &other->due) <= 0) {
+            timer->due = other->due;
+            break;
+        }
     }
     
-    Printf("Workspace: Shell window opened successfully: 0x%lx\n", (ULONG)wsState.shellWindow);
-    Printf("Workspace: Shell window dimensions: LeftEdge=%ld, TopEdge=%ld, Width=%ld, Height=%ld\n",
-           (LONG)wsState.shellWindow->LeftEdge, (LONG)wsState.shellWindow->TopEdge,
-           (LONG)wsState.shellWindow->Width, (LONG)wsState.shellWindow->Height);
+    /* Insert after all timers due at the same time or earlier */
+    link = &scheduler.head;
+    while (*link != NULL && CmpTime(&timer->due, &(*link)->due) <= 0) {
+        link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    timer->scheduled = TRUE;
     
-    return TRUE;
+    if (scheduler.head == timer) {
+        ArmTimer();
+    }
 }
 
-/* Create shell console */
-BOOL CreateShellConsole(VOID)
+/* Remove timer from the schedule - nothing stays queued once the last one is gone */
+VOID CancelTimer(struct ScheduledTimer *timer)
 {
-    STRPTR conspec = NULL;
-    UBYTE conspecBuffer[256];
-    WORD windowWidth, windowHeight;
-    LONG result;
+    struct ScheduledTimer **link;
     
-    /* Prerequisites check */
-    if (!wsState.workspaceScreen || !wsState.shellEnabled) {
-        Printf("Workspace: Cannot create shell console - prerequisites not met\n");
-        return FALSE;
+    if (!timer->scheduled) {
+        return;
     }
-    
-    /* Create shell backdrop window if it doesn't exist */
-    if (!wsState.shellWindow) {
-        if (!CreateShellWindow()) {
-            Printf("Workspace: ERROR - Failed to create shell window\n");
-            return FALSE;
+    for (link = &scheduler.head; *link != NULL; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            break;
         }
     }
+    timer->next = NULL;
+    timer->scheduled = FALSE;
     
-    /* Get dimensions from the shell window */
-    windowWidth = wsState.shellWindow->Width;
-    windowHeight = wsState.shellWindow->Height;
-    
-    /* Validate dimensions */
-    if (windowWidth <= 0 || windowHeight <= 0) {
-        Printf("Workspace: ERROR - Invalid dimensions for shell console (Width=%ld, Height=%ld)\n",
-               (LONG)windowWidth, (LONG)windowHeight);
-        return FALSE;
+    if (scheduler.head == NULL && scheduler.requestPending) {
+        AbortIO((struct IORequest *)TimerIO);
+        WaitIO((struct IORequest *)TimerIO);
+        scheduler.requestPending = FALSE;
     }
+}
+
+/* Queue TimerIO for the earliest timer unless an earlier or equal request is queued */
+/* A request that comes back early just re-arms from RunDueTimers */
+VOID ArmTimer(VOID)
+{
+    struct timeval now;
     
-    Printf("Workspace: Shell console dimensions - width=%ld, height=%ld\n",
-           (LONG)windowWidth, (LONG)windowHeight);
-    
-    /* Build CON: device specifier using WINDOW parameter */
-    /* According to RKM: WINDOW instructs the console to hijack an already open window */
-    /* Format: CON:x/y/width/height/title/WINDOW 0x<hex_address> */
-    if (wsState.shellPath && wsState.shellPath[0] != '\0') {
-        /* Use custom shell path */
-        SNPrintf(conspecBuffer, sizeof(conspecBuffer), wsState.shellPath, wsState.workspaceName);
-        conspec = conspecBuffer;
-    } else {
-        /* Use default: CON:0/0/width/height//WINDOW 0x<hex_address> */
-        {
-            struct Window *win = wsState.shellWindow;
-            ULONG windowAddr;
-            
-            /* Get window address */
-            windowAddr = (ULONG)win;
-            
-            /* Build CON: specifier */
-            SNPrintf(conspecBuffer, sizeof(conspecBuffer),
-                     "CON:0/0/%ld/%ld//WINDOW 0x%08lX",
-                     (LONG)windowWidth, (LONG)windowHeight, windowAddr);
-            conspec = conspecBuffer;
-            
-            Printf("Workspace: CON: specifier: '%s'\n", conspec);
-            Printf("Workspace: Shell window pointer: 0x%lx\n", windowAddr);
+    if (scheduler.head == NULL) {
+        return;
+    }
+    if (scheduler.requestPending) {
+        if (CmpTime(&scheduler.head->due, &scheduler.armedDue) <= 0) {
+            return;  /* Queued request is not later than the head */
         }
+        AbortIO((struct IORequest *)TimerIO);
+        WaitIO((struct IORequest *)TimerIO);
+        scheduler.requestPending = FALSE;
     }
     
-    Printf("Workspace: Creating shell console with CON: spec: %s\n", conspec);
-    
-    /* Ensure window is on the workspace screen and active before hijacking */
-    if (wsState.shellWindow && wsState.shellWindow->WScreen != wsState.workspaceScreen) {
-        Printf("Workspace: WARNING - Shell window is not on workspace screen!\n");
-    }
+    /* TR_ADDREQUEST takes a delay - never less than 1us for a timer already due */
+    GetSysTime(&now);
+    TimerIO->tr_time = scheduler.head->due;
+    if (CmpTime(&now, &TimerIO->tr_time) > 0) {
+        SubTime(&TimerIO->tr_time, &now);
+    } else {
+        TimerIO->tr_time.tv_secs = 0;
+        TimerIO->tr_time.tv_micro = 1;
+    }
+    TimerIO->tr_node.io_Command = TR_ADDREQUEST;
+    SetSignal(0, 1L << TimerPort->mp_SigBit);
+    SendIO((struct IORequest *)TimerIO);
+    scheduler.armedDue = scheduler.head->due;
+    scheduler.requestPending = TRUE;
+}
+
+/* TimerPort signalled - run every timer that is due, then re-arm */
+VOID RunDueTimers(VOID)
+{
+    struct ScheduledTimer *timer;
+    struct timeval now;
     
-    /* Activate window and bring to front */
-    if (wsState.shellWindow) {
-        ActivateWindow(wsState.shellWindow);
-        WindowToFront(wsState.shellWindow);
-        ScreenToFront(wsState.workspaceScreen);
+    if (!scheduler.requestPending || !CheckIO((struct IORequest *)TimerIO)) {
+        return;
     }
+    WaitIO((struct IORequest *)TimerIO);
+    scheduler.requestPending = FALSE;
     
-    /* Use System() directly instead of NewShell command */
-    /* According to RKM: NewShell uses System() with SYS_InName pointing to CON: specifier */
-    /* Format: SystemTags(NULL, SYS_InName, window, SYS_CmdStream, ..., SYS_Output, 0, ...) */
-    {
-        BPTR cmdStream = 0;
-        BPTR startupFile = 0;
-        struct TagItem tags[8];
+    GetSysTime(&now);
+    while (scheduler.head != NULL && CmpTime(&now, &scheduler.head->due) <= 0) {
+        timer = scheduler.head;
+        scheduler.head = timer->next;
+        timer->next = NULL;
+        timer->scheduled = FALSE;
         
-        /* Open startup file (default is S:Shell-Startup) */
-        startupFile = Open("S:Shell-Startup", MODE_OLDFILE);
-        if (startupFile != 0) {
-            cmdStream = startupFile;
+        /* Re-arm repeating timers first so the callback may cancel them */
+        if (timer->intervalMicros != 0) {
+            ScheduleTimer(timer, timer->intervalMicros);
         }
-        
-        /* Build TagItem array - can't use variables in initializers in C89 */
-        /* According to RKM: With SYS_Asynch, must provide SYS_Input/InName AND SYS_Output/OutName */
-        /* Setting SYS_Output to ZERO makes it clone from input (the CON: device) */
-        tags[0].ti_Tag = SYS_InName;
-        tags[0].ti_Data = (ULONG)conspec;  /* CON: specifier with WINDOW parameter */
-        tags[1].ti_Tag = SYS_CmdStream;
-        tags[1].ti_Data = (ULONG)cmdStream;  /* Startup file stream */
-        tags[2].ti_Tag = SYS_Output;
-        tags[2].ti_Data = 0;  /* ZERO - clone from input (CON: device) to preserve our stdout */
-        tags[3].ti_Tag = SYS_Asynch;
-        tags[3].ti_Data = TRUE;  /* Must be TRUE to avoid blocking */
-        tags[4].ti_Tag = SYS_UserShell;
-        tags[4].ti_Data = TRUE;  /* Use user shell */
-        tags[5].ti_Tag = NP_StackSize;
-        tags[5].ti_Data = 4096;
-        tags[6].ti_Tag = NP_Name;
-        tags[6].ti_Data = (ULONG)"Workspace Shell";  /* Process name */
-        tags[7].ti_Tag = TAG_DONE;
-        tags[7].ti_Data = 0;
-        
-        /* Call System() directly with CON: specifier using WINDOW parameter */
-        /* Pass NULL as command since we're using SYS_CmdStream for startup file */
-        /* With NULL command and SYS_Asynch, shell reads from SYS_CmdStream then SYS_InName */
-        result = SystemTagList(NULL, tags);
-        
-        /* Note: cmdStream will be closed by System() when shell terminates */
+        timer->callback(timer);
     }
-    
-    /* SystemTagList returns process ID on success (non-zero) or 0 on failure */
-    /* However, with SYS_Asynch, it may return immediately before process starts */
-    if (result == 0) {
-        Printf("Workspace: WARNING - SystemTagList returned 0 (may be normal with async)\n");
-        /* Don't fail immediately - check if window was actually donated */
-        /* If window UserPort becomes NULL, it was successfully donated */
-        if (wsState.shellWindow && wsState.shellWindow->UserPort == NULL) {
-            Printf("Workspace: Window was donated to console despite return value 0\n");
-            /* Success - window was donated */
+    ArmTimer();
+}
+
+/* Deferred log ring flush */
+VOID LogFlushTimer(struct ScheduledTimer *timer)
+{
+    FlushLogRing();
+}
+
+/* Refill the spare desktop */
+VOID SpareTimer(struct ScheduledTimer *timer)
+{
+    PrepareSpareDesktop();
+}
+
+/* Hibernate screens that have been idle for HIBERNATE seconds */
+/* Idle = no visitors, no shell or requester, and not the front screen */
+VOID HibernateTimer(struct ScheduledTimer *timer)
+{
+    struct Desktop *desktop;
+    struct Desktop *previous = currentDesktop;
+    struct timeval now;
+    BOOL busy;
+    
+    GetSysTime(&now);
+    for (desktop = wsState.desktops; desktop != NULL; desktop = desktop->next) {
+        if (desktop->workspaceScreen == NULL) {
+            continue;
+        }
+        busy = FALSE;
+        if (desktop->shellEnabled || desktop->requesterWindow != NULL || desktop->closeRequested) {
+            busy = TRUE;
+        } else if (IntuitionBase->FirstScreen == desktop->workspaceScreen) {
+            /* Unlocked peek - only compared, never followed */
+            busy = TRUE;
         } else {
-            Printf("Workspace: ERROR - Failed to create shell console (System returned 0 and window not donated)\n");
-            return FALSE;
+            currentDesktop = desktop;
+            if (CheckWorkspaceVisitors() > 0) {
+                busy = TRUE;
+            }
+            currentDesktop = previous;
+        }
+        
+        if (busy || desktop->idleSince == 0) {
+            desktop->idleSince = now.tv_secs;
+        } else if (now.tv_secs - desktop->idleSince >= wsState.hibernateSeconds) {
+            HibernateDesktop(desktop);
         }
-    } else {
-        Printf("Workspace: SystemTagList returned process ID: %ld\n", result);
     }
-    
-    /* Verify window was actually donated (UserPort should be NULL) */
-    /* Small delay to let console take ownership */
-    Delay(1);
-    if (wsState.shellWindow && wsState.shellWindow->UserPort != NULL) {
-        Printf("Workspace: WARNING - Window was not donated to console\n");
-        return FALSE;
+}
+
+/* Convert the E-Clock interval from..to into seconds and microseconds */
+/* 64/32 bit long division - E-Clock high word is always below the frequency */
+VOID EClockElapsed(struct EClockVal *from, struct EClockVal *to, ULONG *seconds, ULONG *micros)
+{
+    ULONG hi;
+    ULONG lo;
+    ULONG quotient = 0;
+    ULONG remainder;
+    LONG bit;
+    
+    *seconds = 0;
+    *micros = 0;
+    if (eclockFrequency < 1000) {
+        return;
     }
     
-    /* IMPORTANT: When using WINDOW parameter, the console takes ownership of the window */
-    /* The console will close the window when it exits */
-    /* Don't set shellWindow to NULL - we'll detect when it's closed by checking UserPort */
-    Printf("Workspace: Shell console launched successfully - shell window ownership transferred to console\n");
-    Printf("Workspace: Note - when shell ends, console will close the shell window\n");
+    hi = to->ev_hi - from->ev_hi;
+    lo = to->ev_lo - from->ev_lo;
+    if (to->ev_lo < from->ev_lo) {
+        hi--;  /* Borrow from high word */
+    }
+    if (hi >= eclockFrequency) {
+        return;  /* Interval does not fit - also catches from > to */
+    }
     
-    /* Disable "Open AmigaShell" menu item since shell is now open */
-    /* Menu 0, Item 3, Sub 0 - format: (menu << 16) | (item << 8) | sub */
-    if (wsState.backdropWindow) {
-        OffMenu(wsState.backdropWindow, (0UL << 16) | (3UL << 8) | 0UL);
-        Printf("Workspace: Disabled 'Open AmigaShell' menu item\n");
+    remainder = hi;
+    for (bit = 31; bit >= 0; bit--) {
+        ULONG carry = remainder & 0x80000000UL;
+        remainder = (remainder << 1) | ((lo >> bit) & 1UL);
+        quotient <<= 1;
+        if (carry || remainder >= eclockFrequency) {
+            remainder -= eclockFrequency;
+            quotient |= 1;
+        }
     }
     
-    Printf("Workspace: Shell console created successfully\n");
-    return TRUE;
+    *seconds = quotient;
+    *micros = (remainder * 1000UL) / (eclockFrequency / 1000UL);
+    if (*micros > 999999UL) {
+        *micros = 999999UL;
+    }
 }
 
-/* Close shell console */
-VOID CloseShellConsole(VOID)
+/* Start timing an event - seconds/micros is the input event timestamp */
+/* (IntuiMessage or InputEvent), 0/0 if the event carries none */
+VOID LatencyBegin(struct LatencyProbe *probe, ULONG seconds, ULONG micros)
 {
-    /* If shell window exists and hasn't been donated to the console, close it */
-    /* Check if window is still valid (UserPort not NULL means we still own it) */
-    if (wsState.shellWindow != NULL) {
-        if (wsState.shellWindow->UserPort != NULL) {
-            /* We still own the window - close it */
-            Printf("Workspace: Closing shell window (not donated to console)\n");
-            CloseWindow(wsState.shellWindow);
-            wsState.shellWindow = NULL;
-        } else {
-            /* Window was donated to console - don't close it, console will close it */
-            Printf("Workspace: Shell window was donated to console - console will close it\n");
-            wsState.shellWindow = NULL;  /* Clear pointer, but don't close */
-        }
+    probe->queueMicros = 0;
+    probe->dispatch.ev_hi = 0;
+    probe->dispatch.ev_lo = 0;
+    if (!TimerBase) {
+        return;
     }
-    
-    wsState.shellEnabled = FALSE;
-    
-    /* Re-enable "Open AmigaShell" menu item since shell is now closed */
-    /* Menu 0, Item 3, Sub 0 - format: (menu << 16) | (item << 8) | sub */
-    if (wsState.backdropWindow) {
-        OnMenu(wsState.backdropWindow, (0UL << 16) | (3UL << 8) | 0UL);
-        Printf("Workspace: Re-enabled 'Open AmigaShell' menu item\n");
+    ReadEClock(&probe->dispatch);
+    if (seconds != 0 || micros != 0) {
+        struct timeval now;
+        
+        probe->origin.tv_secs = seconds;
+        probe->origin.tv_micro = micros;
+        GetSysTime(&now);
+        if (CmpTime(&now, &probe->origin) < 0) {
+            /* now is later than origin (CmpTime returns -1 when the first is greater) */
+            SubTime(&now, &probe->origin);
+            if (now.tv_secs < 4000) {
+                probe->queueMicros = now.tv_secs * 1000000UL + now.tv_micro;
+            } else {
+                probe->queueMicros = 0xFFFFFFFFUL;
+            }
+        }
     }
-    
-    Printf("Workspace: Shell console cleanup complete\n");
 }
 
-/* Load backdrop image */
-/* Parse command line arguments */
-BOOL ParseCommandLine(VOID)
+/* Finish timing an event and add it to the histogram for action */
+VOID LatencyEnd(struct LatencyProbe *probe, ULONG action)
 {
-    LONG argArray[5];
-    STRPTR pubNameArg = NULL;
-    STRPTR cxNameArg = NULL;
-    STRPTR backdropArg = NULL;
-    STRPTR cxPopKeyArg = NULL;
-    STRPTR themeArg = NULL;
-    static UBYTE pubNameBuffer[64];
-    static UBYTE cxNameBuffer[64];
-    static UBYTE backdropBuffer[256];
-    static UBYTE cxPopKeyBuffer[64];
-    static UBYTE themeBuffer[64];
-    
-    /* Initialize arg array */
-    argArray[0] = 0;
-    argArray[1] = 0;
-    argArray[2] = 0;
-    argArray[3] = 0;
-    argArray[4] = 0;
-    
-    /* Clear IoErr before ReadArgs */
-    SetIoErr(0);
+    ULONG total = LatencyRecord(probe, action);
     
-    /* Parse arguments: PUBNAME/K, CX_NAME/K, BACKDROP/K, CX_POPKEY/K, THEME/K */
-    wsState.rda = ReadArgs("PUBNAME/K,CX_NAME/K,BACKDROP/K,CX_POPKEY/K,THEME/K", argArray, NULL);
-    if (!wsState.rda) {
-        LONG errorCode = IoErr();
-        if (errorCode != 0) {
-            Printf("Workspace: ReadArgs failed with error: %ld\n", errorCode);
-        }
-        /* ReadArgs can return NULL even on success if no args provided */
-        /* Set defaults */
-        wsState.pubName = NULL;
-        wsState.cxName = NULL;
-        wsState.backdropImagePath = NULL;
-        wsState.cxPopKey = NULL;
-        wsState.themeName = NULL;
-        return TRUE; /* Not a fatal error */
+    if (action < LATENCY_COUNT) {
+        LOG_TRACE(("Workspace: Latency %s: %lu us (queue %lu us)\n",
+                   latencyNames[action], total, probe->queueMicros));
     }
-    
-    /* Extract arguments */
-    pubNameArg = (STRPTR)argArray[0];
-    cxNameArg = (STRPTR)argArray[1];
-    backdropArg = (STRPTR)argArray[2];
-    cxPopKeyArg = (STRPTR)argArray[3];
-    themeArg = (STRPTR)argArray[4];
-    
-    /* Store pubname if provided */
-    if (pubNameArg && pubNameArg[0] != '\0') {
-        SNPrintf(pubNameBuffer, sizeof(pubNameBuffer), "%s", pubNameArg);
-        wsState.pubName = pubNameBuffer;
-        Printf("Workspace: PUBNAME set to: %s\n", wsState.pubName);
+}
+
+/* LatencyEnd without logging (safe from the commodity task) - returns the latency */
+ULONG LatencyRecord(struct LatencyProbe *probe, ULONG action)
+{
+    struct EClockVal now;
+    struct LatencyStats *stats;
+    ULONG seconds;
+    ULONG micros;
+    ULONG total;
+    ULONG bucket;
+    
+    if (!TimerBase || action >= LATENCY_COUNT) {
+        return 0;
+    }
+    ReadEClock(&now);
+    EClockElapsed(&probe->dispatch, &now, &seconds, &micros);
+    if (seconds < 4000) {
+        total = seconds * 1000000UL + micros;
     } else {
-        wsState.pubName = NULL;
+        total = 0xFFFFFFFFUL;
     }
-    
-    /* Store cxname if provided */
-    if (cxNameArg && cxNameArg[0] != '\0') {
-        SNPrintf(cxNameBuffer, sizeof(cxNameBuffer), "%s", cxNameArg);
-        wsState.cxName = cxNameBuffer;
-        Printf("Workspace: CXNAME set to: %s\n", wsState.cxName);
+    if (total > 0xFFFFFFFFUL - probe->queueMicros) {
+        total = 0xFFFFFFFFUL;
     } else {
-        wsState.cxName = NULL;
+        total += probe->queueMicros;
     }
     
-    /* Store backdrop path if provided */
-    if (backdropArg && backdropArg[0] != '\0') {
-        SNPrintf(backdropBuffer, sizeof(backdropBuffer), "%s", backdropArg);
-        wsState.backdropImagePath = backdropBuffer;
-        Printf("Workspace: BACKDROP set to: %s\n", wsState.backdropImagePath);
-    } else {
-        wsState.backdropImagePath = NULL;
+    bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (total >> (LATENCY_BUCKET0_SHIFT + bucket)) != 0) {
+        bucket++;
     }
     
-    /* Store CX_POPKEY if provided */
-    if (cxPopKeyArg && cxPopKeyArg[0] != '\0') {
-        SNPrintf(cxPopKeyBuffer, sizeof(cxPopKeyBuffer), "%s", cxPopKeyArg);
-        wsState.cxPopKey = cxPopKeyBuffer;
-        Printf("Workspace: CX_POPKEY set to: %s\n", wsState.cxPopKey);
-    } else {
-        wsState.cxPopKey = NULL;
+    /* Both tasks record - Forbid keeps the histogram consistent for DumpLatencyStats */
+    stats = &latencyStats[action];
+    Forbid();
+    stats->count++;
+    stats->buckets[bucket]++;
+    stats->totalMillis += total / 1000UL;
+    if (total > stats->maxMicros) {
+        stats->maxMicros = total;
+    }
+    Permit();
+    return total;
+}
+
+/* Where statistics dumps go - the log file when the log ring is active, else the console */
+BPTR StatsOutput(VOID)
+{
+    if (logRing.records != NULL) {
+        FlushLogRing();
+        if (logRing.file != 0) {
+            return logRing.file;
+        }
     }
+    return Output();
+}
+
+/* Write latency histograms, one line per action: */
+/* latency <action> n=<count> avg=<ms> max=<us> hist=<bucket counts, <128us first> */
+VOID DumpLatencyStats(BPTR file)
+{
+    ULONG action;
+    ULONG bucket;
     
-    /* Store THEME if provided */
-    if (themeArg && themeArg[0] != '\0') {
-        SNPrintf(themeBuffer, sizeof(themeBuffer), "%s", themeArg);
-        wsState.themeName = themeBuffer;
-        Printf("Workspace: THEME set to: %s\n", wsState.themeName);
+    if (file == 0) {
+        return;
+    }
+    for (action = 0; action < LATENCY_COUNT; action++) {
+        struct LatencyStats stats;
+        ULONG avgMillis = 0;
         
-        /* Map theme name to index */
-        if (strcmp(themeArg, "dark") == 0 || strcmp(themeArg, "Dark Mode") == 0) {
-            wsState.currentTheme = THEME_DARK_MODE;
-        } else if (strcmp(themeArg, "sepia") == 0 || strcmp(themeArg, "Sepia") == 0) {
-            wsState.currentTheme = THEME_SEPIA;
-        } else if (strcmp(themeArg, "blue") == 0 || strcmp(themeArg, "Blue") == 0) {
-            wsState.currentTheme = THEME_BLUE;
-        } else if (strcmp(themeArg, "green") == 0 || strcmp(themeArg, "Green") == 0) {
-            wsState.currentTheme = THEME_GREEN;
-        } else {
-            /* Default to Like Workbench */
-            wsState.currentTheme = THEME_LIKE_WORKBENCH;
+        /* A copy - the commodity task may record while we print */
+        Forbid();
+        stats = latencyStats[action];
+        Permit();
+        if (stats.count != 0) {
+            avgMillis = stats.totalMillis / stats.count;
+        }
+        FPrintf(file, "latency %s n=%lu avg=%lums max=%luus hist=",
+                latencyNames[action], stats.count, avgMillis, stats.maxMicros);
+        for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            if (bucket < LATENCY_BUCKETS - 1) {
+                FPrintf(file, "%lu,", stats.buckets[bucket]);
+            } else {
+                FPrintf(file, "%lu\n", stats.buckets[bucket]);
+            }
         }
-    } else {
-        wsState.themeName = NULL;
     }
+    Flush(file);
+}
+
+/* Note free memory before a call that creates or frees a subsystem's resources - */
+/* plain AvailMem only, MEMF_LARGEST walks the free lists and is left to DumpMemStats */
+VOID MemProbeBegin(struct MemProbe *probe)
+{
+    probe->avail = AvailMem(MEMF_ANY);
+}
+
+/* Add what free memory dropped by during the call to account's cross-check */
+VOID MemProbeEnd(struct MemProbe *probe, ULONG account)
+{
+    struct MemAccount *acct = &memAccounts[account];
     
-    return TRUE;
+    acct->seen += (LONG)(probe->avail - AvailMem(MEMF_ANY));
+    acct->calls++;
 }
 
-BOOL LoadBackdropImage(STRPTR imagePath)
+/* Charge bytes Workspace allocated to account, negative when it frees them - */
+/* requirements are the flags they were allocated with, MEMF_CHIP counts as chip */
+VOID MemCharge(ULONG account, ULONG requirements, LONG bytes)
 {
-    Object *dtObject = NULL;
-    APTR drawHandle = NULL;
-    struct RastPort *rp = NULL;
-    LONG drawResult;
-    WORD screenWidth;
-    WORD screenHeight;
+    struct MemAccount *acct = &memAccounts[account];
     
-    if (!imagePath || imagePath[0] == '\0') {
-        Printf("Workspace: No backdrop image path provided\n");
-        return FALSE;
+    if (requirements & MEMF_CHIP) {
+        acct->chip += bytes;
+        if (acct->chip > acct->peakChip) {
+            acct->peakChip = acct->chip;
+        }
+    } else {
+        acct->any += bytes;
+        if (acct->any > acct->peakAny) {
+            acct->peakAny = acct->any;
+        }
     }
+}
+
+/* Write the memory accounts, one line per subsystem plus what is free now: */
+/* memory <account> chip=<held>/<peak> any=<held>/<peak> n=<calls> seen=<bytes> */
+/* memory free chip=<bytes> fast=<bytes> largest=<chip>,<fast> */
+VOID DumpMemStats(BPTR file)
+{
+    ULONG account;
     
-    if (!wsState.backdropWindow || !wsState.workspaceScreen) {
-        Printf("Workspace: Window or screen not available for backdrop image\n");
-        return FALSE;
+    if (file == 0) {
+        return;
     }
-    
-    if (!DataTypesBase) {
-        Printf("Workspace: datatypes.library not available\n");
-        return FALSE;
+    for (account = 0; account < MEMACCT_COUNT; account++) {
+        struct MemAccount *acct = &memAccounts[account];
+        
+        FPrintf(file, "memory %s chip=%ld/%ld any=%ld/%ld n=%lu seen=%ld\n",
+                memAccountNames[account], acct->chip, acct->peakChip, acct->any, acct->peakAny,
+                acct->calls, acct->seen);
+    }
+    FPrintf(file, "memory free chip=%lu fast=%lu largest=%lu,%lu\n",
+            AvailMem(MEMF_CHIP), AvailMem(MEMF_FAST),
+            AvailMem(MEMF_CHIP | MEMF_LARGEST), AvailMem(MEMF_FAST | MEMF_LARGEST));
+    Flush(file);
+}
+
+/* Start measuring the next startup phase */
+VOID ProfileMark(VOID)
+{
+    if (TimerBase) {
+        ReadEClock(&startupProfile.mark);
+    }
+    startupProfile.chipMark = AvailMem(MEMF_CHIP);
+    startupProfile.fastMark = AvailMem(MEMF_FAST);
+}
+
+/* Record the phase that just finished and start measuring the next one */
+VOID ProfilePhase(STRPTR name)
+{
+    struct ProfilePhaseRecord *phase;
+    struct EClockVal now;
+    ULONG seconds = 0;
+    ULONG micros = 0;
+    ULONG chipNow;
+    ULONG fastNow;
+    
+    if (TimerBase) {
+        ReadEClock(&now);
+        EClockElapsed(&startupProfile.mark, &now, &seconds, &micros);
+    }
+    chipNow = AvailMem(MEMF_CHIP);
+    fastNow = AvailMem(MEMF_FAST);
+    
+    if (startupProfile.phaseCount < PROFILE_MAX_PHASES) {
+        phase = &startupProfile.phases[startupProfile.phaseCount];
+        phase->name = name;
+        if (seconds < 4000) {
+            phase->micros = seconds * 1000000UL + micros;
+        } else {
+            phase->micros = 0xFFFFFFFFUL;
+        }
+        phase->chipUsed = (LONG)(startupProfile.chipMark - chipNow);
+        phase->fastUsed = (LONG)(startupProfile.fastMark - fastNow);
+        startupProfile.phaseCount++;
     }
     
-    Printf("Workspace: Loading backdrop image: %s\n", imagePath);
-    
-    /* Create datatype object for the image */
-    dtObject = NewDTObject((APTR)imagePath,
-                           DTA_GroupID, GID_PICTURE,
-                           PDTA_Screen, (ULONG)wsState.workspaceScreen,
-                           PDTA_Remap, TRUE,
-                           PDTA_DestMode, PMODE_V43,
-                           TAG_DONE);
+    /* Measure from here so the bookkeeping above is not charged to the next phase */
+    ProfileMark();
+}
+
+/* Write the startup profile, one line per phase plus a total: */
+/* <phase> <microseconds> <chip bytes used> <fast bytes used> */
+/* Goes to PROFILEFILE, or to ENV:<screen name>.profile of the first desktop */
+VOID WriteProfileReport(VOID)
+{
+    static UBYTE report[PROFILE_REPORT_SIZE];
+    UBYTE varName[80];
+    ULONG length = 0;
+    ULONG totalMicros = 0;
+    LONG totalChip = 0;
+    LONG totalFast = 0;
+    ULONG i;
     
-    if (!dtObject) {
-        LONG errorCode = IoErr();
-        Printf("Workspace: Failed to create datatype object (error: %ld)\n", errorCode);
-        return FALSE;
+    for (i = 0; i < startupProfile.phaseCount; i++) {
+        struct ProfilePhaseRecord *phase = &startupProfile.phases[i];
+        
+        SNPrintf(&report[length], PROFILE_REPORT_SIZE - length, "%s %lu %ld %ld\n",
+                 phase->name, phase->micros, phase->chipUsed, phase->fastUsed);
+        length += strlen((char *)&report[length]);
+        totalMicros += phase->micros;
+        totalChip += phase->chipUsed;
+        totalFast += phase->fastUsed;
+    }
+    SNPrintf(&report[length], PROFILE_REPORT_SIZE - length, "total %lu %ld %ld\n",
+             totalMicros, totalChip, totalFast);
+    length += strlen((char *)&report[length]);
+    
+    if (startupProfile.reportFile) {
+        BPTR file = Open(startupProfile.reportFile, MODE_NEWFILE);
+        if (file == 0) {
+            LOG_WARN(("Workspace: Cannot write profile to %s\n", startupProfile.reportFile));
+            return;
+        }
+        Write(file, report, length);
+        Close(file);
+        LOG_INFO(("Workspace: Startup profile written to %s\n", startupProfile.reportFile));
+    } else {
+        SNPrintf(varName, sizeof(varName), "%s.profile", wsState.desktops->workspaceName);
+        if (!SetVar(varName, report, length, GVF_GLOBAL_ONLY)) {
+            LOG_WARN(("Workspace: Cannot set ENV:%s\n", varName));
+            return;
+        }
+        LOG_INFO(("Workspace: Startup profile written to ENV:%s\n", varName));
+    }
+}
+
+/* Log output - prints directly, or queues a record when the log ring is active */
+/* Level and source line come from LOG_EMIT via logSiteLevel/logSiteLine */
+VOID LogPrintf(CONST_STRPTR format, ...)
+{
+    va_list ap;
+    LONG args[LOG_MAX_ARGS];
+    ULONG stringArgs = 0;  /* Bit n set if argument n is a %s */
+    UBYTE argCount = 0;
+    CONST_STRPTR p;
+    
+    /* Count conversions - every argument is pushed as a LONG */
+    for (p = format; *p != '\0'; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            continue;
+        }
+        while (*p == '-' || *p == '0' || (*p >= '1' && *p <= '9') || *p == '.' || *p == 'l') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (argCount < LOG_MAX_ARGS) {
+            if (*p == 's') {
+                stringArgs |= (1UL << argCount);
+            }
+            argCount++;
+        }
     }
     
-    Printf("Workspace: Datatype object created successfully\n");
-    
-    /* Obtain draw info (required before DrawDTObjectA) */
+    va_start(ap, format);
     {
-        struct TagItem drawTags[2];
-        drawTags[0].ti_Tag = PDTA_Screen;
-        drawTags[0].ti_Data = (ULONG)wsState.workspaceScreen;
-        drawTags[1].ti_Tag = TAG_DONE;
-        drawHandle = ObtainDTDrawInfoA(dtObject, drawTags);
+        UBYTE i;
+        for (i = 0; i < argCount; i++) {
+            args[i] = va_arg(ap, LONG);
+        }
     }
+    va_end(ap);
     
-    if (!drawHandle) {
-        Printf("Workspace: Failed to obtain draw info for backdrop image\n");
-        DisposeDTObject(dtObject);
-        return FALSE;
+    if (logRing.records == NULL) {
+        VPrintf(format, args);
+        return;
     }
     
-    Printf("Workspace: Draw info obtained successfully\n");
-    
-    /* Get window dimensions */
-    rp = wsState.backdropWindow->RPort;
-    screenWidth = wsState.backdropWindow->Width;
-    screenHeight = wsState.backdropWindow->Height;
+    /* Queue a record - oldest records are overwritten when the ring is full */
+    {
+        struct LogRecord *rec = &logRing.records[logRing.written & (LOG_RING_SIZE - 1)];
+        ULONG textUsed = 0;
+        UBYTE i;
+        
+        if (TimerBase) {
+            ReadEClock(&rec->timestamp);
+        } else {
+            rec->timestamp.ev_hi = 0;
+            rec->timestamp.ev_lo = 0;
+        }
+        rec->format = format;
+        rec->line = logSiteLine;
+        rec->level = logSiteLevel;
+        rec->argCount = argCount;
+        for (i = 0; i < argCount; i++) {
+            rec->args[i] = args[i];
+            if ((stringArgs & (1UL << i)) && args[i] != 0) {
+                /* Copy the string - the caller's buffer may be gone by flush time */
+                CONST_STRPTR src = (CONST_STRPTR)args[i];
+                STRPTR dst = &rec->text[textUsed];
+                while (*src != '\0' && textUsed < LOG_TEXT_SIZE - 1) {
+                    rec->text[textUsed++] = *src++;
+                }
+                rec->text[textUsed++] = '\0';
+                rec->args[i] = (LONG)dst;
+                if (textUsed >= LOG_TEXT_SIZE) {
+                    textUsed = LOG_TEXT_SIZE - 1;  /* Further strings become empty */
+                }
+            }
+        }
+        logRing.written++;
+    }
+}
+
+/* Start queueing log records in memory, to be written to path (NULL = default) */
+BOOL StartLogRing(STRPTR path)
+{
+    if (path == NULL || path[0] == '\0') {
+        path = LOG_DEFAULT_FILE;
+    }
+    logRing.path = path;
     
-    /* Draw the image to fill the backdrop window */
-    drawResult = DrawDTObjectA(rp, dtObject,
-                               0, 0,  /* x, y */
-                               screenWidth, screenHeight,  /* width, height */
-                               0, 0,  /* th, tv */
-                               TAG_DONE);
+    if (logRing.records != NULL) {
+        return TRUE;  /* Already running - only the file name changed */
+    }
     
-    if (!drawResult) {
-        Printf("Workspace: Failed to draw backdrop image\n");
-        ReleaseDTDrawInfo(dtObject, drawHandle);
-        DisposeDTObject(dtObject);
+    logRing.records = AllocVec(sizeof(struct LogRecord) * LOG_RING_SIZE, MEMF_ANY);
+    if (logRing.records == NULL) {
+        LOG_WARN(("Workspace: WARNING - No memory for log ring, logging to console\n"));
         return FALSE;
     }
-    
-    Printf("Workspace: Backdrop image drawn successfully\n");
-    
-    /* Store object and draw handle for cleanup */
-    wsState.backdropImageObj = dtObject;
-    wsState.backdropDrawHandle = drawHandle;
-    
+    logRing.written = 0;
+    logRing.flushed = 0;
+    logRing.file = 0;
     return TRUE;
 }
 
-/* Free backdrop image */
-VOID FreeBackdropImage(VOID)
+/* Format and write all queued records to the log file */
+VOID FlushLogRing(VOID)
 {
-    if (wsState.backdropImageObj) {
-        /* Release draw info if obtained */
-        if (wsState.backdropDrawHandle) {
-            ReleaseDTDrawInfo(wsState.backdropImageObj, wsState.backdropDrawHandle);
-            wsState.backdropDrawHandle = NULL;
+    if (!LogRingPending()) {
+        return;
+    }
+    
+    if (logRing.file == 0) {
+        /* Shared lock and append, so several instances can use the same file */
+        logRing.file = Open(logRing.path, MODE_READWRITE);
+        if (logRing.file == 0) {
+            logRing.flushed = logRing.written;  /* Nowhere to write - drop */
+            return;
         }
-        
-        /* Dispose of datatype object */
-        DisposeDTObject(wsState.backdropImageObj);
-        wsState.backdropImageObj = NULL;
-        Printf("Workspace: Backdrop image freed\n");
+        Seek(logRing.file, 0, OFFSET_END);
     }
-}
-
-/* Process commodity messages from Exchange program */
-VOID ProcessCommodityMessages(VOID)
-{
-    CxMsg *cxmsg;
     
-    if (CommoditiesBase == NULL || wsState.commodityPort == NULL) {
-        return;
+    if (logRing.written - logRing.flushed > LOG_RING_SIZE) {
+        FPrintf(logRing.file, "Workspace: ... %lu log records lost\n",
+                logRing.written - logRing.flushed - LOG_RING_SIZE);
+        logRing.flushed = logRing.written - LOG_RING_SIZE;
     }
     
-    while ((cxmsg = (CxMsg *)GetMsg(wsState.commodityPort)) != NULL) {
-        if (CxMsgType(cxmsg) & CXM_COMMAND) {
-            switch (CxMsgID(cxmsg)) {
-                case CXCMD_DISABLE:
-                    /* Disable commodity - deactivate broker */
-                    if (wsState.commodityActive && wsState.commodityBroker) {
-                        /* ActivateCxObj returns previous state */
-                        ActivateCxObj(wsState.commodityBroker, FALSE);
-                        wsState.commodityActive = FALSE;
-                        Printf("Workspace: Commodity disabled\n");
-                    }
-                    break;
-                
-                case CXCMD_ENABLE:
-                    /* Enable commodity - reactivate broker */
-                    if (!wsState.commodityActive && wsState.commodityBroker) {
-                        /* ActivateCxObj returns previous state */
-                        LONG prevState = ActivateCxObj(wsState.commodityBroker, TRUE);
-                        if (prevState == 0) {
-                            /* Was inactive, now active - expected */
-                            wsState.commodityActive = TRUE;
-                            Printf("Workspace: Commodity enabled\n");
-                        } else {
-                            /* Was already active - unexpected */
-                            wsState.commodityActive = TRUE;
-                            Printf("Workspace: WARNING - Broker was already active when enabling\n");
-                        }
-                    }
-                    break;
-                
-                case CXCMD_APPEAR:
-                    /* Show/bring workspace screen to front */
-                    Printf("Workspace: Received CXCMD_APPEAR\n");
-                    if (wsState.workspaceScreen) {
-                        ScreenToFront(wsState.workspaceScreen);
-                        /* Note: Backdrop windows cannot be depth-arranged, so WindowToFront() is invalid */
-                    }
-                    break;
-                
-                case CXCMD_DISAPPEAR:
-                    /* Hide workspace - safely ignore for now to prevent lockups */
-                    /* Just acknowledge and reply - do not perform any operations */
-                    Printf("Workspace: Received CXCMD_DISAPPEAR (ignored)\n");
-                    /* Immediately reply to prevent lockup */
-                    ReplyMsg((struct Message *)cxmsg);
-                    continue; /* Skip the ReplyMsg at end of loop */
-                
-                case CXCMD_KILL:
-                    /* Quit application - check visitors first */
-                    Printf("Workspace: Received CXCMD_KILL\n");
-                    /* HandleCloseMenu will check visitors and only set quitFlag if allowed */
-                    HandleCloseMenu();
-                    break;
-                
-                case CXCMD_UNIQUE:
-                    /* Another instance tried to start - show ourselves */
-                    Printf("Workspace: Received CXCMD_UNIQUE (another instance tried to start)\n");
-                    if (wsState.workspaceScreen) {
-                        ScreenToFront(wsState.workspaceScreen);
-                        /* Note: Backdrop windows cannot be depth-arranged, so WindowToFront() is invalid */
-                    }
-                    break;
-                
-                default:
-                    Printf("Workspace: Received unknown commodity command: %ld\n", CxMsgID(cxmsg));
-                    break;
-            }
-        } else if (CxMsgType(cxmsg) & CXM_IEVENT) {
-            /* Input event message - check if it's from our hotkey filter */
-            if (CxMsgID(cxmsg) == 1) {
-                /* This is from our sender (ID 1) - hotkey was pressed */
-                Printf("Workspace: Hotkey pressed - bringing screen to front\n");
-                if (wsState.workspaceScreen) {
-                    ScreenToFront(wsState.workspaceScreen);
-                }
-            }
-        }
+    while (logRing.flushed != logRing.written) {
+        struct LogRecord *rec = &logRing.records[logRing.flushed & (LOG_RING_SIZE - 1)];
+        ULONG seconds;
+        ULONG micros;
+        STRPTR levelName;
         
-        /* Always reply to the message */
-        ReplyMsg((struct Message *)cxmsg);
+        EClockElapsed(&logRing.startTime, &rec->timestamp, &seconds, &micros);
+        if (rec->level <= WS_LOG_TRACE) {
+            levelName = logLevelNames[rec->level];
+        } else {
+            levelName = "?";
+        }
+        FPrintf(logRing.file, "%5lu.%06lu %-5s %4ld ", seconds, micros, levelName, (LONG)rec->line);
+        VFPrintf(logRing.file, rec->format, rec->args);
+        logRing.flushed++;
     }
+    
+    Flush(logRing.file);
 }
 
-/* Parse tooltypes */
-VOID ParseToolTypes(VOID)
-{
-    /* TODO: Implement tooltype parsing */
-    /* Tooltypes to support:
-     * - SHELL/S or SHELLENABLED/S: Enable shell console
-     * - SHELLPATH/K: Path to shell (default: CON:...)
-     * - BACKDROP/K: Path to backdrop image
-     */
-}
-
-/* Get tooltype value */
-BOOL GetToolType(STRPTR toolType, STRPTR defaultValue, STRPTR buffer, ULONG bufferSize)
+/* Write out what is left in the ring and stop queueing */
+VOID StopLogRing(VOID)
 {
-    /* TODO: Implement tooltype retrieval */
-    if (defaultValue) {
-        Strncpy(buffer, defaultValue, bufferSize);
-        return TRUE;
+    if (logRing.records == NULL) {
+        return;
     }
-    return FALSE;
+    FlushLogRing();
+    if (logRing.file != 0) {
+        Close(logRing.file);
+        logRing.file = 0;
+    }
+    FreeVec(logRing.records);
+    logRing.records = NULL;
 }
 
 /* Cleanup libraries */
 VOID Cleanup(VOID)
 {
+    RemoveMemHandler();
+    StopLogRing();
+    
+    /* Desktops are all closed by now - only the shared ports and registry are left */
+    CloseRegistry();
+    CloseLaunchPort();
+    if (wsState.windowPort) {
+        DeleteMsgPort(wsState.windowPort);
+        wsState.windowPort = NULL;
+    }
+    
     if (InputIO != NULL) {
         CloseDevice((struct IORequest *)InputIO);
         DeleteIORequest((struct IORequest *)InputIO);
@@ -3372,5 +6577,18 @@ VOID Cleanup(VOID)
         CloseLibrary((struct Library *)IntuitionBase);
         IntuitionBase = NULL;
     }
+    
+    if (wsState.shellSigBit != -1) {
+        FreeSignal(wsState.shellSigBit);
+        wsState.shellSigBit = -1;
+    }
+    
+    CleanupTimer();
+    
+    /* Free command line arguments - wsState and the log ring point into them */
+    if (wsState.rda) {
+        FreeArgs(wsState.rda);
+        wsState.rda = NULL;
+    }
 }
 